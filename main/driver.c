@@ -39,12 +39,14 @@
 #include "esp_log.h"
 #include "sdkconfig.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
 #include "soc/rtc.h"
 #include "driver/gpio.h"
 #include "driver/timer.h"
 #include "driver/ledc.h"
 #include "driver/rmt.h"
 #include "hal/rmt_ll.h"
+#include "soc/soc_caps.h"
 #include "driver/i2c.h"
 #include "hal/gpio_types.h"
 #include "xtensa/core-macros.h"
@@ -62,6 +64,20 @@
 
 #if USE_I2S_OUT
 #include "i2s_out.h"
+#include "grbl/planner.h"
+#include "grbl/nvs_buffer.h"
+#endif
+
+#if USE_I2S_IN
+#include "i2s_in.h"
+#endif
+
+#if ISR_STATS_ENABLE
+#include "isr_stats.h"
+#endif
+
+#if PCNT_ENCODER_ENABLE
+#include "pcnt_encoder.h"
 #endif
 
 #if WIFI_ENABLE
@@ -165,6 +181,49 @@ typedef struct {
 static pwm_ramp_t pwm_ramp;
 #endif
 
+#if STEP_BURST_ENABLE
+
+typedef enum {
+    Burst_Off = 0,  // ISR per step
+    Burst_Armed,    // pulses captured, train starts on next tick
+    Burst_Running   // RMT is outputting the pulse train
+} burst_state_t;
+
+typedef struct {
+    volatile burst_state_t state;
+    union {
+        uint8_t inhibit;
+        struct {
+            uint8_t homing  :1,
+                    probing :1,
+                    laser   :1,
+                    unused  :5;
+        };
+    };
+    bool candidate;                     // last pulse output may start a train
+    bool capture;                       // core stepper callback outputs are captured
+    bool held;                          // captured pulse not part of the train is pending
+    bool go_idle;                       // core requested go idle during capture
+    bool resume;                        // capture ended by the time limit, the core callback is run when the train completes
+    bool enable_pending;                // stepper enable change requested during a train
+    bool held_dir_change;
+    axes_signals_t held_dir_outbits;
+    axes_signals_t held_step_outbits;
+    axes_signals_t step_outbits;        // step bits of the train
+    axes_signals_t enable;
+    uint32_t channels;                  // RMT channels of the train
+    uint32_t count;                     // number of pulses in the train
+    uint32_t max_count;
+    uint32_t idle_ticks;                // idle time padding the pulse item to the step interval
+    uint32_t cycles_per_tick;           // current step interval
+    uint32_t train_cycles;              // step interval of the train
+    uint32_t held_cycles;               // interval from the last pulse of the train to the held pulse
+} step_burst_t;
+
+static step_burst_t burst = {0};
+
+#endif
+
 #if SAFETY_DOOR_ENABLE
 static input_signal_t *door_pin;
 #endif
@@ -413,12 +472,86 @@ static output_signal_t outputpin[] = {
 };
 
 static bool IOInitDone = false, rtc_started = false;
-static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED, debounce_mux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED, debounce_mux = portMUX_INITIALIZER_UNLOCKED, debounce_timer_mux = portMUX_INITIALIZER_UNLOCKED;
 #if PROBE_ENABLE
 static probe_state_t probe = {
     .connected = On
 };
-#endif
+
+#if PROBE_ISR
+
+/*
+  The probe edge is latched by interrupt with a timestamp and the step pulses output while probing are logged with theirs,
+  both from esp_timer_get_time() as the interrupts may run on different cores. When probing completes the steps output
+  after the edge are removed from the probe position and the position is rounded to the step nearest the edge.
+  Steps known to be after the edge when logged are counted per axis, others go to a ring that only has to cover
+  the steps output until the latched edge is seen: PROBE_ISR_LATENCY_US at PROBE_STEP_RATE_MAX plus the step before the edge.
+*/
+
+#define PROBE_STEP_LOG_SIZE (PROBE_STEP_RATE_MAX / 1000 * PROBE_ISR_LATENCY_US / 1000 + 2)
+
+typedef struct {
+    uint32_t time;                  // esp_timer_get_time() at output
+    axes_signals_t step_outbits;
+    axes_signals_t dir_outbits;
+} probe_step_t;
+
+typedef struct {
+    volatile bool edge;             // probe edge latched
+    volatile bool frozen;           // log frozen on probe trigger detection
+    uint32_t edge_time;             // esp_timer_get_time() at probe edge interrupt
+    uint32_t head;                  // next ring entry
+    uint32_t count;                 // steps logged to the ring
+    probe_step_t step[PROBE_STEP_LOG_SIZE];
+    int32_t after[N_AXIS];          // steps known to be after the edge, negated
+    uint32_t after_time[N_AXIS];    // time of the first of them
+    int8_t after_dir[N_AXIS];       // and its direction, negated
+} probe_log_t;
+
+static input_signal_t *probe_pin = NULL;
+static probe_log_t probe_log = {0};
+
+inline __attribute__((always_inline)) IRAM_ATTR static void probe_log_step (stepper_t *stepper)
+{
+    uint32_t time = (uint32_t)esp_timer_get_time();
+
+    if(probe_log.edge && (int32_t)(time - probe_log.edge_time) > 0) {
+        uint_fast8_t axis;
+        for(axis = 0; axis < N_AXIS; axis++) {
+            if(stepper->step_outbits.mask & bit(axis)) {
+                int8_t dir = (stepper->dir_outbits.mask & bit(axis)) ? 1 : -1;
+                if(probe_log.after[axis] == 0) {
+                    probe_log.after_time[axis] = time;
+                    probe_log.after_dir[axis] = dir;
+                }
+                probe_log.after[axis] += dir;
+            }
+        }
+    } else {
+        probe_step_t *step = &probe_log.step[probe_log.head];
+
+        step->time = time;
+        step->step_outbits = stepper->step_outbits;
+        step->dir_outbits = stepper->dir_outbits;
+        if(++probe_log.head == PROBE_STEP_LOG_SIZE)
+            probe_log.head = 0;
+        probe_log.count++;
+    }
+}
+
+inline __attribute__((always_inline)) IRAM_ATTR static void probe_latch_edge (input_signal_t *signal, uint32_t time)
+{
+    signal->active = true;
+
+    if(!probe_log.edge) {
+        probe_log.edge_time = time;
+        probe_log.edge = true;
+    }
+}
+
+#endif // PROBE_ISR
+
+#endif // PROBE_ENABLE
 
 #if IOEXPAND_ENABLE
 static ioexpand_t iopins = {0};
@@ -445,6 +578,9 @@ static bool irq_claim (irq_type_t irq, uint_fast8_t id, irq_callback_ptr handler
 static void gpio_limit_isr (void *signal);
 static void gpio_control_isr (void *signal);
 static void gpio_aux_isr (void *signal);
+#if PROBE_ISR
+static void gpio_probe_isr (void *signal);
+#endif
 #if MPG_MODE == 1
 static void gpio_mpg_isr (void *signal);
 #endif
@@ -453,10 +589,20 @@ static void gpio_i2c_strobe_isr (void *signal);
 #endif
 #else
 static void gpio_isr (void *arg);
+static uint8_t gpio_input_map[GPIO_NUM_MAX]; // GPIO number to inputpin[] index, 0xFF if not an input
+#endif
+#if USE_I2S_IN
+static void i2s_in_event (uint32_t events);
+static uint8_t i2s_input_map[I2S_IN_NUM_BITS]; // I2S input number to inputpin[] index, 0xFF if not an input
 #endif
 static void stepper_driver_isr (void *arg);
 
-static TimerHandle_t xDelayTimer = NULL, debounceTimer = NULL;
+static bool debounce_start (input_signal_t *signal);
+
+static TimerHandle_t xDelayTimer = NULL;
+static esp_timer_handle_t debounceTimer = NULL;
+static volatile bool debounce_armed = false;
+static uint32_t debounce_next;
 
 void vTimerCallback (TimerHandle_t xTimer)
 {
@@ -497,6 +643,14 @@ IRAM_ATTR static void driver_delay_ms (uint32_t ms, void (*callback)(void))
 // Enable/disable steppers
 static void stepperEnable (axes_signals_t enable)
 {
+#if STEP_BURST_ENABLE
+    if(burst.state != Burst_Off) {
+        burst.enable = enable;
+        burst.enable_pending = true;
+        return;
+    }
+#endif
+
     enable.mask ^= settings.steppers.enable_invert.mask;
 
 #if !TRINAMIC_MOTOR_ENABLE
@@ -545,6 +699,14 @@ static void stepperWakeUp (void)
     // Enable stepper drivers.
     stepperEnable((axes_signals_t){AXES_BITMASK});
 
+#if STEP_BURST_ENABLE
+    // Core went idle during capture and the train is still running, keep the timer running.
+    if(burst.state != Burst_Off) {
+        burst.go_idle = false;
+        return;
+    }
+#endif
+
     timer_set_counter_value(STEP_TIMER_GROUP, STEP_TIMER_INDEX, 0x00000000ULL);
 //  timer_set_alarm_value(STEP_TIMER_GROUP, STEP_TIMER_INDEX, 5000ULL);
 #if CONFIG_IDF_TARGET_ESP32S3
@@ -562,63 +724,10 @@ static void stepperWakeUp (void)
 #endif
 }
 
-// Sets up stepper driver interrupt timeout
-IRAM_ATTR static void stepperCyclesPerTick (uint32_t cycles_per_tick)
-{
-// Limit min steps/s to about 2 (hal.f_step_timer @ 20MHz)
-#if CONFIG_IDF_TARGET_ESP32S3
-  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarmlo.val = cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL;
-  #else
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarmlo.val = cycles_per_tick < (1UL << 23) ? cycles_per_tick : (1UL << 23) - 1UL;
-  #endif
-#else
-  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low = cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL;
-  #else
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low = cycles_per_tick < (1UL << 23) ? cycles_per_tick : (1UL << 23) - 1UL;
-  #endif
-#endif
-}
-
-// Set stepper direction output pins
-// NOTE: see note for set_step_outputs()
-inline IRAM_ATTR static void set_dir_outputs (axes_signals_t dir_outbits)
-{
-    dir_outbits.value ^= settings.steppers.dir_invert.mask;
-
-    DIGITAL_OUT(X_DIRECTION_PIN, dir_outbits.x);
-    DIGITAL_OUT(Y_DIRECTION_PIN, dir_outbits.y);
-#ifdef Z_DIRECTION_PIN
-    DIGITAL_OUT(Z_DIRECTION_PIN, dir_outbits.z);
-#endif
-#ifdef A_AXIS
-    DIGITAL_OUT(A_DIRECTION_PIN, dir_outbits.a);
-#endif
-#ifdef B_AXIS
-    DIGITAL_OUT(B_DIRECTION_PIN, dir_outbits.b);
-#endif
-#ifdef C_AXIS
-    DIGITAL_OUT(C_DIRECTION_PIN, dir_outbits.c);
-#endif
-#ifdef GANGING_ENABLED
-    dir_outbits.mask ^= settings.steppers.ganged_dir_invert.mask;
-  #ifdef X2_DIRECTION_PIN
-    DIGITAL_OUT(X2_DIRECTION_PIN, dir_outbits.x);
-  #endif
-  #ifdef Y2_DIRECTION_PIN
-    DIGITAL_OUT(Y2_DIRECTION_PIN, dir_outbits.y);
-  #endif
-  #ifdef Z2_DIRECTION_PIN
-    DIGITAL_OUT(Z2_DIRECTION_PIN, dir_outbits.z);
-  #endif
-#endif
-}
+#include "step_out.h"
 
 #ifdef SQUARING_ENABLED
 
-static axes_signals_t motors_1 = {AXES_BITMASK}, motors_2 = {AXES_BITMASK};
-
 // Enable/disable motors for auto squaring of ganged axes
 static void StepperDisableMotors (axes_signals_t axes, squaring_mode_t mode)
 {
@@ -630,133 +739,156 @@ static void StepperDisableMotors (axes_signals_t axes, squaring_mode_t mode)
 
 #if USE_I2S_OUT
 
-static bool goIdlePending = false;
-static uint32_t i2s_step_length = I2S_OUT_USEC_PER_PULSE, i2s_delay_length = I2S_OUT_USEC_PER_PULSE, i2s_delay_samples = 1, i2s_step_samples = 1;
-static bool laser_mode = false;
+static bool goIdlePending = false, laser_mode = false;
+static on_state_change_ptr on_state_change;
 #if DRIVER_SPINDLE_ENABLE
 static on_spindle_selected_ptr on_spindle_selected;
 #endif
 
-// Set stepper pulse output pins
-inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits_1);
+#if I2S_OUT_ALIGNED_OUTPUTS
 
-#if !CONFIG_IDF_TARGET_ESP32S3
+// GPIO and PWM outputs changed while stepping are applied when the I2S outputs change, up to I2S_OUT_DMABUF_COUNT
+// DMA buffers later: from the pulse callback when the stream position is output, from elsewhere when the
+// committed DMA buffers are. I2S outputs need no queue, they are written to the stream.
+// The changes are queued with the time due and applied in order from a one-shot timer.
+
+typedef struct {
+    int64_t due;                // esp_timer time
+    i2s_output_ptr output;
+    uint32_t arg;
+    uint32_t value;
+} i2s_output_t;
+
+typedef struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    i2s_output_t output[I2S_OUT_ALIGNED_QUEUE_SIZE];
+} i2s_output_queue_t;
+
+static i2s_output_queue_t i2s_output = {0};
+static esp_timer_handle_t i2sOutputTimer = NULL;
+static portMUX_TYPE i2s_output_mux = portMUX_INITIALIZER_UNLOCKED;
 
-IRAM_ATTR static void delay_us (uint32_t us)
+// Applies the queued changes due by time in order, returns the time the next change is due or 0 if none are left.
+static int64_t i2s_output_apply (int64_t time)
 {
-#if CONFIG_IDF_TARGET_ESP32S3
-    int32_t t = XTHAL_GET_CCOUNT() + hal.f_mcu * us;
+    int64_t next = 0;
+    i2s_output_t output;
 
-    while((XTHAL_GET_CCOUNT() - t) < 0) {
-        __asm__ __volatile__ ("nop");
-    }
-#else
-    uint64_t start_time = esp_timer_get_time();
+    portENTER_CRITICAL(&i2s_output_mux);
 
-    while (esp_timer_get_time() - start_time < us) {
-        __asm__ __volatile__ ("nop");
+    while(i2s_output.tail != i2s_output.head) {
+        if(i2s_output.output[i2s_output.tail].due > time) {
+            next = i2s_output.output[i2s_output.tail].due;
+            break;
+        }
+        output = i2s_output.output[i2s_output.tail];
+        i2s_output.tail = (i2s_output.tail + 1) & (I2S_OUT_ALIGNED_QUEUE_SIZE - 1);
+        portEXIT_CRITICAL(&i2s_output_mux);
+        output.output(output.arg, output.value);
+        portENTER_CRITICAL(&i2s_output_mux);
     }
-#endif
+
+    portEXIT_CRITICAL(&i2s_output_mux);
+
+    return next;
 }
 
-#endif // !CONFIG_IDF_TARGET_ESP32S3
+// Discards the queued changes, on a reset the core sets the outputs.
+IRAM_ATTR static void i2s_output_flush (void)
+{
+    portENTER_CRITICAL_SAFE(&i2s_output_mux);
+    i2s_output.tail = i2s_output.head;
+    portEXIT_CRITICAL_SAFE(&i2s_output_mux);
+}
 
-IRAM_ATTR static void I2SStepperCyclesPerTick (uint32_t cycles_per_tick)
+static void i2sOutputTimerCallback (void *arg)
 {
-    i2s_out_set_pulse_period((cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL) / (hal.f_step_timer / 1000000));
+    int64_t now = esp_timer_get_time(), next;
+
+    if((next = i2s_output_apply(now)))
+        esp_timer_start_once(i2sOutputTimer, next > now ? next - now : 1);
 }
 
-// Sets stepper direction and pulse pins and starts a step pulse
-// Called when in I2S stepping mode
-IRAM_ATTR static void I2SStepperPulseStart (stepper_t *stepper)
+// Queues an output change to be applied when the I2S outputs catch up. When not stepping the change is queued
+// behind any pending changes so the order is kept.
+// Returns false if there is nothing to wait for, the queue is full or called from an interrupt handler,
+// the caller should then change the output immediately.
+IRAM_ATTR bool i2s_output_defer (i2s_output_ptr output, uint32_t arg, uint32_t value)
 {
-    if(stepper->dir_change) {
-        set_dir_outputs(stepper->dir_outbits);
-        if(stepper->step_outbits.value)
-            i2s_out_push_sample(i2s_delay_samples);
-    }
+    bool queued, start = false;
+    int64_t now, due;
+    uint_fast8_t head, next;
+    uint32_t delay;
 
-    if(stepper->step_outbits.value) {
-        i2s_set_step_outputs(stepper->step_outbits);
-        i2s_out_push_sample(i2s_step_samples);
-        i2s_set_step_outputs((axes_signals_t){0});
+    if(i2sOutputTimer == NULL || xPortInIsrContext())
+        return false;
+
+    if((delay = i2s_out_get_stream_delay_us()) == 0 && i2s_out_get_pulser_status() == STEPPING)
+        delay = i2s_out_get_delay_us();
+
+    due = (now = esp_timer_get_time()) + delay;
+
+    portENTER_CRITICAL(&i2s_output_mux);
+
+    head = i2s_output.head;
+    next = (head + 1) & (I2S_OUT_ALIGNED_QUEUE_SIZE - 1);
+
+    if((queued = (delay || head != i2s_output.tail) && next != i2s_output.tail)) {
+        if(!(start = head == i2s_output.tail) && due < i2s_output.output[(head - 1) & (I2S_OUT_ALIGNED_QUEUE_SIZE - 1)].due)
+            due = i2s_output.output[(head - 1) & (I2S_OUT_ALIGNED_QUEUE_SIZE - 1)].due;
+        i2s_output.output[head].due = due;
+        i2s_output.output[head].output = output;
+        i2s_output.output[head].arg = arg;
+        i2s_output.output[head].value = value;
+        i2s_output.head = next;
     }
+
+    portEXIT_CRITICAL(&i2s_output_mux);
+
+    if(start)
+        esp_timer_start_once(i2sOutputTimer, due > now ? due - now : 1);
+
+    return queued;
 }
 
-// Starts stepper driver ISR timer and forces a stepper driver interrupt callback
-static void I2SStepperWakeUp (void)
+void i2s_output_gpio (uint32_t pin, uint32_t level)
 {
-    // Enable stepper drivers.
-    stepperEnable((axes_signals_t){AXES_BITMASK});
-    i2s_out_set_stepping();
+    gpio_ll_set_level(&GPIO, pin, level);
 }
 
-#ifdef SQUARING_ENABLED
-
-// Set stepper pulse output pins
-inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits_1)
+static void i2s_output_init (void)
 {
-    axes_signals_t step_outbits_2;
-    step_outbits_2.mask = (step_outbits_1.mask & motors_2.mask) ^ settings.steppers.step_invert.mask;
-    step_outbits_1.mask = (step_outbits_1.mask & motors_1.mask) ^ settings.steppers.step_invert.mask;
+    esp_timer_create_args_t output_timer_args = {
+        .callback = i2sOutputTimerCallback,
+        .name = "i2s_output"
+    };
 
-    DIGITAL_OUT(X_STEP_PIN, step_outbits_1.x);
-    DIGITAL_OUT(Y_STEP_PIN, step_outbits_1.y);
-#ifdef Z_STEP_PIN
-    DIGITAL_OUT(Z_STEP_PIN, step_outbits_1.z);
-#endif
-#ifdef X2_STEP_PIN
-    DIGITAL_OUT(X2_STEP_PIN, step_outbits_2.x);
-#endif
-#ifdef Y2_STEP_PIN
-    DIGITAL_OUT(Y2_STEP_PIN, step_outbits_2.y);
-#endif
-#ifdef Z2_STEP_PIN
-    DIGITAL_OUT(Z2_STEP_PIN, step_outbits_2.z);
-#endif
-#ifdef A_AXIS
-    DIGITAL_OUT(A_STEP_PIN, step_outbits_1.a);
-#endif
-#ifdef B_AXIS
-    DIGITAL_OUT(B_STEP_PIN, step_outbits_1.b);
-#endif
-#ifdef C_AXIS
-    DIGITAL_OUT(C_STEP_PIN, step_outbits_1.c);
-#endif
+    esp_timer_create(&output_timer_args, &i2sOutputTimer);
 }
 
-#else // !SQUARING_ENABLED
+#endif // I2S_OUT_ALIGNED_OUTPUTS
+
+#if !CONFIG_IDF_TARGET_ESP32S3
 
-// Set stepper pulse output pins
-inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits)
+static void pulse_lost_report (void *data)
 {
-    step_outbits.value ^= settings.steppers.step_invert.mask;
-    DIGITAL_OUT(X_STEP_PIN, step_outbits.x);
-    DIGITAL_OUT(Y_STEP_PIN, step_outbits.y);
-#ifdef Z_STEP_PIN
-    DIGITAL_OUT(Z_STEP_PIN, step_outbits.z);
-#endif
-#ifdef X2_STEP_PIN
-    DIGITAL_OUT(X2_STEP_PIN, step_outbits.x);
-#endif
-#ifdef Y2_STEP_PIN
-    DIGITAL_OUT(Y2_STEP_PIN, step_outbits.y);
-#endif
-#ifdef Z2_STEP_PIN
-    DIGITAL_OUT(Z2_STEP_PIN, step_outbits.z);
-#endif
-#ifdef A_AXIS
-    DIGITAL_OUT(A_STEP_PIN, step_outbits.a);
-#endif
-#ifdef B_AXIS
-    DIGITAL_OUT(B_STEP_PIN, step_outbits.b);
-#endif
-#ifdef C_AXIS
-    DIGITAL_OUT(C_STEP_PIN, step_outbits.c);
-#endif
+    char msg[60];
+
+    strcpy(msg, "Passthrough step rate exceeded, steps lost: ");
+    strcat(msg, uitoa((uint32_t)data));
+    report_message(msg, Message_Warning);
 }
 
-#endif // !SQUARING_ENABLED
+#endif // !CONFIG_IDF_TARGET_ESP32S3
+
+// Starts stepper driver ISR timer and forces a stepper driver interrupt callback
+static void I2SStepperWakeUp (void)
+{
+    // Enable stepper drivers.
+    stepperEnable((axes_signals_t){AXES_BITMASK});
+    i2s_out_set_stepping();
+}
 
 #if STEP_INJECT_ENABLE
 
@@ -857,6 +989,9 @@ void I2SReset (void)
         i2s_out_set_passthrough();
         i2s_out_delay();
 //      i2s_out_reset();
+#if I2S_OUT_ALIGNED_OUTPUTS
+        i2s_output_apply(INT64_MAX);
+#endif
         goIdlePending = false;
     }
 }
@@ -867,228 +1002,21 @@ IRAM_ATTR static void I2SStepperGoIdle (bool clear_signals)
         i2s_set_step_outputs((axes_signals_t){0});
         set_dir_outputs((axes_signals_t){0});
         i2s_out_reset();
+#if I2S_OUT_ALIGNED_OUTPUTS
+        i2s_output_flush();
+#endif
     }
 
     if(!(goIdlePending = xPortInIsrContext())) {
         i2s_out_set_passthrough();
         i2s_out_delay();
-    }
-}
-
-#else // RMT stepping
-
-void initRMT (settings_t *settings)
-{
-    rmt_item32_t rmtItem[2];
-
-    rmt_config_t rmtConfig = {
-        .rmt_mode = RMT_MODE_TX,
-        .clk_div = 20,
-        .mem_block_num = 1,
-        .tx_config.loop_en = false,
-        .tx_config.carrier_en = false,
-        .tx_config.carrier_freq_hz = 0,
-        .tx_config.carrier_duty_percent = 50,
-        .tx_config.carrier_level = RMT_CARRIER_LEVEL_LOW,
-        .tx_config.idle_output_en = true
-    };
-
-    rmtItem[0].duration0 = (uint32_t)(settings->steppers.pulse_delay_microseconds > 0.0f ? 4.0f * settings->steppers.pulse_delay_microseconds : 1.0f);
-    rmtItem[0].duration1 = (uint32_t)(4.0f * settings->steppers.pulse_microseconds);
-    rmtItem[1].duration0 = 0;
-    rmtItem[1].duration1 = 0;
-
-//    hal.max_step_rate = 4000000UL / (rmtItem[0].duration0 + rmtItem[0].duration1); // + latency
-
-    uint32_t channel;
-    for(channel = 0; channel < (N_AXIS + N_GANGED); channel++) {
-
-        rmtConfig.channel = channel;
-
-        switch(channel) {
-            case X_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.x;
-                rmtConfig.gpio_num = X_STEP_PIN;
-                break;
-            case Y_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.y;
-                rmtConfig.gpio_num = Y_STEP_PIN;
-                break;
-#ifdef Z_STEP_PIN
-            case Z_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.z;
-                rmtConfig.gpio_num = Z_STEP_PIN;
-                break;
-#endif
-#ifdef A_STEP_PIN
-            case A_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.a;
-                rmtConfig.gpio_num = A_STEP_PIN;
-                break;
-#endif
-#ifdef B_STEP_PIN
-            case B_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.b;
-                rmtConfig.gpio_num = B_STEP_PIN;
-                break;
-#endif
-#ifdef C_STEP_PIN
-            case C_AXIS:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.c;
-                rmtConfig.gpio_num = C_STEP_PIN;
-                break;
-#endif
-#ifdef X2_STEP_PIN
-            case X2_MOTOR:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.x;
-                rmtConfig.gpio_num = X2_STEP_PIN;
-                break;
-#endif
-#ifdef Y2_STEP_PIN
-            case Y2_MOTOR:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.y;
-                rmtConfig.gpio_num = Y2_STEP_PIN;
-                break;
-#endif
-#ifdef Z2_STEP_PIN
-            case Z2_MOTOR:
-                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.z;
-                rmtConfig.gpio_num = Z2_STEP_PIN;
-                break;
-#endif
-        }
-#ifndef Z_STEP_PIN
-        if(channel == Z_AXIS)
-            continue;
-#endif
-        rmtItem[0].level0 = rmtConfig.tx_config.idle_level;
-        rmtItem[0].level1 = !rmtConfig.tx_config.idle_level;
-        rmt_config(&rmtConfig);
-        rmt_fill_tx_items(rmtConfig.channel, &rmtItem[0], 2, 0);
-    }
-}
-
-#ifdef SQUARING_ENABLED
-
-// Set stepper pulse output pins
-inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits_1)
-{
-    axes_signals_t step_outbits_2;
-    step_outbits_2.mask = (step_outbits_1.mask & motors_2.mask) ^ settings.steppers.step_invert.mask;
-    step_outbits_1.mask = (step_outbits_1.mask & motors_1.mask) ^ settings.steppers.step_invert.mask;
-
-    if(step_outbits_1.x) {
-        rmt_ll_tx_reset_pointer(&RMT, X_AXIS);
-        rmt_ll_tx_start(&RMT, X_AXIS);
-    }
-#ifdef X2_STEP_PIN
-    if(step_outbits_2.x) {
-        rmt_ll_tx_reset_pointer(&RMT, X2_MOTOR);
-        rmt_ll_tx_start(&RMT, X2_MOTOR);
-    }
-#endif
-
-    if(step_outbits_1.y) {
-        rmt_ll_tx_reset_pointer(&RMT, Y_AXIS);
-        rmt_ll_tx_start(&RMT, Y_AXIS);
-    }
-#ifdef Y2_STEP_PIN
-    if(step_outbits_2.y) {
-        rmt_ll_tx_reset_pointer(&RMT, Y2_MOTOR);
-        rmt_ll_tx_start(&RMT, Y2_MOTOR);
-    }
-#endif
-
-#ifdef Z_STEP_PIN
-    if(step_outbits_1.z) {
-        rmt_ll_tx_reset_pointer(&RMT, Z_AXIS);
-        rmt_ll_tx_start(&RMT, Z_AXIS);
-    }
-  #ifdef Z2_STEP_PIN
-    if(step_outbits_2.z) {
-        rmt_ll_tx_reset_pointer(&RMT, Z2_MOTOR);
-        rmt_ll_tx_start(&RMT, Z2_MOTOR);
-    }
-  #endif
-#endif // Z_STEP_PIN
-
-#ifdef A_STEP_PIN
-    if(step_outbits_1.a) {
-        rmt_ll_tx_reset_pointer(&RMT, A_AXIS);
-        rmt_ll_tx_start(&RMT, A_AXIS);
-    }
-#endif
-
-#ifdef B_STEP_PIN
-    if(step_outbits_1.b) {
-        rmt_ll_tx_reset_pointer(&RMT, B_AXIS);
-        rmt_ll_tx_start(&RMT, B_AXIS);
-    }
-#endif
-
-#ifdef C_STEP_PIN
-    if(step_outbits_1.c) {
-        rmt_ll_tx_reset_pointer(&RMT, C_AXIS);
-        rmt_ll_tx_start(&RMT, C_AXIS);
-    }
-#endif
-}
-
-#else // !SQUARING_ENABLED
-
-// Set stepper pulse output pins
-inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits)
-{
-    if(step_outbits.x) {
-        rmt_ll_tx_reset_pointer(&RMT, X_AXIS);
-        rmt_ll_tx_start(&RMT, X_AXIS);
-#ifdef X2_STEP_PIN
-        rmt_ll_tx_reset_pointer(&RMT, X2_MOTOR);
-        rmt_ll_tx_start(&RMT, X2_MOTOR);
-#endif
-    }
-
-    if(step_outbits.y) {
-        rmt_ll_tx_reset_pointer(&RMT, Y_AXIS);
-        rmt_ll_tx_start(&RMT, Y_AXIS);
-#ifdef Y2_STEP_PIN
-        rmt_ll_tx_reset_pointer(&RMT, Y2_MOTOR);
-        rmt_ll_tx_start(&RMT, Y2_MOTOR);
-#endif
-    }
-
-#ifdef Z_STEP_PIN
-    if(step_outbits.z) {
-        rmt_ll_tx_reset_pointer(&RMT, Z_AXIS);
-        rmt_ll_tx_start(&RMT, Z_AXIS);
-  #ifdef Z2_STEP_PIN
-        rmt_ll_tx_reset_pointer(&RMT, Z2_MOTOR);
-        rmt_ll_tx_start(&RMT, Z2_MOTOR);
-  #endif
-    }
-#endif
-
-#ifdef A_STEP_PIN
-    if(step_outbits.a) {
-        rmt_ll_tx_reset_pointer(&RMT, A_AXIS);
-        rmt_ll_tx_start(&RMT, A_AXIS);
-    }
+#if I2S_OUT_ALIGNED_OUTPUTS
+        i2s_output_apply(INT64_MAX);
 #endif
-#ifdef B_STEP_PIN
-    if(step_outbits.b) {
-        rmt_ll_tx_reset_pointer(&RMT, B_AXIS);
-        rmt_ll_tx_start(&RMT, B_AXIS);
-    }
-#endif
-#ifdef C_STEP_PIN
-    if(step_outbits.c) {
-        rmt_ll_tx_reset_pointer(&RMT, C_AXIS);
-        rmt_ll_tx_start(&RMT, C_AXIS);
     }
-#endif
 }
 
-#endif // !SQUARING_ENABLED
+#else // RMT stepping
 
 #if STEP_INJECT_ENABLE
 
@@ -1136,59 +1064,209 @@ void stepperOutputStep (axes_signals_t step_outbits, axes_signals_t dir_outbits)
             DIGITAL_OUT(C_DIRECTION_PIN, dir_outbits.c);
 #endif
 
-        if(step_outbits.x) {
-            rmt_ll_tx_reset_pointer(&RMT, X_AXIS);
-            rmt_ll_tx_start(&RMT, X_AXIS);
+        uint32_t channels = step_outbits.mask;
 #ifdef X2_STEP_PIN
-            rmt_ll_tx_reset_pointer(&RMT, X2_MOTOR);
-            rmt_ll_tx_start(&RMT, X2_MOTOR);
+        if(step_outbits.x)
+            channels |= bit(X2_MOTOR);
 #endif
-        }
-
-        if(step_outbits.y) {
-            rmt_ll_tx_reset_pointer(&RMT, Y_AXIS);
-            rmt_ll_tx_start(&RMT, Y_AXIS);
 #ifdef Y2_STEP_PIN
-            rmt_ll_tx_reset_pointer(&RMT, Y2_MOTOR);
-            rmt_ll_tx_start(&RMT, Y2_MOTOR);
+        if(step_outbits.y)
+            channels |= bit(Y2_MOTOR);
 #endif
-        }
+#ifdef Z2_STEP_PIN
+        if(step_outbits.z)
+            channels |= bit(Z2_MOTOR);
+#endif
+        rmt_start_channels(channels & rmt_channels);
+    }
+}
 
-#ifdef Z_STEP_PIN
-        if(step_outbits.z) {
-            rmt_ll_tx_reset_pointer(&RMT, Z_AXIS);
-            rmt_ll_tx_start(&RMT, Z_AXIS);
-  #ifdef Z2_STEP_PIN
-            rmt_ll_tx_reset_pointer(&RMT, Z2_MOTOR);
-            rmt_ll_tx_start(&RMT, Z2_MOTOR);
-  #endif
-        }
-#endif
+#endif // STEP_INJECT_ENABLE
 
-#ifdef A_AXIS
-        if(step_outbits.a) {
-            rmt_ll_tx_reset_pointer(&RMT, A_AXIS);
-            rmt_ll_tx_start(&RMT, A_AXIS);
-        }
-#endif
+#if STEP_BURST_ENABLE
 
-#ifdef B_AXIS
-        if(step_outbits.b) {
-            rmt_ll_tx_reset_pointer(&RMT, B_AXIS);
-            rmt_ll_tx_start(&RMT, B_AXIS);
-        }
-#endif
+/*
+  Step bursts:
+  When a tick outputs a step for a single axis without a direction change the core stepper callback is run ahead,
+  with its outputs captured, for as long as it keeps stepping the same axis at the same interval.
+  The captured run is output by the RMT as a loop count limited pulse train starting on the next tick,
+  with the step timer restarted and its alarm set to the time the first captured pulse not part of the train is due.
+  Capture is limited to half a step interval so that the next tick is not missed, the train is not ended before
+  the RMT has flagged the loop count reached.
+  The core runs ahead of the step outputs by max STEP_BURST_MAX_US, bursts are inhibited when homing, probing and in laser mode.
+*/
 
-#ifdef C_AXIS
-        if(step_outbits.c) {
-            rmt_ll_tx_reset_pointer(&RMT, C_AXIS);
-            rmt_ll_tx_start(&RMT, C_AXIS);
+// Configures the RMT channels for a train of count pulses or back to single pulse output when count is 0.
+// For a train the end marker item following the pulse item is replaced by an idle period padding the pulse to the step interval.
+IRAM_ATTR static void rmt_train_config (uint32_t channels, uint32_t count, uint32_t idle_ticks)
+{
+    uint32_t channel;
+
+    while(channels) {
+        channel = __builtin_ctz(channels);
+        channels &= channels - 1;
+        RMTMEM.chan[channel].data32[1].val = count ? (idle_ticks | (((rmt_idle_level >> channel) & 1) << 15)) : 0;
+        rmt_ll_tx_set_loop_count(&RMT, channel, count);
+        rmt_ll_tx_reset_loop(&RMT, channel);
+        rmt_ll_tx_enable_loop_count(&RMT, channel, count != 0);
+        rmt_ll_tx_enable_loop_autostop(&RMT, channel, count != 0);
+        rmt_ll_tx_enable_loop(&RMT, channel, count != 0);
+    }
+}
+
+// Returns true when all channels have completed their loop count. The loop interrupt is not enabled,
+// the raw status is not touched by the RMT driver interrupt handler.
+IRAM_ATTR static inline bool rmt_train_done (uint32_t channels)
+{
+    return ((RMT.int_raw.val >> RMT_TX_LOOP_INT_SHIFT) & channels) == channels;
+}
+
+IRAM_ATTR static inline void step_timer_set_alarm (uint32_t cycles)
+{
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarmlo.val = cycles;
+}
+
+// Restarts the step timer count, the reload value is 0.
+IRAM_ATTR static inline void step_timer_restart (void)
+{
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].load.tn_load = 1;
+}
+
+// Called instead of stepperPulseStart() when the core stepper callback is run ahead.
+IRAM_ATTR static void stepBurstCapture (stepper_t *stepper)
+{
+    if(burst.held)
+        return;
+
+    if(!stepper->dir_change && stepper->step_outbits.value == burst.step_outbits.value &&
+         burst.cycles_per_tick == burst.train_cycles && burst.count < burst.max_count)
+        burst.count++;
+    else {
+        burst.held = true;
+        burst.held_cycles = burst.cycles_per_tick;
+        burst.held_dir_change = stepper->dir_change;
+        burst.held_dir_outbits = stepper->dir_outbits;
+        burst.held_step_outbits = stepper->step_outbits;
+    }
+}
+
+// Called instead of stepperGoIdle() when the core stepper callback is run ahead.
+// The timer is stopped when the tick the core went idle on is reached.
+IRAM_ATTR static void stepBurstCaptureGoIdle (void)
+{
+    burst.go_idle = true;
+
+    if(!burst.held) {
+        burst.held = true;
+        burst.held_cycles = burst.cycles_per_tick;
+        burst.held_dir_change = false;
+        burst.held_step_outbits.value = 0;
+    }
+}
+
+// Runs the core stepper callback ahead, called from the step timer ISR after outputting a pulse that may start a train.
+IRAM_ATTR static void stepBurstRun (void)
+{
+    burst.candidate = false;
+
+    if(burst.cycles_per_tick <= rmt_pulse_ticks || burst.cycles_per_tick - rmt_pulse_ticks > RMT_ITEM_DURATION_MAX)
+        return;
+
+    burst.train_cycles = burst.cycles_per_tick;
+    burst.max_count = min(STEP_BURST_MAX_PULSES, (STEP_BURST_MAX_US * (hal.f_step_timer / 1000000UL)) / burst.train_cycles);
+
+    if(burst.max_count < 2)
+        return;
+
+    // CPU cycles available before the next tick is due
+    uint32_t start = XTHAL_GET_CCOUNT(), limit = (burst.train_cycles / 2) * (hal.f_mcu * 1000000UL / hal.f_step_timer);
+
+    burst.count = 0;
+    burst.held = burst.go_idle = burst.resume = false;
+    burst.capture = true;
+
+    do {
+        hal.stepper.interrupt_callback();
+    } while(!burst.held && XTHAL_GET_CCOUNT() - start < limit);
+
+    if(!burst.held) {
+        burst.resume = true;
+        burst.held_cycles = burst.train_cycles;
+    }
+
+    burst.capture = false;
+    burst.idle_ticks = burst.train_cycles - rmt_pulse_ticks;
+    burst.channels = get_step_channels(burst.step_outbits);
+    burst.state = Burst_Armed;
+}
+
+// Step timer tick while a train is armed or running, replaces the core stepper callback.
+// Returns false when the core stepper callback is to be run for the tick.
+IRAM_ATTR static bool stepBurstTick (void)
+{
+    if(burst.state == Burst_Armed && burst.count) {
+        rmt_train_config(burst.channels, burst.count, burst.idle_ticks);
+        RMT.int_clr.val = burst.channels << RMT_TX_LOOP_INT_SHIFT;
+        rmt_start_channels(burst.channels);
+        step_timer_restart();   // The alarm is relative to the train start
+        step_timer_set_alarm((burst.count - 1) * burst.train_cycles + burst.held_cycles);
+        burst.state = Burst_Running;
+        return true;
+    }
+
+    // Train still running? Check again after a pulse duration.
+    // When the held pulse is due earlier than the step interval only the idle padding of the last pulse may be left.
+    if(burst.state == Burst_Running && burst.held_cycles >= burst.train_cycles && !rmt_train_done(burst.channels)) {
+        step_timer_set_alarm(rmt_pulse_ticks);
+        return true;
+    }
+
+    // Train completed, output the held pulse.
+
+    rmt_train_config(burst.channels, 0, 0);
+    burst.state = Burst_Off;
+
+    if(burst.enable_pending) {
+        burst.enable_pending = false;
+        stepperEnable(burst.enable);
+    }
+
+    if(burst.resume)
+        return false;
+
+    if(burst.held_dir_change)
+        set_dir_outputs(burst.held_dir_outbits);
+
+    if(burst.held_step_outbits.value)
+        set_step_outputs(burst.held_step_outbits);
+
+    if(burst.go_idle)
+        TIMERG0.hw_timer[STEP_TIMER_INDEX].config.tn_en = 0;
+    else
+        stepperCyclesPerTick(burst.cycles_per_tick);
+
+    return true;
+}
+
+// Aborts a train, called when the steppers are stopped.
+IRAM_ATTR static void stepBurstCancel (void)
+{
+    burst.candidate = false;
+
+    if(burst.state != Burst_Off) {
+        uint32_t channel, channels = burst.channels;
+        while(channels) {
+            channel = __builtin_ctz(channels);
+            channels &= channels - 1;
+            rmt_ll_tx_stop(&RMT, channel);
         }
-#endif
+        rmt_train_config(burst.channels, 0, 0);
+        burst.state = Burst_Off;
+        burst.enable_pending = false;
     }
 }
 
-#endif // STEP_INJECT_ENABLE
+#endif // STEP_BURST_ENABLE
 
 #endif // RMT Stepping
 
@@ -1229,81 +1307,301 @@ static axes_signals_t getGangedAxes (bool auto_squared)
 
 #endif // GANGING_ENABLED
 
-// Sets stepper direction and pulse pins and starts a step pulse
-// Called when in I2S passthrough mode
-
-#if CONFIG_IDF_TARGET_ESP32S3
-
-IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
+// Disables stepper driver interrupt
+IRAM_ATTR static void stepperGoIdle (bool clear_signals)
 {
-#if USE_I2S_OUT
-    static bool add_dir_delay = false;
+#if STEP_BURST_ENABLE
+    if(burst.capture) {
+        stepBurstCaptureGoIdle();
+        return;
+    }
 #endif
 
-    if(stepper->dir_change) {
-        set_dir_outputs(stepper->dir_outbits);
-#if USE_I2S_OUT
-        if(!(add_dir_delay = !!stepper->step_outbits.value))
-            i2s_out_commit(0, i2s_delay_samples);
+#if CONFIG_IDF_TARGET_ESP32S3
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].config.tn_en = 0;
+#else
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].config.enable = 0;
 #endif
+#if STEP_BURST_ENABLE
+    stepBurstCancel();
+#endif
+#if USE_I2S_OUT && !CONFIG_IDF_TARGET_ESP32S3
+    if(pulse_lost) {
+        protocol_enqueue_foreground_task(pulse_lost_report, (void *)pulse_lost);
+        pulse_lost = 0;
     }
-
-    if(stepper->step_outbits.value) {
+#endif
+    if(clear_signals) {
+#if USE_I2S_OUT && !CONFIG_IDF_TARGET_ESP32S3
+        pulse_timer_stop();
+#endif
 #if USE_I2S_OUT
-        i2s_set_step_outputs(stepper->step_outbits);
-        i2s_out_commit(i2s_step_samples, add_dir_delay ? i2s_delay_samples : 0);
-        add_dir_delay = false;
+        i2s_set_step_outputs((axes_signals_t){0});
 #else
-        set_step_outputs(stepper->step_outbits);
+        set_step_outputs((axes_signals_t){0});
 #endif
+        set_dir_outputs((axes_signals_t){0});
     }
 }
 
-#else
+#if STEP_QUEUE_ENABLE
 
-IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
-{
-    if(stepper->dir_change) {
-        set_dir_outputs(stepper->dir_outbits);
-#if USE_I2S_OUT
-        if(stepper->step_outbits.value)
-            delay_us(i2s_delay_length + 1);
+/*
+  Step event queue:
+  The core stepper callback (Bresenham and segment bookkeeping) is run by a producer task that captures
+  its pulse_start(), cycles_per_tick() and go_idle() calls as step events in a single-producer/single-consumer ring.
+  The step timer ISR pops one event per tick, outputs it via stepperPulseStart() and sets the interval to the next.
+  The producer runs on the grblHAL core above the grblHAL task priority so that it is only preempted by interrupts,
+  as the callback is when run from the ISR.
+  The core runs ahead of the step outputs by up to STEP_QUEUE_SIZE events and STEP_QUEUE_MAX_US, the queue is bypassed
+  when homing, probing and in laser mode. The hal.stepper handlers are not changed, the mode is selected on wake up.
+*/
+
+typedef struct {
+    uint32_t cycles_per_tick;       // Step timer cycles to the next event
+    axes_signals_t step_outbits;
+    axes_signals_t dir_outbits;
+    bool dir_change;
+    bool go_idle;
+} step_event_t;
+
+typedef struct {
+    volatile bool active;           // steps are queued, selected on wake up
+    volatile bool running;          // producer is to keep the queue filled
+    volatile bool waiting;          // producer is waiting for the queue to drain below half
+    volatile bool stopped;          // step timer is stopped
+    volatile uint32_t head;         // written by the producer
+    volatile uint32_t tail;         // written by the step timer ISR
+    volatile uint32_t produced;     // step timer cycles queued, written by the producer
+    volatile uint32_t output;       // step timer cycles output, written by the step timer ISR
+    uint32_t max_ahead;             // STEP_QUEUE_MAX_US in step timer cycles
+    uint32_t underruns;
+    uint32_t cycles_per_tick;       // current step interval
+    union {
+        uint8_t inhibit;
+        struct {
+            uint8_t homing  :1,
+                    probing :1,
+                    laser   :1,
+                    unused  :5;
+        };
+    };
+    step_event_t *event;            // event being produced
+    TaskHandle_t task;
+    portMUX_TYPE lock;              // serializes wake up against the ISR stopping on a go idle event
+    step_event_t events[STEP_QUEUE_SIZE];
+} step_queue_t;
+
+static step_queue_t step_queue = {
+    .stopped = true,
+    .lock = portMUX_INITIALIZER_UNLOCKED
+};
+
+#if STEP_QUEUE_SIZE & (STEP_QUEUE_SIZE - 1)
+#error "STEP_QUEUE_SIZE must be a power of 2!"
 #endif
+
+#define STEP_QUEUE_MASK (STEP_QUEUE_SIZE - 1)
+#define STEP_QUEUE_UNDERRUN_RETRY 200 // step timer cycles, 10 us
+
+// Called from the core stepper callback.
+IRAM_ATTR static void stepQueuePulseStart (stepper_t *stepper)
+{
+    if(!step_queue.active) {
+        stepperPulseStart(stepper);
+        return;
     }
 
-    if(stepper->step_outbits.value) {
-#if USE_I2S_OUT
-        i2s_set_step_outputs(stepper->step_outbits);
-        delay_us(i2s_step_length + 1);
-        i2s_set_step_outputs((axes_signals_t){0});
-#else
-        set_step_outputs(stepper->step_outbits);
-#endif
+    step_queue.event->dir_change = stepper->dir_change;
+    step_queue.event->dir_outbits = stepper->dir_outbits;
+    step_queue.event->step_outbits = stepper->step_outbits;
+}
+
+// Called from the core stepper callback.
+IRAM_ATTR static void stepQueueCyclesPerTick (uint32_t cycles_per_tick)
+{
+    if(step_queue.active)
+        step_queue.cycles_per_tick = cycles_per_tick;
+    else
+        stepperCyclesPerTick(cycles_per_tick);
+}
+
+IRAM_ATTR static void stepQueueGoIdle (bool clear_signals)
+{
+    // Called by the core stepper callback run by the producer?
+    if(!xPortInIsrContext() && xTaskGetCurrentTaskHandle() == step_queue.task) {
+        step_queue.event->go_idle = true;
+        return;
     }
+
+    step_queue.running = false;
+    stepperGoIdle(clear_signals);
+    step_queue.stopped = true;
+    // The ISR is stopped, queued events are discarded.
+    step_queue.tail = step_queue.head;
+    step_queue.output = step_queue.produced;
 }
 
-#endif
+// Returns true if the producer may add an event.
+IRAM_ATTR static inline bool stepQueueSpace (void)
+{
+    return step_queue.head - step_queue.tail < STEP_QUEUE_SIZE && step_queue.produced - step_queue.output < step_queue.max_ahead;
+}
 
-// Disables stepper driver interrupt
-IRAM_ATTR static void stepperGoIdle (bool clear_signals)
+static void stepQueueWakeUp (void)
 {
-#if CONFIG_IDF_TARGET_ESP32S3
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].config.tn_en = 0;
-#else
-    TIMERG0.hw_timer[STEP_TIMER_INDEX].config.enable = 0;
-#endif
-    if(clear_signals) {
-#if USE_I2S_OUT
-        i2s_set_step_outputs((axes_signals_t){0});
-#else
-        set_step_outputs((axes_signals_t){0});
-#endif
-        set_dir_outputs((axes_signals_t){0});
+    bool restart;
+
+    // Only steppers stopped when idle may change mode, the queue may still be draining events
+    // queued before the core went idle.
+    if(step_queue.stopped)
+        step_queue.active = !step_queue.inhibit;
+
+    if(!step_queue.active) {
+        step_queue.stopped = false;
+        stepperWakeUp();
+        return;
     }
+
+    portENTER_CRITICAL(&step_queue.lock);
+    step_queue.running = true;
+    restart = step_queue.stopped;
+    step_queue.stopped = false;
+    portEXIT_CRITICAL(&step_queue.lock);
+
+    xTaskNotifyGive(step_queue.task);   // Prefill queue while the drivers wake up
+
+    // Events left are output after the go idle event, which is skipped as the producer is running again.
+    if(restart)
+        stepperWakeUp();
+    else
+        stepperEnable((axes_signals_t){AXES_BITMASK});
 }
 
+static void stepQueueTask (void *arg)
+{
+    uint32_t head;
+    step_event_t *event;
+
+    while(true) {
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while(step_queue.running) {
+
+            if(!stepQueueSpace()) {
+                // Wait for the ISR to signal the queue is drained below half, check again in case it already is.
+                step_queue.waiting = true;
+                if(!stepQueueSpace())
+                    break;
+                step_queue.waiting = false;
+            }
+
+            head = step_queue.head;
+            event = step_queue.event = &step_queue.events[head & STEP_QUEUE_MASK];
+            event->step_outbits.value = 0;
+            event->dir_change = event->go_idle = false;
+
+            hal.stepper.interrupt_callback();
+
+            event->cycles_per_tick = step_queue.cycles_per_tick;
+            if(!event->go_idle)
+                step_queue.produced += event->cycles_per_tick;
+
+            __atomic_store_n(&step_queue.head, head + 1, __ATOMIC_RELEASE);
+
+            if(event->go_idle)
+                step_queue.running = false;
+        }
+    }
+}
+
+// Step timer tick, replaces the core stepper callback when the queue is active.
+IRAM_ATTR static void stepQueueOutput (void)
+{
+    static stepper_t pulse = {0};
+
+    uint32_t tail = step_queue.tail;
+
+    if(tail == __atomic_load_n(&step_queue.head, __ATOMIC_ACQUIRE)) {
+        // Underrun, output is delayed until the producer catches up.
+        if(step_queue.running) {
+            step_queue.underruns++;
+            stepperCyclesPerTick(STEP_QUEUE_UNDERRUN_RETRY);
+        }
+        return;
+    }
+
+    step_event_t *event = &step_queue.events[tail & STEP_QUEUE_MASK];
+
+    pulse.dir_change = event->dir_change;
+    pulse.dir_outbits = event->dir_outbits;
+    pulse.step_outbits = event->step_outbits;
+
+    stepperPulseStart(&pulse);
+
+    if(event->go_idle) {
+        portENTER_CRITICAL_ISR(&step_queue.lock);
+        if(!step_queue.running) {
+            stepperGoIdle(false);
+            step_queue.stopped = true;
+        } else // woken up again, the producer continues from the event
+            stepperCyclesPerTick(step_queue.cycles_per_tick);
+        portEXIT_CRITICAL_ISR(&step_queue.lock);
+    } else {
+        stepperCyclesPerTick(event->cycles_per_tick);
+        step_queue.output += event->cycles_per_tick;
+    }
+
+    step_queue.tail = ++tail;
+
+    // Wake the producer when the queue is half empty.
+    if(step_queue.waiting && step_queue.head - tail <= STEP_QUEUE_SIZE / 2 && step_queue.produced - step_queue.output <= step_queue.max_ahead / 2) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        step_queue.waiting = false;
+        vTaskNotifyGiveFromISR(step_queue.task, &xHigherPriorityTaskWoken);
+        if(xHigherPriorityTaskWoken)
+            portYIELD_FROM_ISR();
+    }
+}
+
+#endif // STEP_QUEUE_ENABLE
+
 #if USE_I2S_OUT
 
+/*
+  The hal.stepper handlers are set once and dispatch on the mode so that handlers chained by plugins are kept.
+  In passthrough mode the step interval is clamped to the time a step pulse and the direction setup delay take,
+  hal.max_step_rate is set to the matching rate. Motion started slow in auto mode is then run at this rate at most.
+*/
+
+static volatile bool i2s_streaming = true;
+static uint32_t i2s_pass_min_cycles = 0, i2s_pass_max_rate = 0, i2s_stream_max_rate = 0;
+
+IRAM_ATTR static void I2SStepperSelectPulseStart (stepper_t *stepper)
+{
+    if(i2s_streaming)
+        I2SStepperPulseStart(stepper);
+    else
+        stepperPulseStart(stepper);
+}
+
+IRAM_ATTR static void I2SStepperSelectCyclesPerTick (uint32_t cycles_per_tick)
+{
+    if(i2s_streaming)
+        I2SStepperCyclesPerTick(cycles_per_tick);
+    else
+        stepperCyclesPerTick(cycles_per_tick < i2s_pass_min_cycles ? i2s_pass_min_cycles : cycles_per_tick);
+}
+
+IRAM_ATTR static void I2SStepperSelectGoIdle (bool clear_signals)
+{
+    if(i2s_streaming)
+        I2SStepperGoIdle(clear_signals);
+    else
+        stepperGoIdle(clear_signals);
+}
+
 static void i2s_set_streaming_mode (bool stream)
 {
 #if CONFIG_IDF_TARGET_ESP32S3
@@ -1312,33 +1610,185 @@ static void i2s_set_streaming_mode (bool stream)
     TIMERG0.hw_timer[STEP_TIMER_INDEX].config.enable = 0;
 #endif
 
-    if(!stream && hal.stepper.wake_up == I2SStepperWakeUp && i2s_out_get_pulser_status() == STEPPING) {
+    if(!stream && i2s_streaming && i2s_out_get_pulser_status() == STEPPING) {
        i2s_out_set_passthrough();
        i2s_out_delay();
+#if I2S_OUT_ALIGNED_OUTPUTS
+       i2s_output_apply(INT64_MAX);
+#endif
     }
 
-    if(stream) {
-        if(hal.stepper.wake_up != I2SStepperWakeUp) {
-            hal.stepper.wake_up = I2SStepperWakeUp;
-            hal.stepper.go_idle = I2SStepperGoIdle;
-            hal.stepper.cycles_per_tick = I2SStepperCyclesPerTick;
-            hal.stepper.pulse_start = I2SStepperPulseStart;
-            i2s_out_set_pulse_callback(hal.stepper.interrupt_callback);
-        }
-    } else if(hal.stepper.wake_up != stepperWakeUp) {
-        hal.stepper.wake_up = stepperWakeUp;
-        hal.stepper.go_idle = stepperGoIdle;
-        hal.stepper.cycles_per_tick = stepperCyclesPerTick;
-        hal.stepper.pulse_start = stepperPulseStart;
-        i2s_out_set_pulse_callback(i2s_step_sink);
+    if(stream != i2s_streaming) {
+        i2s_streaming = stream;
+        i2s_out_set_pulse_callback(stream ? hal.stepper.interrupt_callback : i2s_step_sink);
+    }
+
+    hal.max_step_rate = stream ? i2s_stream_max_rate : i2s_pass_max_rate;
+}
+
+/*
+  Step mode selection, $-setting I2S_OUT_STEP_MODE_SETTING:
+  0 - Auto: jogging and motion where all blocks queued at wake up are below I2S_OUT_AUTO_STREAM_RATE steps/s are run
+            in passthrough mode for low latency, other motion is streamed. Blocks queued later are run in the same mode,
+            in passthrough mode capped to the passthrough step rate, see I2SStepperSelectCyclesPerTick().
+  1 - Passthrough: all motion is run in passthrough mode.
+  2 - Streaming: all motion is streamed.
+  Homing, probing and laser mode always run in passthrough mode. The mode is selected when the steppers are woken up.
+*/
+
+typedef enum {
+    I2SStepMode_Auto = 0,
+    I2SStepMode_Passthrough,
+    I2SStepMode_Streaming
+} i2s_step_mode_t;
+
+typedef struct {
+    uint8_t step_mode;  // i2s_step_mode_t
+} i2s_settings_t;
+
+typedef union {
+    uint8_t value;
+    struct {
+        uint8_t homing  :1,
+                probing :1,
+                unused  :6;
+    };
+} i2s_passthrough_t;
+
+static i2s_settings_t i2s_settings;
+static i2s_passthrough_t i2s_passthrough = {0};
+static nvs_address_t i2s_nvs_address;
+
+// Returns true if the motion about to start should be run in passthrough mode:
+// all blocks in the planner are below the step rate limit, a short slow block in front of fast ones is not enough.
+static bool i2s_auto_passthrough (void)
+{
+    plan_block_t *block;
+    uint_fast16_t n_blocks = plan_get_block_buffer_count();
+    bool passthrough;
+
+    if(state_get() == STATE_JOG)
+        return true;
+
+    if((passthrough = !!(block = plan_get_current_block()))) do {
+        passthrough = block->millimeters > 0.0f &&
+                       block->programmed_rate * (float)block->step_event_count < (float)I2S_OUT_AUTO_STREAM_RATE * 60.0f * block->millimeters;
+    } while(passthrough && --n_blocks && (block = block->next));
+
+    return passthrough;
+}
+
+// Only to be called when the steppers are idle.
+static void i2s_step_mode_update (void)
+{
+    bool passthrough = laser_mode || i2s_passthrough.value;
+
+    if(!passthrough) switch(i2s_settings.step_mode) {
+
+        case I2SStepMode_Auto:
+            passthrough = i2s_auto_passthrough();
+            break;
+
+        case I2SStepMode_Passthrough:
+            passthrough = true;
+            break;
+
+        default:
+            break;
     }
+
+    i2s_set_streaming_mode(!passthrough);
+}
+
+static void I2SStepperSelectWakeUp (void)
+{
+    i2s_step_mode_update();
+
+    if(i2s_streaming)
+        I2SStepperWakeUp();
+    else
+        stepperWakeUp();
+}
+
+static const setting_detail_t i2s_setting_detail[] = {
+    { I2S_OUT_STEP_MODE_SETTING, Group_Stepper, "I2S step mode", NULL, Format_RadioButtons, "Auto,Passthrough,Streaming", NULL, NULL, Setting_NonCore, &i2s_settings.step_mode, NULL, NULL },
+};
+
+#ifndef NO_SETTINGS_DESCRIPTIONS
+
+static const setting_descr_t i2s_setting_descr[] = {
+    { I2S_OUT_STEP_MODE_SETTING, "Auto: jogging and slow motion in passthrough mode, other motion streamed.\\n"
+                                 "Passthrough: low latency, step rate limited by the CPU.\\n"
+                                 "Streaming: step pulses are precomputed into the DMA buffers.\\n\\n"
+                                 "Homing, probing and laser mode are always run in passthrough mode."
+    },
+};
+
+#endif
+
+static void i2s_settings_save (void)
+{
+    hal.nvs.memcpy_to_nvs(i2s_nvs_address, (uint8_t *)&i2s_settings, sizeof(i2s_settings_t), true);
+}
+
+static void i2s_settings_restore (void)
+{
+    i2s_settings.step_mode = I2S_OUT_STEP_MODE;
+
+    i2s_settings_save();
+}
+
+static void i2s_settings_load (void)
+{
+    if(hal.nvs.memcpy_from_nvs((uint8_t *)&i2s_settings, i2s_nvs_address, sizeof(i2s_settings_t), true) != NVS_TransferResult_OK)
+        i2s_settings_restore();
+    else if(i2s_settings.step_mode > I2SStepMode_Streaming)
+        i2s_settings.step_mode = I2SStepMode_Streaming;
+}
+
+static setting_details_t i2s_setting_details = {
+    .settings = i2s_setting_detail,
+    .n_settings = sizeof(i2s_setting_detail) / sizeof(setting_detail_t),
+#ifndef NO_SETTINGS_DESCRIPTIONS
+    .descriptions = i2s_setting_descr,
+    .n_descriptions = sizeof(i2s_setting_descr) / sizeof(setting_descr_t),
+#endif
+    .save = i2s_settings_save,
+    .load = i2s_settings_load,
+    .restore = i2s_settings_restore
+};
+
+static void i2s_settings_init (void)
+{
+    if((i2s_nvs_address = nvs_alloc(sizeof(i2s_settings_t))))
+        settings_register(&i2s_setting_details);
+}
+
+// Motion is streamed from shallow DMA buffers for quick response to feed hold and overrides. Only segments
+// at or above I2S_OUT_DEEP_STREAM_RATE, the cruise phase of long rapids and fast feeds, are streamed from deep
+// buffers where the fill task needs the margin. The depth is selected per segment by I2SStepperCyclesPerTick(),
+// a feed hold or a stop lands within the deep buffer time, (I2S_OUT_DMABUF_COUNT + 1) x I2S_OUT_DEEP_DMABUF_USEC,
+// only when issued during such a segment. Deceleration drops back to shallow buffers.
+// Probing and homing are not affected as these are run in passthrough mode.
+// Shallow buffers leave less margin for the fill task, the I2S driver doubles the depth on each underrun until
+// the next depth change.
+static void i2s_state_changed (sys_state_t state)
+{
+    if(state != STATE_CYCLE) {
+        i2s_deep_buffers = false;
+        i2s_out_set_depth(I2S_OUT_SHALLOW_DMABUF_USEC);
+    }
+
+    if(on_state_change)
+        on_state_change(state);
 }
 
 #if DRIVER_SPINDLE_ENABLE
 
 static void onSpindleSelected (spindle_ptrs_t *spindle)
 {
-    i2s_set_streaming_mode(!(laser_mode = spindle->cap.laser));
+    laser_mode = spindle->cap.laser && !I2S_OUT_ALIGNED_OUTPUTS;
+    i2s_step_mode_update();
 
     if(on_spindle_selected)
         on_spindle_selected(spindle);
@@ -1346,13 +1796,101 @@ static void onSpindleSelected (spindle_ptrs_t *spindle)
 
 #endif
 
+#if I2S_OUT_STATS_ENABLE
+
+static uint32_t i2s_underruns_reported = 0;
+static on_realtime_report_ptr on_realtime_report;
+
+// Adds |I2S:<underruns>,<min buffers ahead>,<max refill latency us>,<max fill time us> to the real time report
+// when the underrun count has changed since the last report.
+static void i2s_realtime_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    i2s_out_stats_t stats;
+
+    i2s_out_get_stats(&stats, false);
+
+    if(stats.underruns != i2s_underruns_reported) {
+        i2s_underruns_reported = stats.underruns;
+        stream_write("|I2S:");
+        stream_write(uitoa(stats.underruns));
+        stream_write(",");
+        stream_write(uitoa(stats.ahead_min));
+        stream_write(",");
+        stream_write(uitoa(stats.latency_max / hal.f_mcu));
+        stream_write(",");
+        stream_write(uitoa(stats.fill_max / hal.f_mcu));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+// $I2SSTATS - report, $I2SSTATS=R - report and reset
+static status_code_t i2s_stats_command (sys_state_t state, char *args)
+{
+    bool reset = false;
+    i2s_out_stats_t stats;
+
+    if(args && !(reset = strlen(args) == 1 && CAPS(*args) == 'R'))
+        return Status_InvalidStatement;
+
+    i2s_out_get_stats(&stats, reset);
+
+    if(reset)
+        i2s_underruns_reported = 0;
+
+    hal.stream.write("[I2SSTATS:");
+    hal.stream.write(uitoa(stats.fills));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(stats.underruns));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(stats.ahead_min));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(stats.latency_max / hal.f_mcu));
+    hal.stream.write("|");
+    hal.stream.write(uitoa(stats.fill_max / hal.f_mcu));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+static const sys_command_t i2s_stats_command_list[] = {
+    { .command = "I2SSTATS", .execute = i2s_stats_command }
+};
+
+static sys_commands_t i2s_stats_commands = {
+    .n_commands = sizeof(i2s_stats_command_list) / sizeof(sys_command_t),
+    .commands = i2s_stats_command_list
+};
+
+static sys_commands_t *i2s_stats_get_commands (void)
+{
+    return &i2s_stats_commands;
+}
+
+static void i2s_stats_init (void)
+{
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = i2s_realtime_report;
+
+    i2s_stats_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = i2s_stats_get_commands;
+}
+
+#endif // I2S_OUT_STATS_ENABLE
+
 #endif // USE_I2S_OUT
 
 // Enable/disable limit pins interrupt
 static void limitsEnable (bool on, axes_signals_t homing_cycle)
 {
 #if USE_I2S_OUT
-    i2s_set_streaming_mode(!(homing_cycle.mask || laser_mode));
+    i2s_passthrough.homing = homing_cycle.mask != 0;
+    i2s_step_mode_update();
+#elif STEP_BURST_ENABLE
+    burst.homing = homing_cycle.mask != 0;
+#elif STEP_QUEUE_ENABLE
+    step_queue.homing = homing_cycle.mask != 0;
 #endif
 
     bool disable = !on;
@@ -1367,66 +1905,183 @@ static void limitsEnable (bool on, axes_signals_t homing_cycle)
                 pin = xbar_fn_to_axismask(inputpin[i].id);
                 disable = inputpin[i].group == PinGroup_Limit ? (pin.mask & homing_source.min.mask) : (pin.mask & homing_source.max.mask);
             }
-            gpio_set_intr_type(inputpin[i].pin, on ? map_intr_type(inputpin[i].mode.irq_mode) : GPIO_INTR_DISABLE);
-            if(disable)
-                gpio_intr_disable(inputpin[i].pin);
-            else
-                gpio_intr_enable(inputpin[i].pin);
+            if(disable) {
+                INPUT_IRQ_DISABLE(inputpin[i].pin);
+            } else {
+                INPUT_IRQ_ENABLE(inputpin[i].pin, inputpin[i].mode.irq_mode);
+            }
         }
     } while(i);
 }
 
 // Returns limit state as an axes_signals_t variable.
 // Each bitfield bit indicates an axis limit, where triggered is 1 and not triggered is 0.
-inline IRAM_ATTR static limit_signals_t limitsGetState (void)
-{
-    limit_signals_t signals = {0};
+/*
+  Limit and control input state is read with a single read of the GPIO input registers,
+  the bits are then packed into the signal structs by gather tables built by input_gather_init().
+  Inversion is folded into the tables.
+*/
+
+typedef struct {
+    uint8_t port;   // 0 - GPIO.in (GPIO0-31), 1 - GPIO.in1 (GPIO32-), 2 - I2S input state
+    uint8_t shift;  // bit number in the input register
+    uint8_t bit;    // bit number in the signal struct
+} input_gather_t;
+
+// One entry per signal bit, so a table can hold every input the signal struct has room for.
+#define INPUT_GATHER_MAX (sizeof(control_signals_t) * 8)
+
+_Static_assert(sizeof(axes_signals_t) * 8 <= INPUT_GATHER_MAX, "input gather table too small for the limit signals");
+
+typedef struct {
+    uint_fast8_t n_pins;
+    uint32_t invert;
+    uint32_t mask;  // signal bits added
+    input_gather_t pin[INPUT_GATHER_MAX];
+} input_gather_table_t;
 
-    signals.min.mask = settings.limits.invert.mask;
+static input_gather_table_t limits_min = {0}, control_inputs = {0};
 #ifdef DUAL_LIMIT_SWITCHES
-    signals.min2.mask = settings.limits.invert.mask;
+static input_gather_table_t limits_min2 = {0};
 #endif
+
+#if USE_I2S_IN
+#define INPUT_PORTS_READ(port) uint32_t port[3] = { GPIO.in, GPIO.in1.data, i2s_in_get_state() }
+#else
+#define INPUT_PORTS_READ(port) uint32_t port[2] = { GPIO.in, GPIO.in1.data }
+#endif
+
+inline IRAM_ATTR static uint32_t input_gather (const input_gather_table_t *table, const uint32_t *port)
+{
+    uint32_t value = 0;
+    uint_fast8_t idx = table->n_pins;
+
+    while(idx) {
+        idx--;
+        value |= ((port[table->pin[idx].port] >> table->pin[idx].shift) & 1) << table->pin[idx].bit;
+    }
+
+    return value ^ table->invert;
+}
+
+// Returns false if the signal bit is already taken, each signal can only be mapped to one pin.
+static bool input_gather_add (input_gather_table_t *table, uint8_t pin, uint32_t mask, bool invert)
+{
+    bool ok;
+
+    if((ok = !(table->mask & mask) && table->n_pins < INPUT_GATHER_MAX)) {
+#if USE_I2S_IN
+        if(pin >= I2S_IN_PIN_BASE) {
+            table->pin[table->n_pins].port = 2;
+            table->pin[table->n_pins].shift = pin - I2S_IN_PIN_BASE;
+        } else
+#endif
+        {
+            table->pin[table->n_pins].port = pin >= 32 ? 1 : 0;
+            table->pin[table->n_pins].shift = pin & 0x1F;
+        }
+        table->pin[table->n_pins].bit = __builtin_ctz(mask);
+        if(invert)
+            table->invert |= mask;
+        table->mask |= mask;
+        table->n_pins++;
+    }
+
+    return ok;
+}
+
+static bool input_gather_init (settings_t *settings)
+{
+    bool ok = true;
+
+    memset(&limits_min, 0, sizeof(input_gather_table_t));
+    memset(&control_inputs, 0, sizeof(input_gather_table_t));
+
 #ifdef X_LIMIT_PIN
-    signals.min.x = DIGITAL_IN(X_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, X_LIMIT_PIN, ((axes_signals_t){ .x = On }).mask, settings->limits.invert.x);
 #endif
 #ifdef Y_LIMIT_PIN
-    signals.min.y = DIGITAL_IN(Y_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, Y_LIMIT_PIN, ((axes_signals_t){ .y = On }).mask, settings->limits.invert.y);
 #endif
 #ifdef Z_LIMIT_PIN
-    signals.min.z = DIGITAL_IN(Z_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, Z_LIMIT_PIN, ((axes_signals_t){ .z = On }).mask, settings->limits.invert.z);
 #endif
 #ifdef A_LIMIT_PIN
-    signals.min.a = DIGITAL_IN(A_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, A_LIMIT_PIN, ((axes_signals_t){ .a = On }).mask, settings->limits.invert.a);
 #endif
 #ifdef B_LIMIT_PIN
-    signals.min.b = DIGITAL_IN(B_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, B_LIMIT_PIN, ((axes_signals_t){ .b = On }).mask, settings->limits.invert.b);
 #endif
 #ifdef C_LIMIT_PIN
-    signals.min.c = DIGITAL_IN(C_LIMIT_PIN);
+    ok &= input_gather_add(&limits_min, C_LIMIT_PIN, ((axes_signals_t){ .c = On }).mask, settings->limits.invert.c);
 #endif
 
-#ifdef X2_LIMIT_PIN
-    signals.min2.x = DIGITAL_IN(X2_LIMIT_PIN);
+#ifdef DUAL_LIMIT_SWITCHES
+    memset(&limits_min2, 0, sizeof(input_gather_table_t));
+  #ifdef X2_LIMIT_PIN
+    ok &= input_gather_add(&limits_min2, X2_LIMIT_PIN, ((axes_signals_t){ .x = On }).mask, settings->limits.invert.x);
+  #endif
+  #ifdef Y2_LIMIT_PIN
+    ok &= input_gather_add(&limits_min2, Y2_LIMIT_PIN, ((axes_signals_t){ .y = On }).mask, settings->limits.invert.y);
+  #endif
+  #ifdef Z2_LIMIT_PIN
+    ok &= input_gather_add(&limits_min2, Z2_LIMIT_PIN, ((axes_signals_t){ .z = On }).mask, settings->limits.invert.z);
+  #endif
 #endif
-#ifdef Y2_LIMIT_PIN
-    signals.min2.y = DIGITAL_IN(Y2_LIMIT_PIN);
+
+#ifdef RESET_PIN
+  #if ESTOP_ENABLE
+    ok &= input_gather_add(&control_inputs, RESET_PIN, ((control_signals_t){ .e_stop = On }).value, settings->control_invert.e_stop);
+  #else
+    ok &= input_gather_add(&control_inputs, RESET_PIN, ((control_signals_t){ .reset = On }).value, settings->control_invert.reset);
+  #endif
 #endif
-#ifdef Z2_LIMIT_PIN
-    signals.min2.z = DIGITAL_IN(Z2_LIMIT_PIN);
+#ifdef FEED_HOLD_PIN
+    ok &= input_gather_add(&control_inputs, FEED_HOLD_PIN, ((control_signals_t){ .feed_hold = On }).value, settings->control_invert.feed_hold);
+#endif
+#ifdef CYCLE_START_PIN
+    ok &= input_gather_add(&control_inputs, CYCLE_START_PIN, ((control_signals_t){ .cycle_start = On }).value, settings->control_invert.cycle_start);
+#endif
+#if SAFETY_DOOR_BIT || (AUX_CONTROLS_ENABLED && defined(SAFETY_DOOR_PIN))
+    ok &= input_gather_add(&control_inputs, SAFETY_DOOR_PIN, ((control_signals_t){ .safety_door_ajar = On }).value, settings->control_invert.safety_door_ajar);
+#endif
+#if AUX_CONTROLS_ENABLED
+  #ifdef MOTOR_FAULT_PIN
+    ok &= input_gather_add(&control_inputs, MOTOR_FAULT_PIN, ((control_signals_t){ .motor_fault = On }).value, settings->control_invert.motor_fault);
+  #endif
+  #ifdef MOTOR_WARNING_PIN
+    ok &= input_gather_add(&control_inputs, MOTOR_WARNING_PIN, ((control_signals_t){ .motor_warning = On }).value, settings->control_invert.motor_warning);
+  #endif
 #endif
 
-    if(settings.limits.invert.mask) {
-        signals.min.value ^= settings.limits.invert.mask;
+    return ok;
+}
+
+inline IRAM_ATTR static limit_signals_t limitsGetState (void)
+{
+    limit_signals_t signals = {0};
+    INPUT_PORTS_READ(port);
+
+    signals.min.value = (uint8_t)input_gather(&limits_min, port);
 #ifdef DUAL_LIMIT_SWITCHES
-        signals.min2.mask ^= settings.limits.invert.mask;
+    signals.min2.value = (uint8_t)input_gather(&limits_min2, port);
 #endif
-    }
 
     return signals;
 }
 
+#if AUX_CONTROLS_SCAN
+// Snapshot of the scanned aux controls, updated from aux_irq_handler().
+static volatile uint16_t aux_ctrl_signals = 0;
+static uint16_t aux_ctrl_scan_mask = 0;
+#endif
+
 #if AUX_CONTROLS_ENABLED
-static bool fpu_hack = false; // Needed to avoid awakening the stupid meditating guru that is overly sensitive to floats!
+// Aux controls the interrupt handler could not be registered for, polled by aux_ctrl_poll().
+static uint32_t aux_ctrl_poll_mask = 0, aux_ctrl_poll_state = 0;    // aux_ctrl[] index bits
+#if AUX_CONTROLS_SCAN
+static volatile uint16_t aux_ctrl_poll_signals = 0;                 // Snapshot of the polled scanned controls
+#endif
 #endif
 
 // Returns system state as a control_signals_t variable.
@@ -1434,59 +2089,21 @@ static bool fpu_hack = false; // Needed to avoid awakening the stupid meditating
 inline IRAM_ATTR static control_signals_t systemGetState (void)
 {
     control_signals_t signals;
+    INPUT_PORTS_READ(port);
 
-    signals.value = settings.control_invert.value;
-
-#ifdef RESET_PIN
-#if ESTOP_ENABLE
-    signals.e_stop = DIGITAL_IN(RESET_PIN);
-#else
-    signals.reset = DIGITAL_IN(RESET_PIN);
-#endif
-#endif
-#ifdef FEED_HOLD_PIN
-    signals.feed_hold = DIGITAL_IN(FEED_HOLD_PIN);
-#endif
-#ifdef CYCLE_START_PIN
-    signals.cycle_start = DIGITAL_IN(CYCLE_START_PIN);
-#endif
-#if SAFETY_DOOR_BIT
-    signals.safety_door_ajar = DIGITAL_IN(SAFETY_DOOR_PIN);
-#endif
+    signals.value = (uint16_t)input_gather(&control_inputs, port);
 
 #if AUX_CONTROLS_ENABLED
 
   #ifdef SAFETY_DOOR_PIN
     if(aux_ctrl[AuxCtrl_SafetyDoor].debouncing)
-        signals.safety_door_ajar = !settings.control_invert.safety_door_ajar;
-    else
-        signals.safety_door_ajar = DIGITAL_IN(SAFETY_DOOR_PIN);
-  #endif
-  #ifdef MOTOR_FAULT_PIN
-    signals.motor_fault = DIGITAL_IN(MOTOR_FAULT_PIN);
-  #endif
-  #ifdef MOTOR_WARNING_PIN
-    signals.motor_warning = DIGITAL_IN(MOTOR_WARNING_PIN);
+        signals.safety_door_ajar = On;
   #endif
 
-    if(settings.control_invert.mask)
-        signals.value ^= settings.control_invert.mask;
-
   #if AUX_CONTROLS_SCAN
-    uint_fast8_t i;
-    for(i = AUX_CONTROLS_SCAN; i < AuxCtrl_NumEntries; i++) {
-        if(!fpu_hack && aux_ctrl[i].enabled) {
-            signals.mask &= ~aux_ctrl[i].cap.mask;
-            if(hal.port.wait_on_input(Port_Digital, aux_ctrl[i].port, WaitMode_Immediate, FZERO) == 1)
-                signals.mask |= aux_ctrl[i].cap.mask;
-        }
-    }
+    signals.mask = (signals.mask & ~aux_ctrl_scan_mask) | aux_ctrl_signals | aux_ctrl_poll_signals;
   #endif
 
-#else
-    if(settings.control_invert.mask)
-        signals.value ^= settings.control_invert.mask;
-
 #endif // AUX_CONTROLS_ENABLED
 
     return signals;
@@ -1498,36 +2115,100 @@ IRAM_ATTR static void aux_irq_handler (uint8_t port, bool state)
 {
     uint_fast8_t i;
     control_signals_t signals = {0};
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     for(i = 0; i < AuxCtrl_NumEntries; i++) {
         if(aux_ctrl[i].port == port) {
+#if AUX_CONTROLS_SCAN
+            // Scanned controls are registered for both edges to keep the snapshot current,
+            // only edges matching the control's own interrupt mode are reported.
+            if(i >= AUX_CONTROLS_SCAN) {
+                if(ioports_get_state(port))
+                    aux_ctrl_signals |= aux_ctrl[i].cap.mask;
+                else
+                    aux_ctrl_signals &= ~aux_ctrl[i].cap.mask;
+                if(aux_ctrl[i].irq_mode == IRQ_Mode_None ||
+                    (aux_ctrl[i].irq_mode == IRQ_Mode_Rising && !state) ||
+                     (aux_ctrl[i].irq_mode == IRQ_Mode_Falling && state))
+                    break;
+            }
+#endif
             if(!aux_ctrl[i].debouncing) {
 #if SAFETY_DOOR_ENABLE
                 if(i == AuxCtrl_SafetyDoor) {
-                    if((aux_ctrl[i].debouncing = door_pin->active = (xTimerStartFromISR(debounceTimer, &xHigherPriorityTaskWoken) == pdPASS)))
+                    if((aux_ctrl[i].debouncing = debounce_start(door_pin)))
                         break;
                 }
 #endif
                 signals.mask |= aux_ctrl[i].cap.mask;
                 if(aux_ctrl[i].irq_mode == IRQ_Mode_Change)
-                    signals.deasserted = hal.port.wait_on_input(Port_Digital, aux_ctrl[i].port, WaitMode_Immediate, FZERO) == 0;
+                    signals.deasserted = !ioports_get_state(port);
             }
             break;
         }
     }
 
     if(signals.mask) {
-        if(!signals.deasserted) {
-            fpu_hack = true;
+        if(!signals.deasserted)
             signals.mask |= systemGetState().mask;
+        hal.control.interrupt_callback(signals);
+    }
+}
+
+// Reports changes of the aux controls without an interrupt handler, called from the foreground.
+static void aux_ctrl_poll (void)
+{
+    bool asserted;
+    uint_fast8_t i;
+    control_signals_t signals = {0};
+
+    if(aux_ctrl_poll_mask == 0)
+        return;
+
+    for(i = 0; i < AuxCtrl_NumEntries; i++) {
+
+        if(!(aux_ctrl_poll_mask & (1UL << i)))
+            continue;
+
+        if((asserted = ioports_get_state(aux_ctrl[i].port)) == !!(aux_ctrl_poll_state & (1UL << i)))
+            continue;
+
+        aux_ctrl_poll_state ^= (1UL << i);
+
+#if AUX_CONTROLS_SCAN
+        if(i >= AUX_CONTROLS_SCAN) {
+            if(asserted)
+                aux_ctrl_poll_signals |= aux_ctrl[i].cap.mask;
+            else
+                aux_ctrl_poll_signals &= ~aux_ctrl[i].cap.mask;
         }
+#endif
+        if(aux_ctrl[i].irq_mode != IRQ_Mode_None && (asserted || aux_ctrl[i].irq_mode == IRQ_Mode_Change)) {
+            signals.mask |= aux_ctrl[i].cap.mask;
+            if(aux_ctrl[i].irq_mode == IRQ_Mode_Change)
+                signals.deasserted = !asserted;
+        }
+    }
+
+    if(signals.mask) {
+        if(!signals.deasserted)
+            signals.mask |= systemGetState().mask;
         hal.control.interrupt_callback(signals);
-        fpu_hack = false;
     }
+}
 
-    if(xHigherPriorityTaskWoken)
-        portYIELD_FROM_ISR();
+// Falls back to polling the control if its interrupt handler could not be registered.
+static void aux_ctrl_register (uint_fast8_t i, pin_irq_mode_t irq_mode)
+{
+    if(!hal.port.register_interrupt_handler(aux_ctrl[i].port, irq_mode, aux_irq_handler)) {
+        aux_ctrl_poll_mask |= (1UL << i);
+        if(ioports_get_state(aux_ctrl[i].port)) {
+            aux_ctrl_poll_state |= (1UL << i);
+#if AUX_CONTROLS_SCAN
+            if(i >= AUX_CONTROLS_SCAN)
+                aux_ctrl_poll_signals |= aux_ctrl[i].cap.mask;
+#endif
+        }
+    }
 }
 
 static bool aux_attach (xbar_t *properties, aux_ctrl_t *aux_ctrl)
@@ -1577,13 +2258,69 @@ static bool aux_claim_explicit (aux_ctrl_t *aux_ctrl)
 
 #ifdef PROBE_PIN
 
+#if PROBE_ISR
+
+static void probe_log_overrun (void *data)
+{
+    report_message("Probe step log overrun, increase PROBE_ISR_LATENCY_US", Message_Warning);
+}
+
+// Removes the steps output after the probe edge from the probe position, then interpolates between the steps
+// on either side of the edge: if the edge is closer to the step after it that step is kept.
+static void probe_correct_position (void)
+{
+    if(probe_log.edge && probe_log.frozen) {
+
+        uint_fast8_t axis, n = min(probe_log.count, PROBE_STEP_LOG_SIZE), idx = probe_log.head;
+        uint32_t before_time[N_AXIS];
+        axes_signals_t before = {0};
+        probe_step_t *step;
+
+        while(n--) {
+            step = &probe_log.step[idx = idx == 0 ? PROBE_STEP_LOG_SIZE - 1 : idx - 1];
+            for(axis = 0; axis < N_AXIS; axis++) {
+                if(step->step_outbits.mask & bit(axis)) {
+                    int8_t dir = (step->dir_outbits.mask & bit(axis)) ? 1 : -1;
+                    if((int32_t)(step->time - probe_log.edge_time) > 0) {
+                        probe_log.after[axis] += dir;
+                        probe_log.after_time[axis] = step->time;
+                        probe_log.after_dir[axis] = dir;
+                    } else if(!(before.mask & bit(axis))) {
+                        before.mask |= bit(axis);
+                        before_time[axis] = step->time;
+                    }
+                }
+            }
+            // Oldest entry still after the edge and older ones overwritten: steps after the edge may be missing.
+            if(n == 0 && probe_log.count > PROBE_STEP_LOG_SIZE && (int32_t)(step->time - probe_log.edge_time) > 0)
+                protocol_enqueue_foreground_task(probe_log_overrun, NULL);
+        }
+
+        for(axis = 0; axis < N_AXIS; axis++) {
+            if(probe_log.after[axis]) {
+                sys.probe_position[axis] += probe_log.after[axis];
+                if((before.mask & bit(axis)) &&
+                    (probe_log.edge_time - before_time[axis]) * 2 > probe_log.after_time[axis] - before_time[axis])
+                    sys.probe_position[axis] -= probe_log.after_dir[axis];
+            }
+        }
+    }
+}
+
+#endif
+
 // Sets up the probe pin invert mask to
 // appropriately set the pin logic according to setting for normal-high/normal-low operation
 // and the probing cycle modes for toward-workpiece/away-from-workpiece.
 static void probeConfigure(bool is_probe_away, bool probing)
 {
 #if USE_I2S_OUT
-    i2s_set_streaming_mode(!(probing || laser_mode));
+    i2s_passthrough.probing = probing;
+    i2s_step_mode_update();
+#elif STEP_BURST_ENABLE
+    burst.probing = probing;
+#elif STEP_QUEUE_ENABLE
+    step_queue.probing = probing;
 #endif
 
     probe.triggered = Off;
@@ -1591,8 +2328,19 @@ static void probeConfigure(bool is_probe_away, bool probing)
     probe.inverted = is_probe_away ? !settings.probe.invert_probe_pin : settings.probe.invert_probe_pin;
 
 #if PROBE_ISR
-    gpio_set_intr_type(inputpin[INPUT_PROBE].pin, probe_invert ? GPIO_INTR_NEGEDGE : GPIO_INTR_POSEDGE);
-    inputpin[INPUT_PROBE].active = false;
+    // Called with probing off when the probing motion is completed.
+    probe_correct_position();
+
+    memset(&probe_log, 0, sizeof(probe_log_t));
+
+    if(probe_pin) {
+        probe_pin->active = false;
+        gpio_set_intr_type(probe_pin->pin, probing ? (probe.inverted ? GPIO_INTR_NEGEDGE : GPIO_INTR_POSEDGE) : GPIO_INTR_DISABLE);
+        if(probing)
+            gpio_intr_enable(probe_pin->pin);
+        else
+            gpio_intr_disable(probe_pin->pin);
+    }
 #endif
 }
 
@@ -1604,9 +2352,8 @@ static probe_state_t probeGetState (void)
     state.connected = probe.connected;
 
 #if PROBE_ISR
-    // TODO: verify!
-    inputpin[INPUT_PROBE].active = inputpin[INPUT_PROBE].active || ((uint8_t)DIGITAL_IN(PROBE_PIN) ^ probe.inverted);
-    state.triggered = inputpin[INPUT_PROBE].active;
+    if((state.triggered = (probe_pin && probe_pin->active) || ((uint8_t)DIGITAL_IN(PROBE_PIN) ^ probe.inverted)) && probe.is_probing)
+        probe_log.frozen = true; // Core copies the position to the probe position on return
 #else
     state.triggered = (uint8_t)DIGITAL_IN(PROBE_PIN) ^ probe.inverted;
 #endif
@@ -1625,7 +2372,7 @@ IRAM_ATTR inline static void spindle_off (void)
     iopins.spindle_on = settings.spindle.invert.on ? On : Off;
     ioexpand_out(iopins);
 #elif defined(SPINDLE_ENABLE_PIN)
-    DIGITAL_OUT(SPINDLE_ENABLE_PIN, settings.spindle.invert.on ? 1 : 0);
+    ALIGNED_OUT(SPINDLE_ENABLE_PIN, settings.spindle.invert.on ? 1 : 0);
 #endif
 }
 
@@ -1642,7 +2389,7 @@ IRAM_ATTR inline static void spindle_on (void)
     iopins.spindle_on = settings.spindle.invert.on ? Off : On;
     ioexpand_out(iopins);
 #elif defined(SPINDLE_ENABLE_PIN)
-    DIGITAL_OUT(SPINDLE_ENABLE_PIN, settings.spindle.invert.on ? 0 : 1);
+    ALIGNED_OUT(SPINDLE_ENABLE_PIN, settings.spindle.invert.on ? 0 : 1);
 #endif
 }
 
@@ -1652,7 +2399,7 @@ IRAM_ATTR inline static void spindle_dir (bool ccw)
     iopins.spindle_dir = (ccw ^ settings.spindle.invert.ccw) ? On : Off;
     ioexpand_out(iopins);
 #elif defined(SPINDLE_DIRECTION_PIN)
-    DIGITAL_OUT(SPINDLE_DIRECTION_PIN, (ccw ^ settings.spindle.invert.ccw) ? 1 : 0);
+    ALIGNED_OUT(SPINDLE_DIRECTION_PIN, (ccw ^ settings.spindle.invert.ccw) ? 1 : 0);
 #endif
 }
 
@@ -1672,7 +2419,7 @@ IRAM_ATTR static void spindleSetState (spindle_ptrs_t *spindle, spindle_state_t
 // Variable spindle control functions
 
 // Sets spindle speed
-IRAM_ATTR static void spindleSetSpeed (spindle_ptrs_t *spindle, uint_fast16_t pwm_value)
+IRAM_ATTR static void spindle_set_speed (spindle_ptrs_t *spindle, uint_fast16_t pwm_value)
 {
     if(pwm_value == pwm(spindle)->off_value) {
         if(pwm(spindle)->settings->flags.enable_rpm_controlled) {
@@ -1710,6 +2457,26 @@ IRAM_ATTR static void spindleSetSpeed (spindle_ptrs_t *spindle, uint_fast16_t pw
     }
 }
 
+#if I2S_OUT_ALIGNED_OUTPUTS
+
+static void spindle_set_speed_aligned (uint32_t spindle, uint32_t pwm_value)
+{
+    spindle_set_speed((spindle_ptrs_t *)spindle, (uint_fast16_t)pwm_value);
+}
+
+#endif
+
+IRAM_ATTR static void spindleSetSpeed (spindle_ptrs_t *spindle, uint_fast16_t pwm_value)
+{
+#if I2S_OUT_ALIGNED_OUTPUTS
+    // Laser power updated from the step stream
+    if(i2s_output_defer(spindle_set_speed_aligned, (uint32_t)spindle, pwm_value))
+        return;
+#endif
+
+    spindle_set_speed(spindle, pwm_value);
+}
+
 static uint_fast16_t spindleGetPWM (spindle_ptrs_t *spindle, float rpm)
 {
     return pwm(spindle)->compute_value(pwm(spindle), rpm, false);
@@ -1788,8 +2555,10 @@ bool spindleConfig (spindle_ptrs_t *spindle)
     spindle_update_caps(spindle, spindle->cap.variable ? &spindle_pwm : NULL);
 
 #if USE_I2S_OUT
-    if(spindle->id == spindle_get_default())
-        i2s_set_streaming_mode(!(laser_mode = spindle->cap.laser));
+    if(spindle->id == spindle_get_default()) {
+        laser_mode = spindle->cap.laser && !I2S_OUT_ALIGNED_OUTPUTS;
+        i2s_step_mode_update();
+    }
 #endif
 
     return true;
@@ -1838,10 +2607,10 @@ IRAM_ATTR static void coolantSetState (coolant_state_t mode)
     ioexpand_out(iopins);
 #else
  #ifdef COOLANT_FLOOD_PIN
-    DIGITAL_OUT(COOLANT_FLOOD_PIN, mode.flood ? 1 : 0);
+    ALIGNED_OUT(COOLANT_FLOOD_PIN, mode.flood ? 1 : 0);
  #endif
  #ifdef COOLANT_MIST_PIN
-    DIGITAL_OUT(COOLANT_MIST_PIN, mode.mist ? 1 : 0);
+    ALIGNED_OUT(COOLANT_MIST_PIN, mode.mist ? 1 : 0);
  #endif
 #endif
 }
@@ -1924,25 +2693,78 @@ static void modeEnable (void *data)
 
 #endif
 
-void debounceTimerCallback (TimerHandle_t xTimer)
+/*
+  Software debounce, each pin has its own deadline set by the first edge seen.
+  Further edges are ignored until the deadline has passed, then the pin level is checked
+  and the event reported if still asserted. A single esp_timer is armed for the earliest pending deadline.
+*/
+
+// Arm the debounce timer if not armed or armed for a later deadline.
+IRAM_ATTR static void debounce_arm (uint32_t deadline, uint32_t now)
+{
+    portENTER_CRITICAL_SAFE(&debounce_timer_mux);
+
+    if(!debounce_armed || (int32_t)(deadline - debounce_next) < 0) {
+        if(debounce_armed)
+            esp_timer_stop(debounceTimer);
+        debounce_next = deadline;
+        debounce_armed = esp_timer_start_once(debounceTimer, (int32_t)(deadline - now) > 0 ? deadline - now : 1) == ESP_OK;
+    }
+
+    portEXIT_CRITICAL_SAFE(&debounce_timer_mux);
+}
+
+IRAM_ATTR static bool debounce_start (input_signal_t *signal)
 {
-    uint32_t grp = 0, i = sizeof(inputpin) / sizeof(input_signal_t);
+    if(!signal->active) {
+        uint32_t now = (uint32_t)esp_timer_get_time();
+        signal->debounce_until = now + ((signal->group & (PinGroup_Limit|PinGroup_LimitMax)) ? DEBOUNCE_LIMIT_US : DEBOUNCE_CONTROL_US);
+        signal->active = true;
+        debounce_arm(signal->debounce_until, now);
+    }
+
+    return true;
+}
+
+IRAM_ATTR static void debounceTimerCallback (void *arg)
+{
+    bool pending = false;
+    uint32_t grp = 0, next = 0, now = (uint32_t)esp_timer_get_time(), i = sizeof(inputpin) / sizeof(input_signal_t);
+
+    portENTER_CRITICAL_SAFE(&debounce_timer_mux);
+    debounce_armed = false;
+    portEXIT_CRITICAL_SAFE(&debounce_timer_mux);
+
     do {
         i--;
         if(inputpin[i].debounce && inputpin[i].active) {
-            inputpin[i].active = false; //DIGITAL_IN(inputpin[i].pin) == (inputpin[i].invert ? 0 : 1);
-            grp |= inputpin[i].group;
-        }
+            if((int32_t)(inputpin[i].debounce_until - now) > 0) {
+                if(!pending || (int32_t)(inputpin[i].debounce_until - next) < 0)
+                    next = inputpin[i].debounce_until;
+                pending = true;
+                continue;
+            }
+            inputpin[i].active = false;
 #if SAFETY_DOOR_ENABLE
-        if(&inputpin[i] == door_pin)
-            aux_ctrl[AuxCtrl_SafetyDoor].debouncing = Off;
-#endif
+            // The door is reported via systemGetState() which returns the actual level when not debouncing.
+            if(&inputpin[i] == door_pin) {
+                aux_ctrl[AuxCtrl_SafetyDoor].debouncing = Off;
+                grp |= inputpin[i].group;
+            } else
+#endif
+            // Other inputs are only reported if still asserted when the window has passed, a glitch shorter than the window is dropped.
+            if(DIGITAL_IN(inputpin[i].pin) == (inputpin[i].invert ? 0 : 1))
+                grp |= inputpin[i].group;
+        }
     } while(i);
 
+    if(pending)
+        debounce_arm(next, now);
+
     if(grp & (PinGroup_Limit|PinGroup_LimitMax)) {
-        portENTER_CRITICAL(&debounce_mux);
+        portENTER_CRITICAL_SAFE(&debounce_mux);
         hal.limits.interrupt_callback(limitsGetState());
-        portEXIT_CRITICAL(&debounce_mux);
+        portEXIT_CRITICAL_SAFE(&debounce_mux);
     }
 
 #if SAFETY_DOOR_ENABLE
@@ -1950,9 +2772,9 @@ void debounceTimerCallback (TimerHandle_t xTimer)
 #else
     if(grp & PinGroup_Control) {
 #endif
-        portENTER_CRITICAL(&debounce_mux);
+        portENTER_CRITICAL_SAFE(&debounce_mux);
         hal.control.interrupt_callback(systemGetState());
-        portEXIT_CRITICAL(&debounce_mux);
+        portEXIT_CRITICAL_SAFE(&debounce_mux);
     }
 }
 
@@ -2018,28 +2840,23 @@ static void settings_changed (settings_t *settings, settings_changed_flags_t cha
          * Step pulse config *
          *********************/
 
-#if USE_I2S_OUT
-
-        i2s_delay_length = (uint32_t)ceilf(settings->steppers.pulse_delay_microseconds);
-        i2s_step_length = (uint32_t)ceilf(settings->steppers.pulse_microseconds);
+        step_outputs_init(settings);
 
-        if(i2s_delay_length % I2S_OUT_USEC_PER_PULSE)
-            i2s_delay_length += I2S_OUT_USEC_PER_PULSE - i2s_delay_length % I2S_OUT_USEC_PER_PULSE;
-
-        i2s_delay_length = min(max(i2s_delay_length, I2S_OUT_USEC_PER_PULSE), I2S_OUT_USEC_PER_PULSE * 2);
-
-        if(i2s_step_length % I2S_OUT_USEC_PER_PULSE)
-            i2s_step_length += I2S_OUT_USEC_PER_PULSE - i2s_step_length % I2S_OUT_USEC_PER_PULSE;
-
-        i2s_step_length = min(max(i2s_step_length, I2S_OUT_USEC_PER_PULSE), I2S_OUT_USEC_PER_PULSE * 4);
-
-        i2s_delay_samples = i2s_delay_length / I2S_OUT_USEC_PER_PULSE;
-        i2s_step_samples = i2s_step_length / I2S_OUT_USEC_PER_PULSE;
+#if USE_I2S_OUT
 
-//        hal.max_step_rate = 250000UL / (i2s_delay_samples + i2s_step_samples);
+        // Passthrough mode, one sample low between pulses.
+        i2s_pass_min_cycles = (i2s_delay_length + i2s_step_length + 2 * I2S_OUT_USEC_PER_PULSE) * (hal.f_step_timer / 1000000);
+        i2s_pass_max_rate = 1000000UL / (i2s_delay_length + i2s_step_length + 2 * I2S_OUT_USEC_PER_PULSE);
+        if(!i2s_streaming)
+            hal.max_step_rate = i2s_pass_max_rate;
 
 #else
-        initRMT(settings);
+  #if STEP_BURST_ENABLE
+        burst.laser = settings->mode == Mode_Laser;
+  #elif STEP_QUEUE_ENABLE
+        step_queue.laser = settings->mode == Mode_Laser;
+        step_queue.max_ahead = STEP_QUEUE_MAX_US * (hal.f_step_timer / 1000000UL);
+  #endif
 #endif
 
         /****************************************
@@ -2091,6 +2908,12 @@ static void settings_changed (settings_t *settings, settings_changed_flags_t cha
                 case Input_Probe:
                     pullup = hal.driver_cap.probe_pull_up;
                     signal->invert = false;
+#if PROBE_ISR
+                    probe_pin = signal;
+  #if ETHERNET_ENABLE
+                    gpio_isr_handler_add(signal->pin, gpio_probe_isr, signal);
+  #endif
+#endif
                     break;
 
                 case Input_LimitX:
@@ -2179,6 +3002,12 @@ static void settings_changed (settings_t *settings, settings_changed_flags_t cha
                     break;
             }
 
+#if USE_I2S_IN
+            if(signal->pin >= I2S_IN_PIN_BASE && signal->pin != 0xFF) {
+                signal->active = false;
+                INPUT_IRQ_ENABLE(signal->pin, (signal->group & (PinGroup_Limit|PinGroup_LimitMax)) ? IRQ_Mode_None : signal->mode.irq_mode);
+            } else
+#endif
             if(signal->pin != 0xFF) {
 
                 gpio_intr_disable(signal->pin);
@@ -2202,18 +3031,49 @@ static void settings_changed (settings_t *settings, settings_changed_flags_t cha
 
                 gpio_config(&config);
 
-                signal->active = signal->debounce && DIGITAL_IN(signal->pin) == (signal->invert ? 0 : 1);
+                signal->active = false;
+
+#if DEBOUNCE_GLITCH_FILTER && defined(PIN_FILTER_EN)
+                if(signal->group & (PinGroup_Control|PinGroup_Limit|PinGroup_LimitMax))
+                    PIN_FILTER_EN(GPIO_PIN_MUX_REG[signal->pin]);
+                else
+                    PIN_FILTER_DIS(GPIO_PIN_MUX_REG[signal->pin]);
+#endif
             }
         } while(i);
 
+        if(!input_gather_init(settings))
+            protocol_enqueue_foreground_task(report_warning, "Limit or control signal assigned to more than one input, check the board map!");
+
 #if AUX_CONTROLS_ENABLED
+        aux_ctrl_poll_mask = aux_ctrl_poll_state = 0;
+  #if AUX_CONTROLS_SCAN
+        uint16_t scan_signals = 0;
+        aux_ctrl_scan_mask = aux_ctrl_poll_signals = 0;
+  #endif
         for(i = 0; i < AuxCtrl_NumEntries; i++) {
+  #if AUX_CONTROLS_SCAN
+            if(aux_ctrl[i].enabled && i >= AUX_CONTROLS_SCAN) {
+                if(aux_ctrl[i].irq_mode & (IRQ_Mode_Falling|IRQ_Mode_Rising))
+                    aux_ctrl[i].irq_mode = (settings->control_invert.mask & aux_ctrl[i].cap.mask) ? IRQ_Mode_Falling : IRQ_Mode_Rising;
+                aux_ctrl_scan_mask |= aux_ctrl[i].cap.mask;
+                if(hal.port.wait_on_input(Port_Digital, aux_ctrl[i].port, WaitMode_Immediate, FZERO) == 1)
+                    scan_signals |= aux_ctrl[i].cap.mask;
+                aux_ctrl_register(i, IRQ_Mode_Change);
+                if(aux_ctrl_poll_mask & (1UL << i))
+                    scan_signals &= ~aux_ctrl[i].cap.mask; // snapshot kept by aux_ctrl_poll()
+                continue;
+            }
+  #endif
             if(aux_ctrl[i].enabled && aux_ctrl[i].irq_mode != IRQ_Mode_None) {
                 if(aux_ctrl[i].irq_mode & (IRQ_Mode_Falling|IRQ_Mode_Rising))
                     aux_ctrl[i].irq_mode = (settings->control_invert.mask & aux_ctrl[i].cap.mask) ? IRQ_Mode_Falling : IRQ_Mode_Rising;
-                hal.port.register_interrupt_handler(aux_ctrl[i].port, aux_ctrl[i].irq_mode, aux_irq_handler);
+                aux_ctrl_register(i, aux_ctrl[i].irq_mode);
             }
         }
+  #if AUX_CONTROLS_SCAN
+        aux_ctrl_signals = scan_signals;
+  #endif
 #endif
     }
 }
@@ -2226,7 +3086,12 @@ static void enumeratePins (bool low_level, pin_info_ptr pin_info, void *data)
     pin.mode.input = On;
 
     for(i = 0; i < sizeof(inputpin) / sizeof(input_signal_t); i++) {
+#if USE_I2S_IN
+        pin.pin = inputpin[i].pin - (inputpin[i].pin < I2S_IN_PIN_BASE ? 0 : I2S_IN_PIN_BASE);
+        pin.port = low_level || inputpin[i].pin < I2S_IN_PIN_BASE ? NULL : "I2S in";
+#else
         pin.pin = inputpin[i].pin;
+#endif
         pin.function = inputpin[i].id;
         pin.group = inputpin[i].group;
         pin.mode.pwm = pin.group == PinGroup_SpindlePWM;
@@ -2506,7 +3371,20 @@ static bool driver_setup (settings_t *settings)
     timer_isr_register(STEP_TIMER_GROUP, STEP_TIMER_INDEX, stepper_driver_isr, 0, ESP_INTR_FLAG_IRAM, NULL);
     timer_enable_intr(STEP_TIMER_GROUP, STEP_TIMER_INDEX);
 
+#if STEP_QUEUE_ENABLE
+    xTaskCreatePinnedToCore(stepQueueTask, "StepQueue", 4096, NULL, GRBLHAL_TASK_PRIORITY + 1, &step_queue.task, GRBLHAL_TASK_CORE);
+#endif
+
+#if USE_I2S_OUT && !CONFIG_IDF_TARGET_ESP32S3
+    timer_init(STEP_TIMER_GROUP, PULSE_TIMER_INDEX, &timerConfig);
+    timer_set_counter_value(STEP_TIMER_GROUP, PULSE_TIMER_INDEX, 0ULL); // Also sets the reload value used by pulse_timer_start()
+    timer_isr_register(STEP_TIMER_GROUP, PULSE_TIMER_INDEX, pulse_timer_isr, 0, ESP_INTR_FLAG_IRAM, NULL);
+    timer_enable_intr(STEP_TIMER_GROUP, PULSE_TIMER_INDEX);
+#endif
+
 #if USE_I2S_OUT
+    i2s_stream_max_rate = hal.max_step_rate;
+
     if(i2s_out_init()) {
 #if CONFIG_IDF_TARGET_ESP32S3
         i2s_set_step_outputs((axes_signals_t){ .mask = AXES_BITMASK });
@@ -2584,8 +3462,18 @@ static bool driver_setup (settings_t *settings)
     *  Software debounce init  *
     ****************************/
 
-    if(hal.driver_cap.software_debounce)
-        debounceTimer = xTimerCreate("debounce", pdMS_TO_TICKS(32), pdFALSE, NULL, debounceTimerCallback);
+    if(hal.driver_cap.software_debounce) {
+
+        esp_timer_create_args_t debounce_timer_args = {
+            .callback = debounceTimerCallback,
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+            .dispatch_method = ESP_TIMER_ISR,
+#endif
+            .name = "debounce"
+        };
+
+        esp_timer_create(&debounce_timer_args, &debounceTimer);
+    }
 
     /******************************************
      *  Control, limit & probe pins dir init  *
@@ -2594,9 +3482,34 @@ static bool driver_setup (settings_t *settings)
 #if ETHERNET_ENABLE
     gpio_install_isr_service(0);
 #else
+    uint32_t i = sizeof(inputpin) / sizeof(input_signal_t);
+
+    memset(gpio_input_map, 0xFF, sizeof(gpio_input_map));
+
+    do {
+        i--;
+        if(inputpin[i].pin < GPIO_NUM_MAX)
+            gpio_input_map[inputpin[i].pin] = (uint8_t)i;
+    } while(i);
+
     gpio_isr_register(gpio_isr, NULL, (int)ESP_INTR_FLAG_IRAM, NULL);
 #endif
 
+#if USE_I2S_IN
+    idx = sizeof(inputpin) / sizeof(input_signal_t);
+
+    memset(i2s_input_map, 0xFF, sizeof(i2s_input_map));
+
+    do {
+        idx--;
+        if(inputpin[idx].pin >= I2S_IN_PIN_BASE && inputpin[idx].pin < I2S_IN_PIN_BASE + I2S_IN_NUM_BITS)
+            i2s_input_map[inputpin[idx].pin - I2S_IN_PIN_BASE] = (uint8_t)idx;
+    } while(idx);
+
+    // Control, limit and probe inputs behind the shift registers can not be read without it.
+    bool i2s_in_ok = i2s_in_init(i2s_in_event);
+#endif
+
 #if DRIVER_SPINDLE_PWM_ENABLE
 
     /******************
@@ -2674,6 +3587,15 @@ static bool driver_setup (settings_t *settings)
     grbl.on_spindle_selected = onSpindleSelected;
 #endif
 
+#if USE_I2S_OUT
+    on_state_change = grbl.on_state_change;
+    grbl.on_state_change = i2s_state_changed;
+#endif
+
+#if I2S_OUT_ALIGNED_OUTPUTS
+    i2s_output_init();
+#endif
+
 #if ETHERNET_ENABLE
     enet_start();
 #endif
@@ -2681,6 +3603,12 @@ static bool driver_setup (settings_t *settings)
 //    if(hal.rgb.out)
 //        hal.rgb.out(0, (rgb_color_t){ .R = 5, .G = 100, .B = 5 });
 
+#if USE_I2S_IN
+    // Fail setup so that the core reports it and refuses motion.
+    if(!i2s_in_ok)
+        return false;
+#endif
+
     return IOInitDone;
 }
 
@@ -2719,6 +3647,10 @@ static void wdt_tickler (sys_state_t state)
         ms = xTaskGetTickCountFromISR();
         vTaskDelay(1);
     }
+
+#if AUX_CONTROLS_ENABLED
+    aux_ctrl_poll();
+#endif
 }
 
 // Initialize HAL pointers, setup serial comms and enable EEPROM
@@ -2754,11 +3686,17 @@ bool driver_init (void)
 
 #if USE_I2S_OUT
     hal.driver_reset = I2SReset;
-    hal.stepper.wake_up = I2SStepperWakeUp;
-    hal.stepper.go_idle = I2SStepperGoIdle;
+    hal.stepper.wake_up = I2SStepperSelectWakeUp;
+    hal.stepper.go_idle = I2SStepperSelectGoIdle;
+    hal.stepper.enable = stepperEnable;
+    hal.stepper.cycles_per_tick = I2SStepperSelectCyclesPerTick;
+    hal.stepper.pulse_start = I2SStepperSelectPulseStart;
+#elif STEP_QUEUE_ENABLE
+    hal.stepper.wake_up = stepQueueWakeUp;
+    hal.stepper.go_idle = stepQueueGoIdle;
     hal.stepper.enable = stepperEnable;
-    hal.stepper.cycles_per_tick = I2SStepperCyclesPerTick;
-    hal.stepper.pulse_start = I2SStepperPulseStart;
+    hal.stepper.cycles_per_tick = stepQueueCyclesPerTick;
+    hal.stepper.pulse_start = stepQueuePulseStart;
 #else
     hal.stepper.wake_up = stepperWakeUp;
     hal.stepper.go_idle = stepperGoIdle;
@@ -2917,6 +3855,10 @@ bool driver_init (void)
                 aux_inputs.pins.inputs = input;
             input->id = (pin_function_t)(Input_Aux0 + aux_inputs.n_pins++);
             input->cap.pull_mode = PullMode_UpDown;
+#if USE_I2S_IN
+            if(input->pin >= I2S_IN_PIN_BASE)
+                input->cap.pull_mode = PullMode_None;
+#endif
             input->cap.irq_mode = IRQ_Mode_Edges;
 #if SAFETY_DOOR_ENABLE
             if(input->pin == SAFETY_DOOR_PIN && input->cap.irq_mode != IRQ_Mode_None) {
@@ -3059,6 +4001,22 @@ bool driver_init (void)
     bluetooth_init_local();
 #endif
 
+#if ISR_STATS_ENABLE
+    isr_stats_init();
+#endif
+
+#if USE_I2S_OUT
+    i2s_settings_init();
+#endif
+
+#if USE_I2S_OUT && I2S_OUT_STATS_ENABLE
+    i2s_stats_init();
+#endif
+
+#if PCNT_ENCODER_ENABLE
+    pcnt_encoder_init();
+#endif
+
 #include "grbl/plugins_init.h"
 
     // no need to move version check before init - compiler will fail any mismatch for existing entries
@@ -3070,6 +4028,12 @@ bool driver_init (void)
 // Main stepper driver
 IRAM_ATTR static void stepper_driver_isr (void *arg)
 {
+#if ISR_STATS_ENABLE
+    // The timer counter is reset on alarm so its value is the entry latency.
+    uint32_t isr_entry = XTHAL_GET_CCOUNT(),
+             isr_latency = (uint32_t)timer_group_get_counter_value_in_isr(STEP_TIMER_GROUP, STEP_TIMER_INDEX) * isr_stats_step_timer_cycles;
+#endif
+
 #if CONFIG_IDF_TARGET_ESP32S3
     TIMERG0.int_clr_timers.t0_int_clr = 1;
     TIMERG0.hw_timer[STEP_TIMER_INDEX].config.tn_alarm_en = TIMER_ALARM_EN;
@@ -3077,28 +4041,43 @@ IRAM_ATTR static void stepper_driver_isr (void *arg)
     TIMERG0.int_clr_timers.t0 = 1;
     TIMERG0.hw_timer[STEP_TIMER_INDEX].config.alarm_en = TIMER_ALARM_EN;
 #endif
+
+#if STEP_BURST_ENABLE
+    if(burst.state == Burst_Off || !stepBurstTick()) {
+        burst.candidate = false;
+        hal.stepper.interrupt_callback();
+        if(burst.candidate)
+            stepBurstRun();
+    }
+#elif STEP_QUEUE_ENABLE
+    if(step_queue.active)
+        stepQueueOutput();
+    else
+        hal.stepper.interrupt_callback();
+#else
     hal.stepper.interrupt_callback();
+#endif
+
+#if ISR_STATS_ENABLE
+    isr_stats_add(IsrStats_Step, isr_latency, XTHAL_GET_CCOUNT() - isr_entry);
+#endif
 }
 
 #if ETHERNET_ENABLE
 
 IRAM_ATTR static void gpio_limit_isr (void *signal)
 {
-    if(((input_signal_t *)signal)->debounce) {
-        ((input_signal_t *)signal)->active = true;
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        xTimerStartFromISR(debounceTimer, &xHigherPriorityTaskWoken);
-    } else
+    if(((input_signal_t *)signal)->debounce)
+        debounce_start((input_signal_t *)signal);
+    else
         hal.limits.interrupt_callback(limitsGetState());
 }
 
 IRAM_ATTR static void gpio_control_isr (void *signal)
 {
-    if(((input_signal_t *)signal)->debounce) {
-        ((input_signal_t *)signal)->active = true;
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        xTimerStartFromISR(debounceTimer, &xHigherPriorityTaskWoken);
-    } else
+    if(((input_signal_t *)signal)->debounce)
+        debounce_start((input_signal_t *)signal);
+    else
         hal.control.interrupt_callback(systemGetState());
 }
 
@@ -3107,6 +4086,13 @@ IRAM_ATTR static void gpio_aux_isr (void *signal)
     ioports_event((input_signal_t *)signal);
 }
 
+#if PROBE_ISR
+IRAM_ATTR static void gpio_probe_isr (void *signal)
+{
+    probe_latch_edge((input_signal_t *)signal, (uint32_t)esp_timer_get_time());
+}
+#endif
+
 #if MPG_MODE == 1
 
 IRAM_ATTR static void gpio_mpg_isr (void *signal)
@@ -3135,34 +4121,45 @@ IRAM_ATTR static void gpio_i2c_strobe_isr (void *signal)
   //GPIO intr process
 IRAM_ATTR static void gpio_isr (void *arg)
 {
-    bool debounce = false;
-    uint32_t grp = 0, intr_status[2];
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+#if ISR_STATS_ENABLE
+    uint32_t isr_entry = XTHAL_GET_CCOUNT();
+#endif
+    uint32_t grp = 0, intr_status[2], bank, pending;
+    input_signal_t *input;
 
     gpio_ll_get_intr_status(&GPIO, GRBLHAL_TASK_CORE, &intr_status[0]);         // get interrupt status for GPIO0-31
     gpio_ll_get_intr_status_high(&GPIO, GRBLHAL_TASK_CORE, &intr_status[1]);    // get interrupt status for GPIO32-39
     gpio_ll_clear_intr_status(&GPIO, intr_status[0]);                           // clear intr for gpio0-gpio31
     gpio_ll_clear_intr_status_high(&GPIO, intr_status[1]);                      // clear intr for gpio32-39
 
-    uint32_t i = sizeof(inputpin) / sizeof(input_signal_t);
-    do {
-        i--;
-        if(intr_status[inputpin[i].offset] & inputpin[i].mask) {
-
-            if(inputpin[i].group & PinGroup_AuxInput)
-                ioports_event(&inputpin[i]);
-            else {
-                inputpin[i].active = true;
-                if(inputpin[i].debounce)
-                    debounce = true;
-                else
-                    grp |= inputpin[i].group;
-            }
-        }
-    } while(i);
+    // Dispatch on the pending bits only, cost is proportional to the number of pins that fired.
+    for(bank = 0; bank < 2; bank++) {
+
+        pending = intr_status[bank];
 
-    if(debounce)
-        xTimerStartFromISR(debounceTimer, &xHigherPriorityTaskWoken);
+        while(pending) {
+
+            uint32_t gpio = (bank << 5) + __builtin_ctz(pending);
+
+            pending &= pending - 1;
+
+            if(gpio >= GPIO_NUM_MAX || gpio_input_map[gpio] == 0xFF)
+                continue;
+
+            input = &inputpin[gpio_input_map[gpio]];
+
+            if(input->group & PinGroup_AuxInput)
+                ioports_event(input);
+#if PROBE_ISR
+            else if(input->group == PinGroup_Probe)
+                probe_latch_edge(input, (uint32_t)esp_timer_get_time());
+#endif
+            else if(input->debounce)
+                debounce_start(input);
+            else
+                grp |= input->group;
+        }
+    }
 
     if(grp & (PinGroup_Limit|PinGroup_LimitMax))
         hal.limits.interrupt_callback(limitsGetState());
@@ -3186,8 +4183,45 @@ IRAM_ATTR static void gpio_isr (void *arg)
         i2c_strobe.callback(0, DIGITAL_IN(I2C_STROBE_PIN));
 #endif
 
-    if(xHigherPriorityTaskWoken)
-        portYIELD_FROM_ISR();
+#if ISR_STATS_ENABLE
+    // Edge time is not known, only execution time is recorded.
+    isr_stats_add(IsrStats_GPIO, UINT32_MAX, XTHAL_GET_CCOUNT() - isr_entry);
+#endif
 }
 
 #endif
+
+#if USE_I2S_IN
+
+// Called from the I2S input DMA interrupt handler with the inputs that have changed, dispatched as in gpio_isr().
+IRAM_ATTR static void i2s_in_event (uint32_t events)
+{
+    uint32_t grp = 0, bit;
+    input_signal_t *input;
+
+    while(events) {
+
+        bit = __builtin_ctz(events);
+        events &= events - 1;
+
+        if(i2s_input_map[bit] == 0xFF)
+            continue;
+
+        input = &inputpin[i2s_input_map[bit]];
+
+        if(input->group & PinGroup_AuxInput)
+            ioports_event(input);
+        else if(input->debounce)
+            debounce_start(input);
+        else
+            grp |= input->group;
+    }
+
+    if(grp & (PinGroup_Limit|PinGroup_LimitMax))
+        hal.limits.interrupt_callback(limitsGetState());
+
+    if(grp & PinGroup_Control)
+        hal.control.interrupt_callback(systemGetState());
+}
+
+#endif // USE_I2S_IN
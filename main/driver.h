@@ -68,7 +68,15 @@
 #define GRBLHAL_TASK_CORE 1
 #endif
 
-#define PROBE_ISR 0 // Catch probe state change by interrupt TODO: needs verification!
+#ifndef PROBE_ISR
+#define PROBE_ISR 0 // Latch probe edge by interrupt, the probe position is interpolated from the step timing around the edge.
+#endif
+#ifndef PROBE_ISR_LATENCY_US
+#define PROBE_ISR_LATENCY_US 20     // Max time from the probe edge until the latched edge is seen by the step timer ISR.
+#endif
+#ifndef PROBE_STEP_RATE_MAX
+#define PROBE_STEP_RATE_MAX 200000  // Max step rate while probing, steps/s. Together with PROBE_ISR_LATENCY_US sizes the probe step log.
+#endif
 
 // DO NOT change settings here!
 
@@ -162,6 +170,11 @@ typedef struct {
 #error "Add #define GRBL_ESP32 in grbl/config.h or update your CMakeLists.txt to the latest version!"
 #endif
 
+#if PROBE_ISR && !(PROBE_ENABLE && defined(PROBE_PIN))
+#undef PROBE_ISR
+#define PROBE_ISR 0
+#endif
+
 #if IOEXPAND_ENABLE == 0 && ((DIRECTION_MASK|STEPPERS_DISABLE_MASK|SPINDLE_MASK|COOLANT_MASK) & 0xC00000000ULL)
 #error "Pins 34 - 39 are input only!"
 #endif
@@ -292,6 +305,130 @@ extern SemaphoreHandle_t i2cBusy;
 #define DIGITAL_OUT(pin, state) gpio_ll_set_level(&GPIO, pin, state)
 #endif
 
+#ifndef I2S_IN_PIN_BASE
+#define I2S_IN_PIN_BASE (I2S_OUT_PIN_BASE + 64) // Above the 64-bit I2S output range
+#endif
+
+#ifdef USE_I2S_IN
+#if CONFIG_IDF_TARGET_ESP32S3
+#error "I2S input expansion is not available for the ESP32-S3!"
+#endif
+#undef USE_I2S_IN
+#define USE_I2S_IN 1
+#undef DIGITAL_IN
+#if USE_I2S_OUT
+#define DIGITAL_IN(pin) (pin >= I2S_IN_PIN_BASE ? i2s_in_state(pin - I2S_IN_PIN_BASE) : pin >= I2S_OUT_PIN_BASE ? i2s_out_state(pin - I2S_OUT_PIN_BASE) : gpio_ll_get_level(&GPIO, pin))
+#else
+#define DIGITAL_IN(pin) (pin >= I2S_IN_PIN_BASE ? i2s_in_state(pin - I2S_IN_PIN_BASE) : gpio_ll_get_level(&GPIO, pin))
+#endif
+// Input pin interrupt enable/disable, I2S inputs report edges from the DMA interrupt handler.
+#define INPUT_IRQ_ENABLE(pin, irq_mode) { if(pin >= I2S_IN_PIN_BASE) i2s_in_irq_enable(pin - I2S_IN_PIN_BASE, irq_mode); else { gpio_set_intr_type(pin, map_intr_type(irq_mode)); gpio_intr_enable(pin); } }
+#define INPUT_IRQ_DISABLE(pin) { if(pin >= I2S_IN_PIN_BASE) i2s_in_irq_enable(pin - I2S_IN_PIN_BASE, IRQ_Mode_None); else gpio_intr_disable(pin); }
+#if PROBE_ISR && PROBE_PIN >= I2S_IN_PIN_BASE
+#undef PROBE_ISR
+#define PROBE_ISR 0 // The probe edge time is not known for I2S inputs
+#endif
+#else
+#define USE_I2S_IN 0
+#define INPUT_IRQ_ENABLE(pin, irq_mode) { gpio_set_intr_type(pin, map_intr_type(irq_mode)); gpio_intr_enable(pin); }
+#define INPUT_IRQ_DISABLE(pin) gpio_intr_disable(pin)
+#endif
+
+#ifndef STEP_BURST_ENABLE
+#define STEP_BURST_ENABLE 0
+#endif
+
+#ifndef STEP_QUEUE_ENABLE
+#define STEP_QUEUE_ENABLE 0
+#endif
+
+#if STEP_QUEUE_ENABLE
+#if USE_I2S_OUT || STEP_BURST_ENABLE
+#error "Step event queue is only available with RMT stepping and cannot be combined with step bursts!"
+#endif
+#ifndef STEP_QUEUE_SIZE
+#define STEP_QUEUE_SIZE 64 // Number of step events, must be a power of 2. The core runs up to this many steps ahead of the outputs.
+#endif
+#ifndef STEP_QUEUE_MAX_US
+#define STEP_QUEUE_MAX_US 2000 // Max. time in microseconds the core runs ahead of the outputs, limits feed hold and override latency.
+#endif
+#endif
+
+#ifndef ISR_STATS_ENABLE
+#define ISR_STATS_ENABLE 0
+#endif
+
+#ifndef I2S_OUT_STATS_ENABLE
+#define I2S_OUT_STATS_ENABLE 0
+#endif
+
+#ifndef I2S_OUT_ALIGNED_OUTPUTS
+#define I2S_OUT_ALIGNED_OUTPUTS 0
+#endif
+
+#if I2S_OUT_ALIGNED_OUTPUTS
+#if !USE_I2S_OUT
+#undef I2S_OUT_ALIGNED_OUTPUTS
+#define I2S_OUT_ALIGNED_OUTPUTS 0
+#else
+#ifndef I2S_OUT_ALIGNED_QUEUE_SIZE
+#define I2S_OUT_ALIGNED_QUEUE_SIZE 16 // Number of pending output changes, must be a power of 2.
+#endif
+// Output change to be applied when the step stream reaches the I2S outputs.
+typedef void (*i2s_output_ptr)(uint32_t arg, uint32_t value);
+bool i2s_output_defer (i2s_output_ptr output, uint32_t arg, uint32_t value);
+void i2s_output_gpio (uint32_t pin, uint32_t level);
+#endif
+#endif
+
+// Spindle, coolant and aux outputs: GPIO outputs changed while stepping switch together with the I2S outputs.
+#if I2S_OUT_ALIGNED_OUTPUTS
+#define ALIGNED_OUT(pin, state) { if(pin >= I2S_OUT_PIN_BASE || !i2s_output_defer(i2s_output_gpio, pin, state)) DIGITAL_OUT(pin, state); }
+#else
+#define ALIGNED_OUT(pin, state) DIGITAL_OUT(pin, state)
+#endif
+
+#if USE_I2S_OUT
+#ifndef I2S_OUT_STEP_MODE
+#define I2S_OUT_STEP_MODE 2         // Default step mode, 0: auto, 1: passthrough, 2: streaming.
+#endif
+#ifndef I2S_OUT_STEP_MODE_SETTING
+#define I2S_OUT_STEP_MODE_SETTING ((setting_id_t)798) // $798, owned by this driver. Setting_UserDefined_0 - 9 ($450 - $459) are left to user plugins.
+#endif
+#ifndef I2S_OUT_AUTO_STREAM_RATE
+#define I2S_OUT_AUTO_STREAM_RATE 5000 // Auto step mode: motion with all queued blocks below this step rate (steps/s) is run in passthrough mode.
+#endif
+#ifndef I2S_OUT_PULSE_BATCH
+#define I2S_OUT_PULSE_BATCH 1       // Streaming: run the Bresenham line tracer for the steps within a segment from the bitstream generator.
+#endif
+#ifndef I2S_OUT_DEEP_STREAM_RATE
+#define I2S_OUT_DEEP_STREAM_RATE 20000 // Streaming: segments at or above this step rate (steps/s) are filled from deep DMA buffers.
+#endif
+#endif
+
+#ifndef DEBOUNCE_LIMIT_US
+#define DEBOUNCE_LIMIT_US 32000     // Software debounce window for limit inputs, microseconds.
+#endif
+#ifndef DEBOUNCE_CONTROL_US
+#define DEBOUNCE_CONTROL_US 32000   // Software debounce window for control inputs and the safety door, microseconds.
+#endif
+#ifndef DEBOUNCE_GLITCH_FILTER
+#define DEBOUNCE_GLITCH_FILTER 0    // Enable the GPIO hardware glitch filter for control and limit inputs (ESP32-S3).
+#endif
+
+#ifndef PCNT_ENCODER_ENABLE
+#define PCNT_ENCODER_ENABLE 0
+#endif
+
+#if STEP_BURST_ENABLE
+#if USE_I2S_OUT
+#error "Step bursts are only available with RMT stepping!"
+#endif
+#ifndef STEP_BURST_MAX_US
+#define STEP_BURST_MAX_US 10000 // Max duration of a pulse train, the core runs up to this far ahead of the step outputs.
+#endif
+#endif
+
 typedef enum
 {
     Pin_GPIO = 0,
@@ -314,6 +451,7 @@ typedef struct {
     bool invert;
     volatile bool active;
     volatile bool debounce;
+    volatile uint32_t debounce_until;
     pin_cap_t cap;
     pin_mode_t mode;
     const adc_map_t *adc;
@@ -342,6 +480,7 @@ typedef struct {
 gpio_int_type_t map_intr_type (pin_irq_mode_t mode);
 void ioports_init(pin_group_pins_t *aux_inputs, pin_group_pins_t *aux_outputs);
 void ioports_event (input_signal_t *input);
+bool ioports_get_state (uint8_t port);
 void ioports_init_analog (pin_group_pins_t *aux_inputs, pin_group_pins_t *aux_outputs);
 
 #ifdef HAS_BOARD_INIT
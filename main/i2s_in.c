@@ -0,0 +1,217 @@
+/*
+
+  i2s_in.c - driver code for Espressif ESP32 processor
+
+  Input expander, 74HC165 shift register chains sampled by the I2S1 peripheral (input)
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  I2S1 runs as a free running receiver master, BCK clocks the chain and WS drives SH/LD.
+  Each 64 bit frame loads the chain during the left channel (WS low) and shifts it in during the right channel (WS high),
+  only the right channel is stored. The DMA engine fills a ring of I2S_IN_DMABUF_COUNT buffers and interrupts once
+  per buffer, the handler updates the input state from the last sample and reports edges seen in any sample.
+  No CPU time is spent on the inputs between interrupts.
+*/
+
+#include "driver.h"
+
+#if USE_I2S_IN
+
+#include <driver/periph_ctrl.h>
+#include <rom/lldesc.h>
+#include <soc/i2s_struct.h>
+
+#include "i2s_in.h"
+
+#define I2S_IN_SHIFT (32 - I2S_IN_NUM_BITS) // The chain is received MSB first in a 32 bit channel
+
+typedef struct {
+    volatile uint32_t state;    // Input state from the last sample of the last buffer received
+    uint32_t rising;            // Inputs to report rising edges for
+    uint32_t falling;           // Inputs to report falling edges for
+    i2s_in_event_ptr on_event;
+    lldesc_t *desc;
+    uint32_t *buffers;
+} i2s_in_t;
+
+static i2s_in_t i2s_in = {0};
+static intr_handle_t i2s_in_isr_handle;
+
+static void IRAM_ATTR i2s_in_intr_handler (void *arg)
+{
+    typeof(I2S1.int_st) status = I2S1.int_st;
+
+    I2S1.int_clr.val = status.val;
+
+    if(status.in_suc_eof) {
+
+        lldesc_t *desc = (lldesc_t *)I2S1.in_eof_des_addr;
+        uint32_t *sample = (uint32_t *)desc->buf, prev = i2s_in.state, state = prev, rising = 0, falling = 0;
+        uint_fast16_t n = I2S_IN_DMABUF_SAMPLES;
+
+        do {
+            state = *sample++ >> I2S_IN_SHIFT;
+            rising |= state & ~prev;
+            falling |= prev & ~state;
+            prev = state;
+        } while(--n);
+
+        i2s_in.state = state;
+
+        if((rising = (rising & i2s_in.rising) | (falling & i2s_in.falling)) && i2s_in.on_event)
+            i2s_in.on_event(rising);
+    }
+}
+
+IRAM_ATTR uint32_t i2s_in_get_state (void)
+{
+    return i2s_in.state;
+}
+
+IRAM_ATTR uint8_t i2s_in_state (uint8_t pin)
+{
+    return pin < I2S_IN_NUM_BITS ? (uint8_t)((i2s_in.state >> pin) & 0x01) : 0;
+}
+
+// Sets the edges reported for an input, IRQ_Mode_None disables reporting.
+IRAM_ATTR void i2s_in_irq_enable (uint8_t pin, pin_irq_mode_t irq_mode)
+{
+    if(pin < I2S_IN_NUM_BITS) {
+
+        uint32_t bit = 1UL << pin;
+
+        if(irq_mode & IRQ_Mode_Rising)
+            i2s_in.rising |= bit;
+        else
+            i2s_in.rising &= ~bit;
+
+        if(irq_mode & IRQ_Mode_Falling)
+            i2s_in.falling |= bit;
+        else
+            i2s_in.falling &= ~bit;
+    }
+}
+
+bool i2s_in_init (i2s_in_event_ptr on_event)
+{
+    uint_fast8_t idx;
+
+    if(i2s_in.desc)
+        return false;
+
+    i2s_in.buffers = (uint32_t *)heap_caps_calloc(I2S_IN_DMABUF_COUNT * I2S_IN_DMABUF_SAMPLES, sizeof(uint32_t), MALLOC_CAP_DMA);
+    i2s_in.desc = (lldesc_t *)heap_caps_calloc(I2S_IN_DMABUF_COUNT, sizeof(lldesc_t), MALLOC_CAP_DMA);
+
+    if(i2s_in.buffers == NULL || i2s_in.desc == NULL) {
+        heap_caps_free(i2s_in.buffers);
+        heap_caps_free(i2s_in.desc);
+        i2s_in.buffers = NULL;
+        i2s_in.desc = NULL;
+        return false;
+    }
+
+    i2s_in.on_event = on_event;
+
+    // Descriptor ring, the DMA engine loops forever
+    for(idx = 0; idx < I2S_IN_DMABUF_COUNT; idx++) {
+        i2s_in.desc[idx].owner = 1;
+        i2s_in.desc[idx].eof = 1;
+        i2s_in.desc[idx].size = I2S_IN_DMABUF_SAMPLES * sizeof(uint32_t);
+        i2s_in.desc[idx].length = I2S_IN_DMABUF_SAMPLES * sizeof(uint32_t);
+        i2s_in.desc[idx].buf = (uint8_t *)&i2s_in.buffers[idx * I2S_IN_DMABUF_SAMPLES];
+        i2s_in.desc[idx].qe.stqe_next = &i2s_in.desc[(idx + 1) % I2S_IN_DMABUF_COUNT];
+    }
+
+    // Route the I2S signals, BCK and WS are driven by the receiver in master mode
+    PIN_FUNC_SELECT(GPIO_PIN_MUX_REG[I2S_IN_BCK], PIN_FUNC_GPIO);
+    gpio_set_direction(I2S_IN_BCK, GPIO_MODE_OUTPUT);
+    gpio_matrix_out(I2S_IN_BCK, I2S1I_BCK_OUT_IDX, false, false);
+
+    PIN_FUNC_SELECT(GPIO_PIN_MUX_REG[I2S_IN_WS], PIN_FUNC_GPIO);
+    gpio_set_direction(I2S_IN_WS, GPIO_MODE_OUTPUT);
+    gpio_matrix_out(I2S_IN_WS, I2S1I_WS_OUT_IDX, false, false);
+
+    PIN_FUNC_SELECT(GPIO_PIN_MUX_REG[I2S_IN_DATA], PIN_FUNC_GPIO);
+    gpio_set_direction(I2S_IN_DATA, GPIO_MODE_INPUT);
+    gpio_matrix_in(I2S_IN_DATA, I2S1I_DATA_IN15_IDX, false);
+
+    periph_module_reset(PERIPH_I2S1_MODULE);
+    periph_module_enable(PERIPH_I2S1_MODULE);
+
+    I2S1.conf.rx_start = 0;
+    I2S1.in_link.stop = 1;
+    I2S1.int_ena.val = 0;
+    I2S1.int_clr.val = 0xFFFFFFFF;
+
+    // reset receiver, FIFO and DMA
+    I2S1.conf.rx_reset = 1;
+    I2S1.conf.rx_reset = 0;
+    I2S1.conf.rx_fifo_reset = 1;
+    I2S1.conf.rx_fifo_reset = 0;
+    I2S1.lc_conf.in_rst = 1;
+    I2S1.lc_conf.in_rst = 0;
+
+    I2S1.lc_conf.check_owner = 0;
+    I2S1.lc_conf.indscr_burst_en = 0;
+    I2S1.conf2.lcd_en = 0;
+    I2S1.conf2.camera_en = 0;
+    I2S1.pdm_conf.rx_pdm_en = 0;
+    I2S1.pdm_conf.pdm2pcm_conv_en = 0;
+
+    I2S1.conf.rx_slave_mod = 0;         // Master, BCK and WS are outputs
+    I2S1.conf.rx_mono = 0;
+    I2S1.conf.rx_msb_right = 0;
+    I2S1.conf.rx_right_first = 0;
+    I2S1.conf.rx_short_sync = 0;
+    I2S1.conf.rx_msb_shift = 0;         // No Philips delay, bit 31 is the first bit after WS (SH/LD) goes high
+
+    I2S1.fifo_conf.rx_fifo_mod = 3;     // 32-bit single channel data
+    I2S1.fifo_conf.rx_fifo_mod_force_en = 1;
+    I2S1.conf_chan.rx_chan_mod = 1;     // 1: right channel only, WS high when the chain is shifted
+    I2S1.sample_rate_conf.rx_bits_mod = 32;
+
+    // fi2s = 160 MHz / I2S_IN_CLKM_DIV, fbck = fi2s / 4
+    I2S1.clkm_conf.clka_en = 0;         // Use 160 MHz PLL_D2_CLK as reference
+    I2S1.clkm_conf.clkm_div_num = I2S_IN_CLKM_DIV;
+    I2S1.clkm_conf.clkm_div_b = 0;
+    I2S1.clkm_conf.clkm_div_a = 1;
+    I2S1.sample_rate_conf.rx_bck_div_num = 4;
+
+    I2S1.rx_eof_num = I2S_IN_DMABUF_SAMPLES; // Words per buffer, one sample each
+    I2S1.in_link.addr = (uint32_t)&i2s_in.desc[0];
+    I2S1.fifo_conf.dscr_en = 1;
+
+    if(esp_intr_alloc(ETS_I2S1_INTR_SOURCE, ESP_INTR_FLAG_IRAM, i2s_in_intr_handler, NULL, &i2s_in_isr_handle) != ESP_OK) {
+        periph_module_disable(PERIPH_I2S1_MODULE);
+        return false;
+    }
+
+    I2S1.int_ena.in_suc_eof = 1;        // Triggered when a buffer is filled
+    I2S1.in_link.start = 1;
+    I2S1.conf.rx_start = 1;
+
+    // Wait for the first buffer so the initial state is valid
+    hal.delay_ms((I2S_IN_DMABUF_SAMPLES * 64) / I2S_IN_BCK_KHZ + 2, NULL);
+
+    return true;
+}
+
+#endif // USE_I2S_IN
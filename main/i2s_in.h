@@ -0,0 +1,93 @@
+/*
+
+  i2s_in.h - driver code for Espressif ESP32 processor
+
+  Input expander, 74HC165 shift register chains sampled by the I2S1 peripheral (input)
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _I2S_IN_H_
+#define _I2S_IN_H_
+
+#include "driver.h"
+
+#if USE_I2S_IN
+
+/*
+  Board map:
+
+  #define USE_I2S_IN
+  #define I2S_IN_BCK      GPIO_NUM_xx  // 74HC165 CLK (pin 2), all chips
+  #define I2S_IN_WS       GPIO_NUM_xx  // 74HC165 SH/LD (pin 1), all chips
+  #define I2S_IN_DATA     GPIO_NUM_xx  // 74HC165 QH (pin 9) of the first chip, QH of the next chip to SER (pin 10) of the previous
+  #define I2S_IN_NUM_BITS 16           // 8, 16, 24 or 32, number of chips x 8
+
+  #define X_LIMIT_PIN     I2SI(0)      // Input A of the last chip in the chain
+  #define Y_LIMIT_PIN     I2SI(1)
+  ...
+
+  The chain is parallel loaded while WS is low and shifted out MSB first while WS is high, one frame per sample.
+  Inputs are numbered from the A input of the last chip in the chain, I2SI(7) is the H input of the last chip,
+  I2SI(8) the A input of the next to last chip and so on.
+  The sample rate is I2S_IN_BCK_KHZ / 64, edges are reported once per DMA buffer of I2S_IN_DMABUF_SAMPLES samples.
+  Pulses shorter than a sample may be lost, shorter than a buffer are reported as an edge but not in the state.
+  NOTE: pull-up/pull-down settings do not apply to expanded inputs, the board has to provide them.
+*/
+
+#ifndef I2S_IN_NUM_BITS
+#define I2S_IN_NUM_BITS 32
+#endif
+
+#if I2S_IN_NUM_BITS != 8 && I2S_IN_NUM_BITS != 16 && I2S_IN_NUM_BITS != 24 && I2S_IN_NUM_BITS != 32
+#error "I2S_IN_NUM_BITS should be 8, 16, 24 or 32"
+#endif
+
+#ifndef I2S_IN_BCK_KHZ
+#define I2S_IN_BCK_KHZ 2000         // 31.25 kHz sample rate
+#endif
+
+#ifndef I2S_IN_DMABUF_SAMPLES
+#define I2S_IN_DMABUF_SAMPLES 32    // Samples per DMA buffer, ~1 ms @ 2 MHz BCK
+#endif
+
+#ifndef I2S_IN_DMABUF_COUNT
+#define I2S_IN_DMABUF_COUNT 2
+#endif
+
+// fi2s = 160 MHz / I2S_IN_CLKM_DIV, fbck = fi2s / 4
+#define I2S_IN_CLKM_DIV (160000 / (I2S_IN_BCK_KHZ * 4))
+
+#if I2S_IN_CLKM_DIV < 2 || I2S_IN_CLKM_DIV > 255 || I2S_IN_CLKM_DIV * I2S_IN_BCK_KHZ * 4 != 160000
+#error "I2S_IN_BCK_KHZ must be 40000 kHz divided by an integer in the range 2 - 255!"
+#endif
+
+#define I2SI(n) (I2S_IN_PIN_BASE + n)
+
+// Called from the DMA interrupt handler with the inputs that have changed according to their irq mode.
+typedef void (*i2s_in_event_ptr)(uint32_t events);
+
+bool i2s_in_init (i2s_in_event_ptr on_event);
+uint32_t i2s_in_get_state (void);
+uint8_t i2s_in_state (uint8_t pin);
+void i2s_in_irq_enable (uint8_t pin, pin_irq_mode_t irq_mode);
+
+#endif // USE_I2S_IN
+
+#endif // _I2S_IN_H_
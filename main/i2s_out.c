@@ -54,6 +54,7 @@
 #include <freertos/queue.h>
 
 #include <stdatomic.h>
+#include <string.h>
 
 #include "i2s_out.h"
 
@@ -71,27 +72,62 @@
 // Increasing I2S_OUT_DMABUF_COUNT has the effect of preventing buffer underflow,
 // but on the other hand, it leads to a delay with pulse and/or non-pulse-generated I/Os.
 // The number of I2S_OUT_DMABUF_COUNT should be chosen carefully.
+// The number of samples filled per buffer while stepping can be lowered at run time by i2s_out_set_depth(),
+// the delay is then (I2S_OUT_DMABUF_COUNT + 1) x the shorter buffer time.
 //
 // Reference information:
 //   FreeRTOS task time slice = portTICK_PERIOD_MS = 1 ms (ESP32 FreeRTOS port)
 //
-#define I2S_SAMPLE_SIZE 4                                       /* 4 bytes, 32 bits per sample */
+#define I2S_SAMPLE_SIZE I2S_OUT_SAMPLE_SIZE                     /* 4 bytes, 8 bytes in 64-bit mode */
 #define DMA_SAMPLE_COUNT (I2S_OUT_DMABUF_LEN / I2S_SAMPLE_SIZE) /* number of samples per buffer */
-#define SAMPLE_SAFE_COUNT (20 / I2S_OUT_USEC_PER_PULSE)         /* prevent buffer overrun (GRBL's $0 should be less than or equal 20) */
+
+// DMA complete event, sent from the interrupt handler to the bitstream generator task
+typedef struct {
+    lldesc_t *desc;
+    uint32_t ring_gen;          // o_dma.ring_gen when the event was sent
+#if I2S_OUT_STATS_ENABLE
+    uint32_t eof_time;          // CPU cycle count at DMA EOF
+#endif
+} i2s_out_dma_event_t;
 
 typedef struct {
     uint32_t**   buffers;
-    uint32_t*    current;
-    uint32_t     rw_pos;
     lldesc_t**   desc;
-    xQueueHandle queue;
+    xQueueHandle queue;         // of i2s_out_dma_event_t
+    TaskHandle_t task;          // bitstream generator task
+    volatile uint32_t samples;  // Number of samples to fill per buffer when stepping, see i2s_out_set_depth()
+    volatile uint32_t ring_gen; // Incremented when the descriptor ring is rebuilt, under the pulser lock
 } i2s_out_dma_t;
 
-static i2s_out_dma_t o_dma;
+static i2s_out_dma_t o_dma = {
+    .samples = DMA_SAMPLE_COUNT
+};
 static intr_handle_t i2s_out_isr_handle;
 
+#if I2S_OUT_NUM_BITS == 64
+/*
+  64-bit mode: the shift register chain is latched by WS mid frame, bits 32 - 63 are then from the previous frame.
+  Streaming: bits 0 - 31 are written one sample later so that both words of a sample are latched together.
+  Passthrough: both words are output from a short descriptor looping on itself so that they take the same path,
+  a write reaches the outputs after the TX FIFO has drained, within I2S_OUT_PASS_DELAY_SAMPLES.
+*/
+#define I2S_OUT_PASS_SAMPLES 4
+#define I2S_OUT_FIFO_SAMPLES 32     // TX FIFO, 64 words
+#define I2S_OUT_PASS_DELAY_SAMPLES (I2S_OUT_FIFO_SAMPLES + I2S_OUT_PASS_SAMPLES + 1)
+
+static DRAM_ATTR lldesc_t pass_desc;
+static DRAM_ATTR uint32_t pass_buf[I2S_OUT_PASS_SAMPLES * I2S_STREAM_WORDS];
+static uint32_t lo_carry;           // bits 0 - 31 of the last sample streamed
+#endif
+
+#if I2S_OUT_STATS_ENABLE
+static i2s_out_stats_t i2s_out_stats = {
+    .ahead_min = I2S_OUT_DMABUF_COUNT
+};
+#endif
+
 // output value
-static atomic_uint_least32_t i2s_out_port_data = ATOMIC_VAR_INIT(0);
+static atomic_uint_least32_t i2s_out_port_data[I2S_STREAM_WORDS];
 
 // inner lock
 static portMUX_TYPE i2s_out_spinlock = portMUX_INITIALIZER_UNLOCKED;
@@ -116,16 +152,14 @@ static portMUX_TYPE i2s_out_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static int i2s_out_initialized = 0;
 
-static volatile uint32_t             i2s_out_pulse_period;
-static uint32_t                      i2s_out_remain_time_until_next_pulse;  // Time remaining until the next pulse (usec)
-static volatile i2s_out_pulse_func_t i2s_out_pulse_func;
 static gpio_num_t i2s_out_ws_pin   = 255;
 static gpio_num_t i2s_out_bck_pin  = 255;
 static gpio_num_t i2s_out_data_pin = 255;
 
-static volatile i2s_out_pulser_status_t i2s_out_pulser_status = PASSTHROUGH;
+// Pulser status, changed with atomic compare and swap. Readers do not take a lock.
+static _Atomic i2s_out_pulser_status_t i2s_out_pulser_status = PASSTHROUGH;
 
-// outer lock
+// outer lock, serializes stopping, rewiring and restarting the DMA descriptor ring
 static portMUX_TYPE i2s_out_pulser_spinlock = portMUX_INITIALIZER_UNLOCKED;
 #define I2S_OUT_PULSER_ENTER_CRITICAL()                         \
     do {                                                        \
@@ -143,8 +177,18 @@ static portMUX_TYPE i2s_out_pulser_spinlock = portMUX_INITIALIZER_UNLOCKED;
             portEXIT_CRITICAL(&i2s_out_pulser_spinlock);        \
         }                                                       \
     } while (0)
-#define I2S_OUT_PULSER_ENTER_CRITICAL_ISR() portENTER_CRITICAL_ISR(&i2s_out_pulser_spinlock)
-#define I2S_OUT_PULSER_EXIT_CRITICAL_ISR() portEXIT_CRITICAL_ISR(&i2s_out_pulser_spinlock)
+
+// bitstream generator
+static i2s_stream_t stream = {
+    .pulser_status = &i2s_out_pulser_status,
+    .port_data = i2s_out_port_data
+};
+
+// Atomically change the pulser status from expected to desired, returns false if the status was not expected.
+static inline bool i2s_out_pulser_transition (i2s_out_pulser_status_t expected, i2s_out_pulser_status_t desired)
+{
+    return atomic_compare_exchange_strong(&i2s_out_pulser_status, &expected, desired);
+}
 
 //
 // Internal functions
@@ -159,14 +203,43 @@ static inline void gpio_matrix_out_check (uint8_t gpio, uint32_t signal_idx, boo
     }
 }
 
+#if I2S_OUT_NUM_BITS == 64
+
+// Delays bits 0 - 31 of n samples by one sample, the last one is carried over to the next buffer.
+static inline void IRAM_ATTR i2s_out_align_words (uint32_t *buf, uint32_t n)
+{
+    uint32_t lo;
+
+    buf += I2S_STREAM_LO_WORD;
+    while (n--) {
+        lo = *buf;
+        *buf = lo_carry;
+        lo_carry = lo;
+        buf += I2S_STREAM_WORDS;
+    }
+}
+
+static inline void IRAM_ATTR i2s_out_pass_data (i2s_out_data_t port_data)
+{
+    uint32_t *buf = pass_buf;
+
+    for (int i = 0; i < I2S_OUT_PASS_SAMPLES; i++) {
+        buf = i2s_stream_put(buf, port_data);
+    }
+}
+
+#endif
+
 static inline void i2s_out_single_data (void)
 {
 #if I2S_OUT_NUM_BITS == 16
-    uint32_t port_data = atomic_load(&i2s_out_port_data);
+    uint32_t port_data = atomic_load(&i2s_out_port_data[0]);
     port_data <<= 16;                   // Shift needed. This specification is not spelled out in the manual.
     I2S0.conf_single_data = port_data;  // Apply port data in real-time (static I2S)
+#elif I2S_OUT_NUM_BITS == 64
+    i2s_out_pass_data(i2s_stream_port_data(&stream));
 #else
-    I2S0.conf_single_data = atomic_load(&i2s_out_port_data);  // Apply port data in real-time (static I2S)
+    I2S0.conf_single_data = atomic_load(&i2s_out_port_data[0]);  // Apply port data in real-time (static I2S)
 #endif
 }
 
@@ -185,25 +258,30 @@ static void IRAM_ATTR i2s_out_reset_fifo (void)
     I2S_OUT_EXIT_CRITICAL();
 }
 
-static void IRAM_ATTR i2s_clear_dma_buffer (lldesc_t *dma_desc, uint32_t port_data)
+static void IRAM_ATTR i2s_clear_dma_buffer (lldesc_t *dma_desc, i2s_out_data_t port_data)
 {
     uint32_t *buf = (uint32_t *)dma_desc->buf;
     for (int i = 0; i < DMA_SAMPLE_COUNT; i++) {
-        buf[i] = port_data;
+        buf = i2s_stream_put(buf, port_data);
     }
+#if I2S_OUT_NUM_BITS == 64
+    lo_carry = (uint32_t)port_data;
+#endif
     // Restore the buffer length.
     // The length may have been changed short when the data was filled in to prevent buffer overrun.
-    dma_desc->length = I2S_OUT_DMABUF_LEN;
+    dma_desc->length = o_dma.samples * I2S_SAMPLE_SIZE;
 }
 
-static void IRAM_ATTR i2s_clear_o_dma_buffers (uint32_t port_data)
+static void IRAM_ATTR i2s_clear_o_dma_buffers (i2s_out_data_t port_data)
 {
+    o_dma.ring_gen++;  // Descriptors of pending DMA complete events are no longer to be written by the task
+
     for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++) {
         // Initialize DMA descriptor
         o_dma.desc[buf_idx]->owner        = 1;
         o_dma.desc[buf_idx]->eof          = 1;  // set to 1 will trigger the interrupt
         o_dma.desc[buf_idx]->sosf         = 0;
-        o_dma.desc[buf_idx]->length       = I2S_OUT_DMABUF_LEN;
+        o_dma.desc[buf_idx]->length       = o_dma.samples * I2S_SAMPLE_SIZE;
         o_dma.desc[buf_idx]->size         = I2S_OUT_DMABUF_LEN;
         o_dma.desc[buf_idx]->buf          = (uint8_t*)o_dma.buffers[buf_idx];
         o_dma.desc[buf_idx]->offset       = 0;
@@ -230,11 +308,11 @@ static void IRAM_ATTR i2s_out_gpio_detach (uint8_t ws, uint8_t bck, uint8_t data
     gpio_matrix_out_check(data, I2S_OUT_DETACH_PORT_IDX, 0, 0);
 }
 
-static void IRAM_ATTR i2s_out_gpio_shiftout (uint32_t port_data)
+static void IRAM_ATTR i2s_out_gpio_shiftout (i2s_out_data_t port_data)
 {
     gpio_set_level(i2s_out_ws_pin, 0);
     for (int i = 0; i < I2S_OUT_NUM_BITS; i++) {
-        gpio_set_level(i2s_out_data_pin, !!(port_data & bit(((I2S_OUT_NUM_BITS - 1) - i))));
+        gpio_set_level(i2s_out_data_pin, (uint32_t)(port_data >> ((I2S_OUT_NUM_BITS - 1) - i)) & 0x01);
         gpio_set_level(i2s_out_bck_pin, 1);
         gpio_set_level(i2s_out_bck_pin, 0);
     }
@@ -267,7 +345,7 @@ static void IRAM_ATTR i2s_out_stop (void)
     gpio_set_level(i2s_out_bck_pin, 0);
 
     // Transmit recovery data to 74HC595
-    uint32_t port_data = atomic_load(&i2s_out_port_data);  // current expanded port value
+    i2s_out_data_t port_data = i2s_stream_port_data(&stream);  // current expanded port value
     i2s_out_gpio_shiftout(port_data);
 
     //clear pending interrupt
@@ -284,7 +362,7 @@ static bool IRAM_ATTR i2s_out_start (void)
 
     I2S_OUT_ENTER_CRITICAL();
     // Transmit recovery data to 74HC595
-    uint32_t port_data = atomic_load(&i2s_out_port_data);  // current expanded port value
+    i2s_out_data_t port_data = i2s_stream_port_data(&stream);  // current expanded port value
     i2s_out_gpio_shiftout(port_data);
 
     // Attach I2S to specified GPIO pin
@@ -293,10 +371,22 @@ static bool IRAM_ATTR i2s_out_start (void)
     i2s_out_reset_fifo_without_lock();
 
     if (i2s_out_pulser_status == PASSTHROUGH) {
+#if I2S_OUT_NUM_BITS == 64
+        I2S0.fifo_conf.tx_fifo_mod = 2;  // 2: 32-bit dual channel data
+        I2S0.conf_chan.tx_chan_mod = 0;  // 0: dual channel, both words from the looping passthrough descriptor
+        I2S0.conf_single_data      = 0;
+        i2s_out_pass_data(port_data);
+#else
         I2S0.conf_chan.tx_chan_mod = 3;  // 3:right+constant 4:left+constant (when tx_msb_right = 1)
-        I2S0.conf_single_data      = port_data;
+        I2S0.conf_single_data      = (uint32_t)port_data;
+#endif
     } else {
+#if I2S_OUT_NUM_BITS == 64
+        I2S0.fifo_conf.tx_fifo_mod = 2;  // 2: 32-bit dual channel data
+        I2S0.conf_chan.tx_chan_mod = 0;  // 0: dual channel, both words from the DMA buffers
+#else
         I2S0.conf_chan.tx_chan_mod = 4;  // 3:right+constant 4:left+constant (when tx_msb_right = 1)
+#endif
         I2S0.conf_single_data      = 0;
     }
 
@@ -306,7 +396,11 @@ static bool IRAM_ATTR i2s_out_start (void)
     I2S0.lc_conf.out_rst = 1;
     I2S0.lc_conf.out_rst = 0;
 
+#if I2S_OUT_NUM_BITS == 64
+    I2S0.out_link.addr = (uint32_t)(i2s_out_pulser_status == PASSTHROUGH ? &pass_desc : o_dma.desc[0]);
+#else
     I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
+#endif
 
     I2S0.conf.tx_reset = 1;
     I2S0.conf.tx_reset = 0;
@@ -331,78 +425,32 @@ static bool IRAM_ATTR i2s_out_start (void)
     return true;
 }
 
-static void IRAM_ATTR i2s_fillout_dma_buffer (lldesc_t *dma_desc)
+// The buffer is filled without locking, the descriptor is only updated under the pulser lock
+// and if the ring has not been rebuilt by i2s_out_reset() or a mode change meanwhile.
+static void IRAM_ATTR i2s_fillout_dma_buffer (lldesc_t *dma_desc, uint32_t ring_gen)
 {
-    uint32_t *buf = (uint32_t *)dma_desc->buf;
-    o_dma.rw_pos  = 0;
     // It reuses the oldest (just transferred) buffer with the name "current"
-    // and fills the buffer for later DMA.
-    I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock pulser status
-    if (i2s_out_pulser_status == STEPPING) {
-        //
-        // Fillout the buffer for pulse
-        //
-        // To avoid buffer overflow, all of the maximum pulse width (normally about 10us)
-        // is adjusted to be in a single buffer.
-        // DMA_SAMPLE_SAFE_COUNT is referred to as the margin value.
-        // Therefore, if a buffer is close to full and it is time to generate a pulse,
-        // the generation of the buffer is interrupted (the buffer length is shortened slightly)
-        // and the pulse generation is postponed until the next buffer is filled.
-        //
-        o_dma.rw_pos = 0;
-        while (o_dma.rw_pos < (DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT)) {
-            // no data to read (buffer empty)
-            if (i2s_out_remain_time_until_next_pulse < I2S_OUT_USEC_PER_PULSE) {
-                // pulser status may change in pulse phase func, so I need to check it every time.
-                if (i2s_out_pulser_status == STEPPING) {
-                    // fillout future DMA buffer (tail of the DMA buffer chains)
-                    if (i2s_out_pulse_func != NULL) {
-                        uint32_t old_rw_pos = o_dma.rw_pos;
-                        I2S_OUT_PULSER_EXIT_CRITICAL();   // Temporarily unlocked status lock as it may be locked in pulse callback.
-                        i2s_out_pulse_func();             // should be pushed into buffer max DMA_SAMPLE_SAFE_COUNT
-                        I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock again.
-                        // Calculate pulse period.
-                        i2s_out_remain_time_until_next_pulse += i2s_out_pulse_period - I2S_OUT_USEC_PER_PULSE * (o_dma.rw_pos - old_rw_pos);
-                        if (i2s_out_pulser_status == WAITING) {
-                            // i2s_out_set_passthrough() has called from the pulse function.
-                            // It needs to go into pass-through mode.
-                            // This DMA descriptor must be a tail of the chain.
-                            dma_desc->qe.stqe_next = NULL;  // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
-                        } else if (i2s_out_pulser_status == PASSTHROUGH) {
-                            // i2s_out_reset() has called during the execution of the pulse function.
-                            // I2S has already in static mode, and buffers has cleared to zero.
-                            // To prevent the pulse function from being called back,
-                            // we assume that the buffer is already full.
-                            i2s_out_remain_time_until_next_pulse = 0;                 // There is no need to fill the current buffer.
-                            o_dma.rw_pos                         = DMA_SAMPLE_COUNT;  // The buffer is full.
-                            break;
-                        }
-                        continue;
-                    }
-                }
-            }
-            // no pulse data in push buffer (pulse off or idle or callback is not defined)
-            buf[o_dma.rw_pos++] = atomic_load(&i2s_out_port_data);
-            if (i2s_out_remain_time_until_next_pulse >= I2S_OUT_USEC_PER_PULSE) {
-                i2s_out_remain_time_until_next_pulse -= I2S_OUT_USEC_PER_PULSE;
-            } else {
-                i2s_out_remain_time_until_next_pulse = 0;
-            }
+    // and fills the buffer for later DMA, see i2s_stream_fill().
+    i2s_out_pulser_status_t status = i2s_stream_fill(&stream, (uint32_t *)dma_desc->buf, o_dma.samples);
+
+    I2S_OUT_PULSER_ENTER_CRITICAL();
+    if (ring_gen != o_dma.ring_gen) {
+        // The descriptor is part of a rebuilt ring, replace the stale step samples.
+        i2s_clear_dma_buffer(dma_desc, i2s_out_pulser_status == STEPPING ? i2s_stream_port_data(&stream) : 0);
+    } else {
+#if I2S_OUT_NUM_BITS == 64
+        i2s_out_align_words((uint32_t *)dma_desc->buf, stream.rw_pos);
+#endif
+        if (status == WAITING) {
+            // i2s_out_set_passthrough() has called from the pulse function.
+            // It needs to go into pass-through mode.
+            // This DMA descriptor must be a tail of the chain.
+            dma_desc->qe.stqe_next = NULL;  // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
         }
         // set filled length to the DMA descriptor
-        dma_desc->length = o_dma.rw_pos * I2S_SAMPLE_SIZE;
-    } else if (i2s_out_pulser_status == WAITING) {
-        i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-        o_dma.rw_pos           = 0;         // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
-        dma_desc->qe.stqe_next = NULL;      // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
-    } else {
-        // Stepper paused (passthrough state, static I2S control mode)
-        // In the passthrough mode, there is no need to fill the buffer with port_data.
-        i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-        o_dma.rw_pos                         = 0;  // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
-        i2s_out_remain_time_until_next_pulse = 0;
+        dma_desc->length = stream.rw_pos * I2S_SAMPLE_SIZE;
     }
-    I2S_OUT_PULSER_EXIT_CRITICAL();  // Unlock pulser status
+    I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
 //
@@ -410,7 +458,7 @@ static void IRAM_ATTR i2s_fillout_dma_buffer (lldesc_t *dma_desc)
 //
 static void IRAM_ATTR i2s_out_intr_handler (void *arg)
 {
-    lldesc_t *finish_desc;
+    i2s_out_dma_event_t finish;
     portBASE_TYPE high_priority_task_awoken = pdFALSE;
 
     if (I2S0.int_st.out_eof || I2S0.int_st.out_total_eof) {
@@ -426,28 +474,36 @@ static void IRAM_ATTR i2s_out_intr_handler (void *arg)
             I2S_OUT_EXIT_CRITICAL_ISR();
         }
         // Get the descriptor of the last item in the linkedlist
-        finish_desc = (lldesc_t*)I2S0.out_eof_des_addr;
+        finish.desc = (lldesc_t*)I2S0.out_eof_des_addr;
+        finish.ring_gen = o_dma.ring_gen;
+#if I2S_OUT_STATS_ENABLE
+        finish.eof_time = XTHAL_GET_CCOUNT();
+#endif
 
         // If the queue is full it's because we have an underflow,
         // more than buf_count isr without new data, remove the front buffer
         if (xQueueIsQueueFullFromISR(o_dma.queue)) {
-            lldesc_t* front_desc;
+            i2s_out_dma_event_t front;
             // Remove a descriptor from the DMA complete event queue
-            xQueueReceiveFromISR(o_dma.queue, &front_desc, &high_priority_task_awoken);
-            I2S_OUT_PULSER_ENTER_CRITICAL_ISR();
-            uint32_t port_data = 0;
+            xQueueReceiveFromISR(o_dma.queue, &front, &high_priority_task_awoken);
+            i2s_out_data_t port_data = 0;
+            uint32_t *buf = (uint32_t *)front.desc->buf;
             if (i2s_out_pulser_status == STEPPING) {
-                port_data = atomic_load(&i2s_out_port_data);
+                port_data = i2s_stream_port_data(&stream);
+                // Underrun guard, deepen the buffers until the next i2s_out_set_depth() call.
+                o_dma.samples = o_dma.samples < DMA_SAMPLE_COUNT / 2 ? o_dma.samples * 2 : DMA_SAMPLE_COUNT;
+#if I2S_OUT_STATS_ENABLE
+                i2s_out_stats.underruns++;  // The step stream is now late by one buffer
+#endif
             }
-            I2S_OUT_PULSER_EXIT_CRITICAL_ISR();
-            for (int i = 0; i < DMA_SAMPLE_COUNT; i++) {
-                ((uint32_t *)front_desc->buf)[i] = port_data;
+            for (int i = 0; i < o_dma.samples; i++) {
+                buf = i2s_stream_put(buf, port_data);
             }
-            front_desc->length = I2S_OUT_DMABUF_LEN;
+            front.desc->length = o_dma.samples * I2S_SAMPLE_SIZE;
         }
 
         // Send a DMA complete event to the I2S bitstreamer task with finished buffer
-        xQueueSendFromISR(o_dma.queue, &finish_desc, &high_priority_task_awoken);
+        xQueueSendFromISR(o_dma.queue, &finish, &high_priority_task_awoken);
     }
 
     if (high_priority_task_awoken == pdTRUE)
@@ -462,16 +518,20 @@ static void IRAM_ATTR i2s_out_intr_handler (void *arg)
 //
 static void IRAM_ATTR i2sOutTask (void* parameter)
 {
+    i2s_out_dma_event_t event;
     lldesc_t *dma_desc;
 
     while (1) {
         // Wait a DMA complete event from I2S isr
         // (Block until a DMA transfer has complete)
-        xQueueReceive(o_dma.queue, &dma_desc, portMAX_DELAY);
-        o_dma.current = (uint32_t*)(dma_desc->buf);
+        xQueueReceive(o_dma.queue, &event, portMAX_DELAY);
+        dma_desc = event.desc;
+        if (event.ring_gen != o_dma.ring_gen) {
+            continue;  // The ring has been rebuilt since the event was sent
+        }
+        stream.buf = (uint32_t*)(dma_desc->buf);
         // It reuses the oldest (just transferred) buffer with the name "current"
         // and fills the buffer for later DMA.
-        I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock pulser status
         if (i2s_out_pulser_status == STEPPING) {
             //
             // Fillout the buffer for pulse
@@ -483,60 +543,113 @@ static void IRAM_ATTR i2sOutTask (void* parameter)
             // the generation of the buffer is interrupted (the buffer length is shortened slightly)
             // and the pulse generation is postponed until the next buffer is filled.
             //
-            i2s_fillout_dma_buffer(dma_desc);
-            dma_desc->length = o_dma.rw_pos * I2S_SAMPLE_SIZE;
+#if I2S_OUT_STATS_ENABLE
+            uint32_t fill_start = XTHAL_GET_CCOUNT();
+#endif
+            i2s_fillout_dma_buffer(dma_desc, event.ring_gen);
+#if I2S_OUT_STATS_ENABLE
+            i2s_out_stats_fill(&i2s_out_stats, event.eof_time, fill_start, uxQueueMessagesWaiting(o_dma.queue));
+#endif
         } else if (i2s_out_pulser_status == WAITING) {
             if (dma_desc->qe.stqe_next == NULL) {
                 // Tail of the DMA descriptor found
                 // I2S TX module has already stopped by ISR
-                i2s_out_stop();
-                i2s_clear_o_dma_buffers(0);  // 0 for static I2S control mode (right ch. data is always 0)
+                I2S_OUT_PULSER_ENTER_CRITICAL();
                 // You need to set the status before calling i2s_out_start()
                 // because the process in i2s_out_start() is different depending on the status.
-                i2s_out_pulser_status = PASSTHROUGH;
-                i2s_out_start();
+                if (event.ring_gen == o_dma.ring_gen && i2s_out_pulser_transition(WAITING, PASSTHROUGH)) {  // i2s_out_reset() may have got here first
+                    i2s_out_stop();
+                    i2s_clear_o_dma_buffers(0);  // 0 for static I2S control mode
+                    i2s_out_start();
+                }
+                I2S_OUT_PULSER_EXIT_CRITICAL();
             } else {
                 // Processing a buffer slightly ahead of the tail buffer.
                 // We don't need to fill up the buffer by port_data any more.
-                i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-                o_dma.rw_pos           = 0;         // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
-                dma_desc->qe.stqe_next = NULL;      // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
+                I2S_OUT_PULSER_ENTER_CRITICAL();
+                if (event.ring_gen == o_dma.ring_gen) {
+                    i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
+                    stream.rw_pos          = 0;         // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
+                    dma_desc->qe.stqe_next = NULL;      // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
+                }
+                I2S_OUT_PULSER_EXIT_CRITICAL();
             }
         } else {
             // Stepper paused (passthrough state, static I2S control mode)
             // In the passthrough mode, there is no need to fill the buffer with port_data.
-            i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-            o_dma.rw_pos = 0;                   // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
+            I2S_OUT_PULSER_ENTER_CRITICAL();
+            if (event.ring_gen == o_dma.ring_gen) {
+                i2s_clear_dma_buffer(dma_desc, 0);
+                stream.rw_pos = 0;              // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
+            }
+            I2S_OUT_PULSER_EXIT_CRITICAL();
         }
-        I2S_OUT_PULSER_EXIT_CRITICAL();  // Unlock pulser status
     }
 }
 
+// Output committed to the DMA ring, the sum of the descriptor lengths.
+static uint32_t IRAM_ATTR i2s_out_committed_us (void)
+{
+    uint32_t length = 0;
+
+    for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++)
+        length += o_dma.desc[buf_idx]->length;
+
+    return length / I2S_SAMPLE_SIZE * I2S_OUT_USEC_PER_PULSE;
+}
+
 //
 // External funtions
 //
+#if I2S_OUT_STATS_ENABLE
+
+void i2s_out_get_stats (i2s_out_stats_t *stats, bool reset)
+{
+    I2S_OUT_ENTER_CRITICAL();
+
+    memcpy(stats, &i2s_out_stats, sizeof(i2s_out_stats_t));
+
+    if (reset) {
+        memset(&i2s_out_stats, 0, sizeof(i2s_out_stats_t));
+        i2s_out_stats.ahead_min = I2S_OUT_DMABUF_COUNT;
+    }
+
+    I2S_OUT_EXIT_CRITICAL();
+}
+
+#endif
+
+// Time for a passthrough mode write to reach all outputs.
+// In 64-bit mode both words are taken from the looping passthrough descriptor, behind the TX FIFO.
+static inline uint32_t IRAM_ATTR i2s_out_passthrough_us (void)
+{
+#if I2S_OUT_NUM_BITS == 64
+    return I2S_OUT_PASS_DELAY_SAMPLES * I2S_OUT_USEC_PER_PULSE;
+#else
+    return I2S_OUT_USEC_PER_PULSE * 2;
+#endif
+}
+
 void IRAM_ATTR i2s_out_delay (void)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
     if (i2s_out_pulser_status == PASSTHROUGH) {
         // Depending on the timing, it may not be reflected immediately,
         // so wait twice as long just in case.
-        ets_delay_us(I2S_OUT_USEC_PER_PULSE * 2);
+        ets_delay_us(i2s_out_passthrough_us());
     } else {
         // Just wait until the data now registered in the DMA descripter
         // is reflected in the I2S TX module via FIFO.
-        delay(I2S_OUT_DELAY_MS);
+        delay(i2s_out_committed_us() / 1000 + 1);
     }
-    I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
 void IRAM_ATTR i2s_out_write (uint8_t pin, uint8_t val)
 {
-    uint32_t bit = bit(pin);
+    uint32_t bit = bit(pin & 0x1F);
     if (val) {
-        atomic_fetch_or(&i2s_out_port_data, bit);
+        atomic_fetch_or(&i2s_out_port_data[pin >> 5], bit);
     } else {
-        atomic_fetch_and(&i2s_out_port_data, ~bit);
+        atomic_fetch_and(&i2s_out_port_data[pin >> 5], ~bit);
     }
     // It needs a lock for access, but I've given up because I need speed.
     // This is not a problem as long as there is no overlap between the status change and digitalWrite().
@@ -545,109 +658,132 @@ void IRAM_ATTR i2s_out_write (uint8_t pin, uint8_t val)
     }
 }
 
+void IRAM_ATTR i2s_out_write_mask (i2s_out_data_t set, i2s_out_data_t clear)
+{
+    for (int i = 0; i < I2S_STREAM_WORDS; i++) {
+        if ((uint32_t)clear) {
+            atomic_fetch_and(&i2s_out_port_data[i], ~(uint32_t)clear);
+        }
+        if ((uint32_t)set) {
+            atomic_fetch_or(&i2s_out_port_data[i], (uint32_t)set);
+        }
+#if I2S_STREAM_WORDS == 2
+        set >>= 32;
+        clear >>= 32;
+#endif
+    }
+    if (i2s_out_pulser_status == PASSTHROUGH) {
+        i2s_out_single_data();
+    }
+}
+
 bool IRAM_ATTR i2s_out_state (uint8_t pin)
 {
-    uint32_t port_data = atomic_load(&i2s_out_port_data);
+    uint32_t port_data = atomic_load(&i2s_out_port_data[pin >> 5]);
 
-    return (!!(port_data & bit(pin)));
+    return (!!(port_data & bit(pin & 0x1F)));
 }
 
 uint32_t IRAM_ATTR i2s_out_push_sample (uint32_t num)
 {
-    if (num > SAMPLE_SAFE_COUNT) {
-        return 0;
-    }
-    // push at least one sample (even if num is zero)
-    uint32_t port_data = atomic_load(&i2s_out_port_data);
-    uint32_t n         = 0;
-    do {
-        o_dma.current[o_dma.rw_pos++] = port_data;
-        n++;
-    } while (n < num);
+    return i2s_stream_push(&stream, num);
+}
 
-    return n;
+uint32_t IRAM_ATTR i2s_out_push_pulse (i2s_out_data_t mask, i2s_out_data_t level, uint32_t num)
+{
+    return i2s_stream_push_pulse(&stream, mask, level, num);
 }
 
 i2s_out_pulser_status_t IRAM_ATTR i2s_out_get_pulser_status (void)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
-    i2s_out_pulser_status_t s = i2s_out_pulser_status;
-    I2S_OUT_PULSER_EXIT_CRITICAL();
-
-    return s;
+    return i2s_out_pulser_status;
 }
 
 void IRAM_ATTR i2s_out_set_passthrough (void)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
-    if (i2s_out_pulser_status == STEPPING) {
-        i2s_out_pulser_status = WAITING;  // Start stopping the pulser
-        delay(I2S_OUT_DELAY_MS);
+    if (i2s_out_pulser_transition(STEPPING, WAITING)) {  // Start stopping the pulser
+        delay(i2s_out_committed_us() / 1000 + 1);
     }
-    I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
 void IRAM_ATTR i2s_out_set_stepping (void)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
-
-    if (i2s_out_pulser_status == STEPPING) {
-        // Re-entered (fail safe)
-        I2S_OUT_PULSER_EXIT_CRITICAL();
-        return;
+    // Wait for complete DMAs
+    while (i2s_out_pulser_status == WAITING) {
+        delay(o_dma.samples * I2S_OUT_USEC_PER_PULSE / 1000 + 1);
     }
 
-    if (i2s_out_pulser_status == WAITING) {
-        // Wait for complete DMAs
-        for (;;) {
-            I2S_OUT_PULSER_EXIT_CRITICAL();
-            delay(I2S_OUT_DELAY_DMABUF_MS);
-            I2S_OUT_PULSER_ENTER_CRITICAL();
-            if (i2s_out_pulser_status == WAITING) {
-                continue;
-            }
-            if (i2s_out_pulser_status == PASSTHROUGH) {
-                // DMA completed
-                break;
-            }
-            // Another function change the I2S state to STEPPING
-            I2S_OUT_PULSER_EXIT_CRITICAL();
-            return;
-        }
-    }
-
-    // Change I2S state from PASSTHROUGH to STEPPING
-    i2s_out_stop();
-    uint32_t port_data = atomic_load(&i2s_out_port_data);
-    i2s_clear_o_dma_buffers(port_data);
+    I2S_OUT_PULSER_ENTER_CRITICAL();
 
+    // Change I2S state from PASSTHROUGH to STEPPING.
     // You need to set the status before calling i2s_out_start()
     // because the process in i2s_out_start() is different depending on the status.
-    i2s_out_pulser_status = STEPPING;
-    i2s_out_start();
+    if (i2s_out_pulser_transition(PASSTHROUGH, STEPPING)) {
+        i2s_out_stop();
+        i2s_clear_o_dma_buffers(i2s_stream_port_data(&stream));
+        i2s_out_start();
+    } // else re-entered (fail safe) or another function changed the I2S state to STEPPING
+
     I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
+uint32_t IRAM_ATTR i2s_out_set_depth (uint32_t usec)
+{
+    uint32_t samples = usec / I2S_OUT_USEC_PER_PULSE;
+
+    o_dma.samples = samples < I2S_OUT_MIN_DMABUF_SAMPLES ? I2S_OUT_MIN_DMABUF_SAMPLES : (samples > DMA_SAMPLE_COUNT ? DMA_SAMPLE_COUNT : samples);
+
+    return o_dma.samples * I2S_OUT_USEC_PER_PULSE;
+}
+
+uint32_t IRAM_ATTR i2s_out_get_delay_us (void)
+{
+    return i2s_out_pulser_status == PASSTHROUGH ? i2s_out_passthrough_us() : i2s_out_committed_us();
+}
+
+// The buffer being filled goes out after the other buffers in the ring.
+// Only callbacks from the bitstream generator task are in the stream, foreground and interrupt callers get 0.
+uint32_t IRAM_ATTR i2s_out_get_stream_delay_us (void)
+{
+    if (!stream.filling || i2s_out_pulser_status != STEPPING || xPortInIsrContext() || xTaskGetCurrentTaskHandle() != o_dma.task)
+        return 0;
+
+    uint32_t length = 0;
+
+    for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++) {
+        if (o_dma.desc[buf_idx]->buf != (uint8_t *)stream.buf)
+            length += o_dma.desc[buf_idx]->length;
+    }
+
+    return (length / I2S_SAMPLE_SIZE + stream.rw_pos) * I2S_OUT_USEC_PER_PULSE;
+}
+
 void IRAM_ATTR i2s_out_set_pulse_period (uint32_t period)
 {
-    i2s_out_pulse_period = period;
+    stream.pulse_period = period;
 }
 
 void IRAM_ATTR i2s_out_set_pulse_callback (i2s_out_pulse_func_t func)
 {
-    i2s_out_pulse_func = func;
+    stream.pulse_func = func;
+}
+
+void i2s_out_set_pulse_batch (i2s_out_pulse_batch_func_t func, i2s_out_data_t mask, uint32_t samples)
+{
+    stream.pulse_batch_func = NULL;
+    stream.step_mask = mask;
+    stream.step_samples = samples;
+    stream.pulse_batch_func = func;
 }
 
 void IRAM_ATTR i2s_out_reset (void)
 {
     I2S_OUT_PULSER_ENTER_CRITICAL();
     i2s_out_stop();
-    if (i2s_out_pulser_status == STEPPING) {
-        uint32_t port_data = atomic_load(&i2s_out_port_data);
-        i2s_clear_o_dma_buffers(port_data);
-    } else if (i2s_out_pulser_status == WAITING) {
+    if (i2s_out_pulser_transition(WAITING, PASSTHROUGH)) {
         i2s_clear_o_dma_buffers(0);
-        i2s_out_pulser_status = PASSTHROUGH;
+    } else if (i2s_out_pulser_status == STEPPING) {
+        i2s_clear_o_dma_buffers(i2s_stream_port_data(&stream));
     }
     // You need to set the status before calling i2s_out_start()
     // because the process in i2s_out_start() is different depending on the status.
@@ -665,7 +801,10 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
         return false;
     }
 
-    atomic_store(&i2s_out_port_data, init_param.init_val);
+    atomic_store(&i2s_out_port_data[0], (uint32_t)init_param.init_val);
+#if I2S_STREAM_WORDS == 2
+    atomic_store(&i2s_out_port_data[1], (uint32_t)(init_param.init_val >> 32));
+#endif
 
     // To make sure hardware is enabled before any hardware register operations.
     periph_module_reset(PERIPH_I2S0_MODULE);
@@ -724,10 +863,19 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     }
 
     // Initialize
-    i2s_clear_o_dma_buffers(init_param.init_val);
-    o_dma.rw_pos  = 0;
-    o_dma.current = NULL;
-    o_dma.queue   = xQueueCreate(I2S_OUT_DMABUF_COUNT, sizeof(uint32_t *));
+    i2s_clear_o_dma_buffers(i2s_out_pulser_status == PASSTHROUGH ? 0 : init_param.init_val);
+#if I2S_OUT_NUM_BITS == 64
+    pass_desc.owner        = 1;
+    pass_desc.eof          = 0;  // no interrupt, the descriptor loops on itself
+    pass_desc.sosf         = 0;
+    pass_desc.length       = pass_desc.size = sizeof(pass_buf);
+    pass_desc.buf          = (uint8_t *)pass_buf;
+    pass_desc.offset       = 0;
+    pass_desc.qe.stqe_next = &pass_desc;
+    i2s_out_pass_data(init_param.init_val);
+#endif
+    i2s_stream_reset(&stream, NULL);
+    o_dma.queue   = xQueueCreate(I2S_OUT_DMABUF_COUNT, sizeof(i2s_out_dma_event_t));
 
     // Set the first DMA descriptor
     I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
@@ -780,7 +928,7 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     } else {
         // Static output mode
         I2S0.conf_chan.tx_chan_mod = 3;  // 3:right+constant 4:left+constant (when tx_msb_right = 1)
-        I2S0.conf_single_data      = init_param.init_val;
+        I2S0.conf_single_data      = (uint32_t)init_param.init_val;
     }
 
 #if I2S_OUT_NUM_BITS == 16
@@ -828,19 +976,14 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     // set clock (fi2s) 160MHz / 5
     I2S0.clkm_conf.clka_en = 0;  // Use 160 MHz PLL_D2_CLK as reference
                                  // N + b/a = 0
-#if I2S_OUT_NUM_BITS == 16
-    // N = 10
-    I2S0.clkm_conf.clkm_div_num = 10;  // minimum value of 2, reset value of 4, max 256 (IS clock dividers integral value)
-#else
-    // N = 5
-    I2S0.clkm_conf.clkm_div_num = 5;  // minimum value of 2, reset value of 4, max 256 (IS clock dividers integral value)
-#endif
-    // b/a = 0
-    I2S0.clkm_conf.clkm_div_b = 0;  // 0 at reset
-    I2S0.clkm_conf.clkm_div_a = 0;  // 0 at reset, what about divide by 0? (not an issue)
+    // N = 10 (16-bit) or 5 (32-bit) @ 4 usec/pulse, halved for each halving of the pulse time
+    I2S0.clkm_conf.clkm_div_num = I2S_OUT_CLKM_DIV_X4 / 4;  // minimum value of 2, reset value of 4, max 256 (IS clock dividers integral value)
+    // b/a = 0 or 1/2 (N + b/a = 2.5)
+    I2S0.clkm_conf.clkm_div_b = I2S_OUT_CLKM_DIV_X4 % 4;    // 0 at reset
+    I2S0.clkm_conf.clkm_div_a = 4;                          // 0 at reset
 
     // Bit clock configuration bit in transmitter mode.
-    // fbck = fi2s / tx_bck_div_num = (160 MHz / 5) / 2 = 16 MHz
+    // fbck = fi2s / tx_bck_div_num = (160 MHz / 5) / 2 = 16 MHz @ 32-bit, 4 usec/pulse, see I2S_OUT_BCK_KHZ
     I2S0.sample_rate_conf.tx_bck_div_num = 2;  // minimum value of 2 defaults to 6
     I2S0.sample_rate_conf.rx_bck_div_num = 2;
 
@@ -852,8 +995,8 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     I2S0.int_ena.out_done      = 0;  // Triggered when all transmitted and buffered data have been read.
 
     // default pulse callback period (usec)
-    i2s_out_pulse_period = init_param.pulse_period;
-    i2s_out_pulse_func   = init_param.pulse_func;
+    stream.pulse_period = init_param.pulse_period;
+    stream.pulse_func   = init_param.pulse_func;
 
     // Create the task that will feed the buffer
     xTaskCreatePinnedToCore(i2sOutTask,
@@ -861,7 +1004,7 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
                             4096,
                             NULL,
                             GRBLHAL_TASK_PRIORITY + 1,
-                            NULL,
+                            &o_dma.task,
                             GRBLHAL_TASK_CORE  // must run the task on same core
     );
 
@@ -896,7 +1039,7 @@ bool IRAM_ATTR i2s_out_init (void)
         .bck_pin      = I2S_OUT_BCK,
         .data_pin     = I2S_OUT_DATA,
         .pulse_func   = NULL,
-        .pulse_period = I2S_OUT_USEC_PER_PULSE,
+        .pulse_period = I2S_STREAM_TICKS_PER_SAMPLE,
         .init_val     = I2S_OUT_INIT_VAL,
     };
 
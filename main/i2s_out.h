@@ -46,8 +46,8 @@
 
 /* Assert */
 #if defined(I2S_OUT_NUM_BITS)
-#if (I2S_OUT_NUM_BITS != 16) && (I2S_OUT_NUM_BITS != 32)
-#error "I2S_OUT_NUM_BITS should be 16 or 32"
+#if (I2S_OUT_NUM_BITS != 16) && (I2S_OUT_NUM_BITS != 32) && (I2S_OUT_NUM_BITS != 64)
+#error "I2S_OUT_NUM_BITS should be 16, 32 or 64"
 #endif
 #else
 #define I2S_OUT_NUM_BITS 32
@@ -55,17 +55,110 @@
 
 #define I2SO(n) (I2S_OUT_PIN_BASE + n)
 
-/* 16-bit mode: 1000000 usec / ((160000000 Hz) / 10 / 2) x 16 bit/pulse x 2(stereo) = 4 usec/pulse */
-/* 32-bit mode: 1000000 usec / ((160000000 Hz) /  5 / 2) x 32 bit/pulse x 2(stereo) = 4 usec/pulse */
-#define I2S_OUT_USEC_PER_PULSE 4
+/*
+  64-bit mode: all 64 bits of a sample are latched together in both streaming and passthrough mode.
+  On the ESP32 passthrough writes are output via the DMA rather than the static data register,
+  they reach the outputs after about 150 us instead of 8 us, see i2s_out_delay().
+*/
+
+#include "i2s_stream.h"
+
+#if (I2S_OUT_USEC_PER_PULSE != 4) && (I2S_OUT_USEC_PER_PULSE != 2) && (I2S_OUT_USEC_PER_PULSE != 1)
+#error "I2S_OUT_USEC_PER_PULSE should be 4, 2 or 1"
+#endif
+
+/*
+  Maximum bit clock (BCK) of the shift register chain. 74HC595 is rated for 20 - 25 MHz when powered from 3.3V,
+  long chains and cables to daughter boards lower this. Raise it only if the hardware is known to handle it.
+*/
+#ifndef I2S_OUT_MAX_BCK_KHZ
+#define I2S_OUT_MAX_BCK_KHZ 20000
+#endif
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define I2S_OUT_BITS_PER_SAMPLE I2S_OUT_NUM_BITS        // TDM, one channel or two in 64-bit mode
+#elif I2S_OUT_NUM_BITS == 64
+#define I2S_OUT_BITS_PER_SAMPLE 64                      // stereo, data in both channels
+#else
+#define I2S_OUT_BITS_PER_SAMPLE (I2S_OUT_NUM_BITS * 2)  // stereo
+#endif
+
+#define I2S_OUT_BCK_KHZ (I2S_OUT_BITS_PER_SAMPLE * 1000 / I2S_OUT_USEC_PER_PULSE)
+// fbck = 160 MHz / (N + b/a) / 2 -> N + b/a = 80 MHz / fbck, in quarters: b/a = 0, 1/4, 1/2 or 3/4.
+#define I2S_OUT_CLKM_DIV_X4 (320000 / I2S_OUT_BCK_KHZ)
+
+#if I2S_OUT_CLKM_DIV_X4 < 8
+#error "I2S_OUT_USEC_PER_PULSE is too short for the I2S clock divider, use 16-bit mode (I2S_OUT_NUM_BITS 16)"
+#endif
+
+/*
+  Bit clock per sample period with the default I2S_OUT_MAX_BCK_KHZ:
+
+                   4 us      2 us      1 us
+  ESP32 16-bit     8 MHz    16 MHz    32 MHz (too fast)
+  ESP32 32-bit    16 MHz    32 MHz (too fast)
+  ESP32-S3 16-bit  4 MHz     8 MHz    16 MHz
+  ESP32-S3 32-bit  8 MHz    16 MHz    32 MHz (too fast)
+
+  The ESP32 always clocks out a stereo frame, so the 1 us period is only available on the ESP32-S3.
+*/
+#if I2S_OUT_BCK_KHZ > I2S_OUT_MAX_BCK_KHZ
+#if I2S_OUT_NUM_BITS != 16
+#error "I2S bit clock exceeds the shift register chain maximum (I2S_OUT_MAX_BCK_KHZ), use 16-bit mode (I2S_OUT_NUM_BITS 16) or increase I2S_OUT_USEC_PER_PULSE"
+#else
+#error "I2S bit clock exceeds the shift register chain maximum (I2S_OUT_MAX_BCK_KHZ), increase I2S_OUT_USEC_PER_PULSE"
+#endif
+#endif
 
 #define I2S_OUT_DMABUF_COUNT 5  /* number of DMA buffers to store data */
-#define I2S_OUT_DMABUF_LEN 2000 /* maximum size in bytes (4092 is DMA's limit) */
+#define I2S_OUT_SAMPLE_SIZE (I2S_STREAM_WORDS * sizeof(uint32_t))   /* bytes per sample */
+#define I2S_OUT_DMABUF_LEN (2000 * I2S_STREAM_WORDS)                /* maximum size in bytes (4092 is DMA's limit), 500 samples */
 
-#define I2S_OUT_DELAY_DMABUF_MS (I2S_OUT_DMABUF_LEN / sizeof(uint32_t) * I2S_OUT_USEC_PER_PULSE / 1000)
+#define I2S_OUT_DELAY_DMABUF_MS (I2S_OUT_DMABUF_LEN / I2S_OUT_SAMPLE_SIZE * I2S_OUT_USEC_PER_PULSE / 1000)
 #define I2S_OUT_DELAY_MS (I2S_OUT_DELAY_DMABUF_MS * (I2S_OUT_DMABUF_COUNT + 1))
 
-typedef void (*i2s_out_pulse_func_t)(void);
+/*
+  The number of samples filled per DMA buffer while stepping can be changed at run time, this sets
+  how much output is committed ahead of the step generator: (I2S_OUT_DMABUF_COUNT + 1) x buffer time.
+  Shallow buffers lower the latency of feed hold, overrides and stops at the cost of a higher DMA interrupt rate.
+*/
+#ifndef I2S_OUT_SHALLOW_DMABUF_USEC
+#define I2S_OUT_SHALLOW_DMABUF_USEC 100 // 600 us committed, 10 kHz DMA interrupt rate.
+#endif
+#define I2S_OUT_DEEP_DMABUF_USEC (I2S_OUT_DMABUF_LEN / I2S_OUT_SAMPLE_SIZE * I2S_OUT_USEC_PER_PULSE)
+#define I2S_OUT_MIN_DMABUF_SAMPLES (SAMPLE_SAFE_COUNT * 2 + 2)  // Room for at least one pulse per buffer.
+
+#if I2S_OUT_STATS_ENABLE
+
+#include "xtensa/core-macros.h"
+
+/*
+  Step stream health. An underrun is a buffer that was shifted out again with static port data
+  as the fill task did not refill it in time, the step timing is then off by one buffer time.
+*/
+typedef struct {
+    uint32_t fills;         // Buffers filled while stepping
+    uint32_t underruns;     // Buffers recycled by the DMA interrupt handler while stepping
+    uint32_t ahead_min;     // Min number of filled buffers queued for DMA on refill done
+    uint32_t latency_max;   // Max time from DMA EOF to refill done, CPU cycles
+    uint32_t fill_max;      // Max time spent in i2s_fillout_dma_buffer(), CPU cycles
+} i2s_out_stats_t;
+
+// Records a refill done by the fill task, times are CPU cycle counts. waiting is the number of DMA complete events queued.
+static inline void i2s_out_stats_fill (i2s_out_stats_t *stats, uint32_t eof_time, uint32_t fill_start, uint32_t waiting)
+{
+    uint32_t now = XTHAL_GET_CCOUNT(), ahead = waiting < I2S_OUT_DMABUF_COUNT ? I2S_OUT_DMABUF_COUNT - 1 - waiting : 0;
+
+    stats->fills++;
+    if(now - eof_time > stats->latency_max)
+        stats->latency_max = now - eof_time;
+    if(now - fill_start > stats->fill_max)
+        stats->fill_max = now - fill_start;
+    if(ahead < stats->ahead_min)
+        stats->ahead_min = ahead;
+}
+
+#endif // I2S_OUT_STATS_ENABLE
 
 typedef struct {
     /*
@@ -80,13 +173,17 @@ typedef struct {
                                 Latches the X bits when ws is switched to High
         If I2S_OUT_PIN_BASE is set to 128,
         bit0:Expanded GPIO 128, 1: Expanded GPIO 129, ..., v: Expanded GPIO 159
+
+        64-bit mode: the right channel carries bits 63 - 32 and is latched with the left channel of the next sample,
+        bits 32 - 63 are output one sample after bits 0 - 31. On the ESP32-S3 the two words are sent as TDM slots 0 and 1
+        of one frame, bits 63 - 32 first, and latched together.
     */
     uint8_t              ws_pin;
     uint8_t              bck_pin;
     uint8_t              data_pin;
     i2s_out_pulse_func_t pulse_func;
-    uint32_t             pulse_period;  // aka step rate.
-    uint32_t             init_val;
+    uint32_t             pulse_period;  // aka step rate, in 1/I2S_STREAM_TICKS_PER_USEC microseconds.
+    i2s_out_data_t       init_val;
 } i2s_out_init_t;
 
 /*
@@ -102,7 +199,7 @@ typedef struct {
         .bck_pin = I2S_OUT_BCK,
         .data_pin = I2S_OUT_DATA,
         .pulse_func = NULL,
-        .pulse_period = I2S_OUT_USEC_PER_PULSE,
+        .pulse_period = I2S_STREAM_TICKS_PER_SAMPLE,
         .init_val = I2S_OUT_INIT_VAL,
     };
   return false ... already initialized
@@ -114,30 +211,51 @@ void i2s_set_step_mask (void);
 
 /*
   Get a bit state from the internal pin state var.
-  pin: expanded pin No. (0..31)
+  pin: expanded pin No. (0..I2S_OUT_NUM_BITS - 1)
 */
 bool i2s_out_state (uint8_t pin);
 
 /*
    Set a bit in the internal pin state var. (not written electrically)
-   pin: expanded pin No. (0..31)
+   pin: expanded pin No. (0..I2S_OUT_NUM_BITS - 1)
    val: bit value(0 or not 0)
 */
 void i2s_out_write(uint8_t pin, uint8_t val);
 
+/*
+   Set and clear several bits in the internal pin state var in one go.
+   set:   bits to set
+   clear: bits to clear
+*/
+void i2s_out_write_mask (i2s_out_data_t set, i2s_out_data_t clear);
 
+/*
+   ESP32-S3 passthrough mode: output a step pulse from the current pin state.
+   delay: samples with the step bits cleared before the pulse, max I2S_OUT_MAX_DELAY_USEC / I2S_OUT_USEC_PER_PULSE
+   pulse: samples with the step bits set, max I2S_OUT_MAX_STEP_USEC / I2S_OUT_USEC_PER_PULSE
+   The step bits are cleared in the pin state when done.
+*/
 void i2s_out_commit (uint8_t pulse, uint8_t delay);
 
 /*
     Set current pin state to the I2S bitstream buffer
     (This call will generate a future I2S_OUT_USEC_PER_PULSE us x N bitstream)
     num: Number of samples to be generated
-         The number of samples is limited to (20 / I2S_OUT_USEC_PER_PULSE).
+         The number of samples is limited to SAMPLE_SAFE_COUNT.
     return: number of puhsed samples
             0 .. no space for push
  */
 uint32_t i2s_out_push_sample (uint32_t num);
 
+/*
+    Push a step pulse to the I2S bitstream buffer, the current pin state with the bits in mask replaced by level.
+    The internal pin state var is not changed.
+    num: Number of samples to be generated, limited as for i2s_out_push_sample()
+    return: number of pushed samples
+            0 .. no space for push
+ */
+uint32_t i2s_out_push_pulse (i2s_out_data_t mask, i2s_out_data_t level, uint32_t num);
+
 /*
    Set pulser mode to passtrough
    After this function is called,
@@ -161,7 +279,29 @@ void i2s_out_set_stepping (void);
 void i2s_out_delay (void);
 
 /*
-   Set the pulse callback period in ISR microseconds.
+   Set the time filled per DMA buffer while stepping, clamped to I2S_OUT_MIN_DMABUF_SAMPLES - I2S_OUT_DEEP_DMABUF_USEC.
+   Takes effect as the buffers are refilled, the latency drops to the new value within one round of the DMA ring.
+   return: the buffer time set in microseconds
+ */
+uint32_t i2s_out_set_depth (uint32_t usec);
+
+/*
+   Get the time until output written now is shifted out in microseconds,
+   the sum of the DMA buffers committed when stepping. On the ESP32 in 64-bit mode this is
+   also the passthrough mode time as bits 32 - 63 are output from the DMA ring.
+   Used by the driver to delay GPIO outputs changed outside the pulse callback, see i2s_output_defer().
+ */
+uint32_t i2s_out_get_delay_us (void);
+
+/*
+   Get the time until the sample at the current stream position is shifted out in microseconds.
+   Only valid from the pulse callback while stepping, resolution is one DMA buffer.
+   return: 0 when not called from the pulse callback
+ */
+uint32_t i2s_out_get_stream_delay_us (void);
+
+/*
+   Set the pulse callback period in 1/I2S_STREAM_TICKS_PER_USEC microseconds.
  */
 void i2s_out_set_pulse_period (uint32_t period);
 
@@ -171,17 +311,23 @@ void i2s_out_set_pulse_period (uint32_t period);
 void i2s_out_set_pulse_callback (i2s_out_pulse_func_t func);
 
 /*
-   Get current pulser mode
+   Register a callback function to generate runs of step pulses within a segment, NULL to run
+   the pulse callback for every pulse. mask is the step output bits, samples the step pulse length.
  */
-typedef enum  {
-    PASSTHROUGH = 0,  // Static I2S mode.The i2s_out_write() reflected with very little delay
-    STEPPING,         // Streaming step data.
-    WAITING,          // Waiting for the step DMA completion
-    STOPPED,          // ESP32-S: no output
-} i2s_out_pulser_status_t;
+void i2s_out_set_pulse_batch (i2s_out_pulse_batch_func_t func, i2s_out_data_t mask, uint32_t samples);
 
+/*
+   Get current pulser mode
+ */
 i2s_out_pulser_status_t i2s_out_get_pulser_status (void);
 
+#if I2S_OUT_STATS_ENABLE
+/*
+   Get the step stream statistics, optionally resetting them.
+ */
+void i2s_out_get_stats (i2s_out_stats_t *stats, bool reset);
+#endif
+
 /*
    Reset i2s I/O expander
    - Stop ISR/DMA
@@ -69,6 +69,7 @@
 #include "soc/gdma_periph.h"
 #include "soc/system_reg.h"
 #include <stdatomic.h>
+#include <string.h>
 
 #include "i2s_out.h"
 
@@ -86,44 +87,71 @@
 // Increasing I2S_OUT_DMABUF_COUNT has the effect of preventing buffer underflow,
 // but on the other hand, it leads to a delay with pulse and/or non-pulse-generated I/Os.
 // The number of I2S_OUT_DMABUF_COUNT should be chosen carefully.
+// The number of samples filled per buffer while stepping can be lowered at run time by i2s_out_set_depth(),
+// the delay is then (I2S_OUT_DMABUF_COUNT + 1) x the shorter buffer time.
 //
 // Reference information:
 //   FreeRTOS task time slice = portTICK_PERIOD_MS = 1 ms (ESP32 FreeRTOS port)
 //
-#define I2S_SAMPLE_SIZE 4                                       /* 4 bytes, 32 bits per sample */
+#define I2S_SAMPLE_SIZE I2S_OUT_SAMPLE_SIZE                     /* 4 bytes, 8 bytes in 64-bit mode */
 #define DMA_SAMPLE_COUNT (I2S_OUT_DMABUF_LEN / I2S_SAMPLE_SIZE) /* number of samples per buffer */
-#define SAMPLE_SAFE_COUNT (20 / I2S_OUT_USEC_PER_PULSE)         /* prevent buffer overrun (GRBL's $0 should be less than or equal 20) */
-#define DMA_SAMPLE_COUNT_PASSTROUGH 12
+#define I2S_PASS_DELAY_MAX (I2S_OUT_MAX_DELAY_USEC / I2S_OUT_USEC_PER_PULSE)  /* max step delay samples in passthrough mode */
+#define I2S_PASS_PULSE_MAX (I2S_OUT_MAX_STEP_USEC / I2S_OUT_USEC_PER_PULSE)   /* max step pulse samples in passthrough mode */
 #ifndef I2S_OUT_INIT_VAL
 #define I2S_OUT_INIT_VAL 0
 #endif
 #define I2S_OUT_DETACH_PORT_IDX 0x100
 #define I2S_LOCAL_QUEUE 0 // Set 0 for FreeRTOS queue, 8 or 16 for local queue
 
+// DMA complete event, sent from the interrupt handler to the bitstream generator
+typedef struct {
+    dma_descriptor_t *desc;
+    uint32_t ring_gen;          // i2s_sr.dma.ring_gen when the event was sent
+#if I2S_OUT_STATS_ENABLE
+    uint32_t eof_time;          // CPU cycle count at DMA EOF
+#endif
+} i2s_out_dma_event_t;
+
+/*
+  Passthrough mode descriptor chain: delay samples -> pulse samples -> idle, the idle descriptor loops on itself.
+  Shorter delays and pulses are entered further into the runs, all delay descriptors share one sample buffer and
+  all pulse descriptors another. The idle descriptor has its own buffer as passthrough writes update it while the
+  delay samples of the same chain may still be output. A step is committed by writing the three samples and
+  patching the links, the chains are used alternately so that the one being set up is not output.
+*/
+typedef struct {
+    dma_descriptor_t delay[I2S_PASS_DELAY_MAX];
+    dma_descriptor_t pulse[I2S_PASS_PULSE_MAX];
+    dma_descriptor_t idle;
+    uint32_t off[I2S_STREAM_WORDS];     // delay sample
+    uint32_t on[I2S_STREAM_WORDS];      // pulse sample
+    uint32_t rest[I2S_STREAM_WORDS];    // idle sample, updated by i2s_out_write() and i2s_out_write_mask()
+} i2s_pass_chain_t;
+
 typedef struct {
     uint32_t **buffers;
-    uint32_t *current;
-    uint32_t rw_pos;
     dma_descriptor_t **desc;
-    dma_descriptor_t *idle, *idle_next;
+    dma_descriptor_t *idle;     // Passthrough mode, idle descriptor of the chain being output
+    uint_fast8_t pass;          // Passthrough mode, chain being output
     int32_t channel;
     intr_handle_t intr_handle;
+    volatile uint32_t samples;  // Number of samples to fill per buffer when stepping, see i2s_out_set_depth()
+    volatile uint32_t ring_gen; // Incremented when the descriptor ring is rebuilt
 #if !I2S_LOCAL_QUEUE
-    xQueueHandle queue;
+    xQueueHandle queue;         // of i2s_out_dma_event_t
+    TaskHandle_t task;          // bitstream generator task
 #endif
 } i2s_out_dma_t;
 
 typedef struct {
     bool initialized;
-    atomic_uint_least32_t port_data; // output value
-    uint32_t step_mask;
-    volatile uint32_t pulse_period;
-    uint32_t remain_time_until_next_pulse;  // Time remaining until the next pulse (usec)
+    atomic_uint_least32_t port_data[I2S_STREAM_WORDS]; // output value, bits 0 - 31 first
+    i2s_out_data_t step_mask;
+    i2s_stream_t stream;                    // bitstream generator
     gpio_num_t ws_pin;
     gpio_num_t bck_pin;
     gpio_num_t data_pin;
-    volatile i2s_out_pulse_func_t pulse_func;
-    volatile i2s_out_pulser_status_t pulser_status;
+    _Atomic i2s_out_pulser_status_t pulser_status;  // changed with atomic compare and swap or under the inner lock by i2s_out_start()
     portMUX_TYPE spinlock, pulser_spinlock;
     i2s_out_dma_t dma;
 } i2s_sr_t;
@@ -131,7 +159,7 @@ typedef struct {
 typedef struct {
     volatile uint_fast16_t head;
     volatile uint_fast16_t tail;
-    dma_descriptor_t *descr[I2S_LOCAL_QUEUE];
+    i2s_out_dma_event_t descr[I2S_LOCAL_QUEUE];
 } i2s_dma_queue_t;
 
 static const DRAM_ATTR uint32_t i2s_tx_int_flags = GDMA_LL_EVENT_TX_DONE|GDMA_LL_EVENT_TX_TOTAL_EOF;
@@ -141,15 +169,24 @@ static i2s_dma_queue_t dma_queue = {0};
 static on_execute_realtime_ptr on_execute_realtime, on_execute_delay;
 #endif
 
+#if I2S_OUT_STATS_ENABLE
+static i2s_out_stats_t i2s_out_stats = {
+    .ahead_min = I2S_OUT_DMABUF_COUNT
+};
+#endif
+
+static i2s_pass_chain_t i2s_pass_chain[2];
+
 static i2s_sr_t i2s_sr = {
     .ws_pin   = 255,
     .bck_pin  = 255,
     .data_pin = 255,
     .pulser_status = STOPPED,
-    .port_data = ATOMIC_VAR_INIT(0),
     .spinlock = portMUX_INITIALIZER_UNLOCKED,
     .pulser_spinlock = portMUX_INITIALIZER_UNLOCKED,
-    .dma.idle = NULL
+    .dma.idle = NULL,
+    .dma.pass = 0,
+    .dma.samples = DMA_SAMPLE_COUNT
 };
 
 // inner lock
@@ -173,7 +210,7 @@ static i2s_sr_t i2s_sr = {
 #define I2S_OUT_ENTER_CRITICAL_ISR() portENTER_CRITICAL_ISR(&i2s_sr.spinlock)
 #define I2S_OUT_EXIT_CRITICAL_ISR() portEXIT_CRITICAL_ISR(&i2s_sr.spinlock)
 
-// outer lock
+// outer lock, serializes stopping, rewiring and restarting the DMA descriptor ring
 #define I2S_OUT_PULSER_ENTER_CRITICAL()                         \
     do {                                                        \
         if (xPortInIsrContext()) {                              \
@@ -191,8 +228,11 @@ static i2s_sr_t i2s_sr = {
         }                                                       \
     } while (0)
 
-#define I2S_OUT_PULSER_ENTER_CRITICAL_ISR() portENTER_CRITICAL_ISR(&i2s_sr.pulser_spinlock)
-#define I2S_OUT_PULSER_EXIT_CRITICAL_ISR() portEXIT_CRITICAL_ISR(&i2s_sr.pulser_spinlock)
+// Atomically change the pulser status from expected to desired, returns false if the status was not expected.
+static inline bool i2s_out_pulser_transition (i2s_out_pulser_status_t expected, i2s_out_pulser_status_t desired)
+{
+    return atomic_compare_exchange_strong(&i2s_sr.pulser_status, &expected, desired);
+}
 
 //
 // Internal functions
@@ -218,20 +258,22 @@ static inline void i2s_out_single_data (void)
 #endif
 }
 */
-static inline void IRAM_ATTR i2s_clear_dma_buffer (dma_descriptor_t *dma_desc, uint32_t port_data)
+static inline void IRAM_ATTR i2s_clear_dma_buffer (dma_descriptor_t *dma_desc, i2s_out_data_t port_data)
 {
     uint32_t *buf = (uint32_t *)dma_desc->buffer, i = DMA_SAMPLE_COUNT;
 
     do {
-        *buf++ = port_data;
+        buf = i2s_stream_put(buf, port_data);
     } while(--i);
     // Restore the buffer length.
     // The length may have been changed short when the data was filled in to prevent buffer overrun.
-    dma_desc->dw0.length = I2S_OUT_DMABUF_LEN;
+    dma_desc->dw0.length = i2s_sr.dma.samples * I2S_SAMPLE_SIZE;
 }
 
-static void IRAM_ATTR i2s_clear_o_dma_buffers (uint32_t port_data)
+static void IRAM_ATTR i2s_clear_o_dma_buffers (i2s_out_data_t port_data)
 {
+    i2s_sr.dma.ring_gen++;  // Descriptors of pending DMA complete events are no longer to be written by the task
+
     for(int i = 0; i < I2S_OUT_DMABUF_COUNT; i++) {
 
         // Initialize DMA descriptor
@@ -239,7 +281,7 @@ static void IRAM_ATTR i2s_clear_o_dma_buffers (uint32_t port_data)
 
         i2s_sr.dma.desc[i]->dw0.owner = 1;
         i2s_sr.dma.desc[i]->dw0.suc_eof = 1;
-        i2s_sr.dma.desc[i]->dw0.length = I2S_OUT_DMABUF_LEN;
+        i2s_sr.dma.desc[i]->dw0.length = i2s_sr.dma.samples * I2S_SAMPLE_SIZE;
         i2s_sr.dma.desc[i]->dw0.size = I2S_OUT_DMABUF_LEN;
         i2s_sr.dma.desc[i]->buffer = i2s_sr.dma.buffers[i];
         i2s_sr.dma.desc[i]->next = (dma_descriptor_t *)((i < (I2S_OUT_DMABUF_COUNT - 1)) ? (i2s_sr.dma.desc[i + 1]) : i2s_sr.dma.desc[0]);
@@ -264,14 +306,14 @@ static void IRAM_ATTR i2s_out_gpio_detach (uint8_t ws, uint8_t bck, uint8_t data
     gpio_matrix_out_check(data, I2S_OUT_DETACH_PORT_IDX, false, false);
 }
 */
-static void IRAM_ATTR i2s_out_gpio_shiftout (uint32_t port_data)
+static void IRAM_ATTR i2s_out_gpio_shiftout (i2s_out_data_t port_data)
 {
     uint32_t i = I2S_OUT_NUM_BITS;
 
     gpio_set_level(i2s_sr.ws_pin, 0);
 
     do {
-        gpio_set_level(i2s_sr.data_pin, !!(port_data & bit(--i)));
+        gpio_set_level(i2s_sr.data_pin, (uint32_t)(port_data >> --i) & 0x01);
         gpio_set_level(i2s_sr.bck_pin, 1);
         gpio_set_level(i2s_sr.bck_pin, 0);
     } while(i);
@@ -325,33 +367,42 @@ static void IRAM_ATTR i2s_out_stop (void)
 }
 */
 
-static bool IRAM_ATTR i2s_out_start (i2s_out_pulser_status_t pulser_status)
+static void i2s_pass_desc_init (dma_descriptor_t *desc, uint32_t *buffer, dma_descriptor_t *next)
 {
-    static uint32_t pass_data[DMA_SAMPLE_COUNT_PASSTROUGH];
-    static dma_descriptor_t pass_dma[DMA_SAMPLE_COUNT_PASSTROUGH];
+    desc->dw0.owner = 1;
+    desc->dw0.suc_eof = 0;
+    desc->dw0.length = desc->dw0.size = I2S_SAMPLE_SIZE;
+    desc->buffer = buffer;
+    desc->next = next;
+}
 
-    if(!i2s_sr.initialized)
-        return false;
+static void i2s_pass_chain_init (i2s_pass_chain_t *chain)
+{
+    uint_fast8_t i;
 
-    if(i2s_sr.dma.idle == NULL) {
+    for(i = 0; i < I2S_PASS_DELAY_MAX; i++)
+        i2s_pass_desc_init(&chain->delay[i], chain->off, i == I2S_PASS_DELAY_MAX - 1 ? &chain->idle : &chain->delay[i + 1]);
 
-        uint_fast8_t i = DMA_SAMPLE_COUNT_PASSTROUGH;
+    for(i = 0; i < I2S_PASS_PULSE_MAX; i++)
+        i2s_pass_desc_init(&chain->pulse[i], chain->on, i == I2S_PASS_PULSE_MAX - 1 ? &chain->idle : &chain->pulse[i + 1]);
 
-        do {
-            pass_dma[--i].dw0.owner = 1;
-            pass_dma[i].dw0.suc_eof = 0;
-            pass_dma[i].dw0.length = pass_dma[i].dw0.size = sizeof(i2s_sr.port_data);
-            pass_dma[i].buffer = &pass_data[i];
-            pass_dma[i].next = &pass_dma[i == 0 || i == (DMA_SAMPLE_COUNT_PASSTROUGH - 1) ? 0 : i + 1];
-        } while(i);
+    i2s_pass_desc_init(&chain->idle, chain->rest, &chain->idle);
+}
 
-        i2s_sr.dma.idle = &pass_dma[0];
-        i2s_sr.dma.idle_next = &pass_dma[1];
+static bool IRAM_ATTR i2s_out_start (i2s_out_pulser_status_t pulser_status)
+{
+    if(!i2s_sr.initialized)
+        return false;
+
+    if(i2s_sr.dma.idle == NULL) {
+        i2s_pass_chain_init(&i2s_pass_chain[0]);
+        i2s_pass_chain_init(&i2s_pass_chain[1]);
+        i2s_sr.dma.idle = &i2s_pass_chain[i2s_sr.dma.pass].idle;
     }
 
     I2S_OUT_ENTER_CRITICAL();
 
-    if(i2s_sr.pulse_func == NULL)
+    if(i2s_sr.stream.pulse_func == NULL)
         pulser_status = PASSTHROUGH;
 
     if(i2s_sr.pulser_status == pulser_status) {
@@ -366,20 +417,19 @@ static bool IRAM_ATTR i2s_out_start (i2s_out_pulser_status_t pulser_status)
     i2s_ll_tx_reset(&I2S0);
     i2s_ll_tx_reset_fifo(&I2S0);
 
-    uint32_t port_data = atomic_load(&i2s_sr.port_data);  // current expanded port value
+    i2s_out_data_t port_data = i2s_stream_port_data(&i2s_sr.stream);  // current expanded port value
 
 // Transmit recovery data to 74HC595
 //    i2s_out_gpio_shiftout(port_data);
 
     if((i2s_sr.pulser_status = pulser_status) == PASSTHROUGH)
-        *(uint32_t *)i2s_sr.dma.idle->buffer = port_data;
+        i2s_stream_put(i2s_sr.dma.idle->buffer, port_data);
     else {
         i2s_clear_o_dma_buffers(port_data);
 #if I2S_LOCAL_QUEUE
         dma_queue.tail = dma_queue.head;
 #endif
-        i2s_sr.dma.rw_pos = 0;
-        i2s_sr.dma.current = i2s_sr.dma.desc[0]->buffer;
+        i2s_stream_reset(&i2s_sr.stream, i2s_sr.dma.desc[0]->buffer);
     }
 
     gdma_ll_tx_reset_channel(&GDMA, i2s_sr.dma.channel);
@@ -423,7 +473,13 @@ static void IRAM_ATTR i2s_out_intr_handler (void *arg)
     if(irq & i2s_tx_int_flags) {
 
         // Get the descriptor of the last item in the linked list
-        dma_descriptor_t *finish_desc = (dma_descriptor_t *)gdma_ll_tx_get_eof_desc_addr(&GDMA, i2s_sr.dma.channel);
+        i2s_out_dma_event_t finish = {
+            .desc = (dma_descriptor_t *)gdma_ll_tx_get_eof_desc_addr(&GDMA, i2s_sr.dma.channel),
+            .ring_gen = i2s_sr.dma.ring_gen,
+#if I2S_OUT_STATS_ENABLE
+            .eof_time = XTHAL_GET_CCOUNT()
+#endif
+        };
 
         // Finished stepping?
         if(irq & GDMA_LL_EVENT_TX_TOTAL_EOF) {
@@ -435,54 +491,62 @@ static void IRAM_ATTR i2s_out_intr_handler (void *arg)
         // more than buf_count isr without new data, remove the front buffer
         else if((irq & GDMA_LL_EVENT_TX_DONE) && i2s_sr.pulser_status != PASSTHROUGH) {
 
-            uint32_t port_data = 0;
-            dma_descriptor_t *front_desc;
+            i2s_out_data_t port_data = 0;
+            i2s_out_dma_event_t front;
 
 #if I2S_LOCAL_QUEUE
 
-            I2S_OUT_PULSER_ENTER_CRITICAL_ISR();
+            I2S_OUT_ENTER_CRITICAL_ISR();
 
             uint32_t qptr = (dma_queue.head + 1) & (I2S_LOCAL_QUEUE - 1);  // Get next head pointer
 
             if(dma_queue.tail == qptr) {
 
-                front_desc = dma_queue.descr[dma_queue.tail++];
-
-
-                if(i2s_sr.pulser_status == STEPPING)
-                    port_data = atomic_load(&i2s_sr.port_data);
+                front = dma_queue.descr[dma_queue.tail++];
 
+                if(i2s_sr.pulser_status == STEPPING) {
+                    port_data = i2s_stream_port_data(&i2s_sr.stream);
+                    // Underrun guard, deepen the buffers until the next i2s_out_set_depth() call.
+                    i2s_sr.dma.samples = i2s_sr.dma.samples < DMA_SAMPLE_COUNT / 2 ? i2s_sr.dma.samples * 2 : DMA_SAMPLE_COUNT;
+#if I2S_OUT_STATS_ENABLE
+                    i2s_out_stats.underruns++;  // The step stream is now late by one buffer
+#endif
+                }
 
-                i2s_clear_dma_buffer(front_desc, port_data);
+                i2s_clear_dma_buffer(front.desc, port_data);
 
                 dma_queue.tail &= (I2S_LOCAL_QUEUE - 1);
             }
 
             // Send a DMA complete event to the I2S bitstreamer task with finished buffer
-            if((dma_queue.descr[dma_queue.head] = finish_desc) > 100)
+            if((uint32_t)finish.desc > 100) {
+                dma_queue.descr[dma_queue.head] = finish;
                 dma_queue.head = qptr;
+            }
 
-            I2S_OUT_PULSER_EXIT_CRITICAL_ISR();
+            I2S_OUT_EXIT_CRITICAL_ISR();
 
 #else
 
             if(xQueueIsQueueFullFromISR(i2s_sr.dma.queue)) {
 
                 // Remove a descriptor from the DMA complete event queue
-                xQueueReceiveFromISR(i2s_sr.dma.queue, &front_desc, &high_priority_task_awoken);
-
-                I2S_OUT_PULSER_ENTER_CRITICAL_ISR();
-
-                if(i2s_sr.pulser_status == STEPPING)
-                    port_data = atomic_load(&i2s_sr.port_data);
-
-                I2S_OUT_PULSER_EXIT_CRITICAL_ISR();
+                xQueueReceiveFromISR(i2s_sr.dma.queue, &front, &high_priority_task_awoken);
+
+                if(i2s_sr.pulser_status == STEPPING) {
+                    port_data = i2s_stream_port_data(&i2s_sr.stream);
+                    // Underrun guard, deepen the buffers until the next i2s_out_set_depth() call.
+                    i2s_sr.dma.samples = i2s_sr.dma.samples < DMA_SAMPLE_COUNT / 2 ? i2s_sr.dma.samples * 2 : DMA_SAMPLE_COUNT;
+#if I2S_OUT_STATS_ENABLE
+                    i2s_out_stats.underruns++;  // The step stream is now late by one buffer
+#endif
+                }
 
-                i2s_clear_dma_buffer(front_desc, port_data);
+                i2s_clear_dma_buffer(front.desc, port_data);
             }
 
             // Send a DMA complete event to the I2S bitstreamer task with finished buffer
-            xQueueSendFromISR(i2s_sr.dma.queue, &finish_desc, &high_priority_task_awoken);
+            xQueueSendFromISR(i2s_sr.dma.queue, &finish, &high_priority_task_awoken);
 
 #endif
         }
@@ -494,93 +558,53 @@ static void IRAM_ATTR i2s_out_intr_handler (void *arg)
         portYIELD_FROM_ISR();
 }
 
-static void IRAM_ATTR i2s_fillout_dma_buffer (dma_descriptor_t *dma_desc)
+// The buffer is filled without locking, the descriptor is only updated under the pulser lock
+// and if the ring has not been rebuilt by i2s_out_reset() or a mode change meanwhile.
+static void IRAM_ATTR i2s_fillout_dma_buffer (dma_descriptor_t *dma_desc, uint32_t ring_gen)
 {
-    uint32_t *buf = (uint32_t *)dma_desc->buffer;
-
     // It reuses the oldest (just transferred) buffer with the name "current"
-    // and fills the buffer for later DMA.
+    // and fills the buffer for later DMA, see i2s_stream_fill().
 
-    i2s_sr.dma.rw_pos = 0;
+    i2s_out_pulser_status_t status = i2s_stream_fill(&i2s_sr.stream, (uint32_t *)dma_desc->buffer, i2s_sr.dma.samples);
 
-    //
-    // Fillout the buffer for pulse
-    //
-    // To avoid buffer overflow, all of the maximum pulse width (normally about 10us)
-    // is adjusted to be in a single buffer.
-    // DMA_SAMPLE_SAFE_COUNT is referred to as the margin value.
-    // Therefore, if a buffer is close to full and it is time to generate a pulse,
-    // the generation of the buffer is interrupted (the buffer length is shortened slightly)
-    // and the pulse generation is postponed until the next buffer is filled.
-    //
-    while (i2s_sr.dma.rw_pos < (DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT)) {
-
-        // no data to read (buffer empty)
-        if (i2s_sr.remain_time_until_next_pulse < I2S_OUT_USEC_PER_PULSE) {
-
-            // pulser status may change in pulse phase func, so I need to check it every time.
-            if (i2s_sr.pulser_status == STEPPING) {
-
-                // fillout future DMA buffer (tail of the DMA buffer chains)
-
-                uint32_t old_rw_pos = i2s_sr.dma.rw_pos, period;
-
-                I2S_OUT_PULSER_EXIT_CRITICAL();   // Temporarily unlocked status lock as it may be locked in pulse callback.
-
-                i2s_sr.pulse_func();              // Insert steps.
-
-                I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock again.
-
-                period = I2S_OUT_USEC_PER_PULSE * (i2s_sr.dma.rw_pos - old_rw_pos);
-
-                // Calculate pulse period.
-                if(i2s_sr.pulse_period >= period)
-                    i2s_sr.remain_time_until_next_pulse += i2s_sr.pulse_period - period;
-                else // too fast!
-                    i2s_sr.remain_time_until_next_pulse += I2S_OUT_USEC_PER_PULSE;
+    I2S_OUT_PULSER_ENTER_CRITICAL();
 
-                if (i2s_sr.pulser_status == WAITING) {
-                    // i2s_out_set_passthrough() has called from the pulse function.
-                    // It needs to go into pass-through mode.
-                    // This DMA descriptor must be a tail of the chain.
-                    dma_desc->dw0.suc_eof = 1; //?
-                    dma_desc->next = NULL;  // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
-                } else if (i2s_sr.pulser_status == PASSTHROUGH) {
-                    // i2s_out_reset() has called during the execution of the pulse function.
-                    // I2S has already in static mode, and buffers has cleared to zero.
-                    // To prevent the pulse function from being called back,
-                    // we assume that the buffer is already full.
-                    i2s_sr.remain_time_until_next_pulse = 0;                 // There is no need to fill the current buffer.
-                    i2s_sr.dma.rw_pos                   = DMA_SAMPLE_COUNT;  // The buffer is full.
-                    break;
-                }
-                continue;
-            }
-        }
-        // no pulse data in push buffer (pulse off or idle or callback is not defined)
-        buf[i2s_sr.dma.rw_pos++] = atomic_load(&i2s_sr.port_data);
-        if (i2s_sr.remain_time_until_next_pulse >= I2S_OUT_USEC_PER_PULSE) {
-            i2s_sr.remain_time_until_next_pulse -= I2S_OUT_USEC_PER_PULSE;
-        } else {
-            i2s_sr.remain_time_until_next_pulse = 0;
+    if(ring_gen != i2s_sr.dma.ring_gen) {
+        // The descriptor is part of a rebuilt ring, replace the stale step samples.
+        if(i2s_sr.pulser_status == STEPPING)
+            i2s_clear_dma_buffer(dma_desc, i2s_stream_port_data(&i2s_sr.stream));
+    } else {
+        if(status == WAITING) {
+            // i2s_out_set_passthrough() has called from the pulse function.
+            // It needs to go into pass-through mode.
+            // This DMA descriptor must be a tail of the chain.
+            dma_desc->dw0.suc_eof = 1; //?
+            dma_desc->next = NULL;  // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
         }
+
+        // set filled length to the DMA descriptor
+        dma_desc->dw0.length = i2s_sr.stream.rw_pos * I2S_SAMPLE_SIZE;
     }
-    // set filled length to the DMA descriptor
-    dma_desc->dw0.length = i2s_sr.dma.rw_pos * I2S_SAMPLE_SIZE;
+
+    I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
 //
 // I2S bitstream generator task
 //
 
-static inline void i2s_step_gen (dma_descriptor_t *dma_desc)
+// waiting: number of DMA complete events still queued
+static inline void i2s_step_gen (i2s_out_dma_event_t *event, uint32_t waiting)
 {
-    i2s_sr.dma.current = (uint32_t *)dma_desc->buffer;
+    dma_descriptor_t *dma_desc = event->desc;
+
+    if(event->ring_gen != i2s_sr.dma.ring_gen)
+        return; // The ring has been rebuilt since the event was sent
+
+    i2s_sr.stream.buf = (uint32_t *)dma_desc->buffer;
     // It reuses the oldest (just transferred) buffer with the name "current"
     // and fills the buffer for later DMA.
 
-    I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock pulser status
-
     if (i2s_sr.pulser_status == STEPPING) {
         //
         // Fillout the buffer for pulse
@@ -592,32 +616,42 @@ static inline void i2s_step_gen (dma_descriptor_t *dma_desc)
         // the generation of the buffer is interrupted (the buffer length is shortened slightly)
         // and the pulse generation is postponed until the next buffer is filled.
         //
-        i2s_fillout_dma_buffer(dma_desc);
-        dma_desc->dw0.length = i2s_sr.dma.rw_pos * I2S_SAMPLE_SIZE;
-    } else if (i2s_sr.pulser_status == WAITING) {
-        if (dma_desc->next == NULL) {
-            // Tail of the DMA descriptor found
-            // I2S TX module has already stopped by ISR
-            //i2s_out_stop();
-            //i2s_clear_o_dma_buffers(0);  // 0 for static I2S control mode (right ch. data is always 0)
-            // You need to set the status before calling i2s_out_start()
-            // because the process in i2s_out_start() is different depending on the status.
-            i2s_out_start(PASSTHROUGH);
-        } else {
-            // Processing a buffer slightly ahead of the tail buffer.
-            // We don't need to fill up the buffer by port_data any more.
+#if I2S_OUT_STATS_ENABLE
+        uint32_t fill_start = XTHAL_GET_CCOUNT();
+#endif
+        i2s_fillout_dma_buffer(dma_desc, event->ring_gen);
+#if I2S_OUT_STATS_ENABLE
+        i2s_out_stats_fill(&i2s_out_stats, event->eof_time, fill_start, waiting);
+#endif
+    } else {
+
+        I2S_OUT_PULSER_ENTER_CRITICAL();
+
+        if(event->ring_gen != i2s_sr.dma.ring_gen)
+            ; // Rebuilt by i2s_out_reset() meanwhile
+        else if (i2s_sr.pulser_status == WAITING) {
+            if (dma_desc->next == NULL) {
+                // Tail of the DMA descriptor found
+                // I2S TX module has already stopped by ISR
+                // You need to set the status before calling i2s_out_start()
+                // because the process in i2s_out_start() is different depending on the status.
+                i2s_out_start(PASSTHROUGH);
+            } else {
+                // Processing a buffer slightly ahead of the tail buffer.
+                // We don't need to fill up the buffer by port_data any more.
+                i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
+                i2s_sr.stream.rw_pos = 0;           // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
+                dma_desc->next = NULL;              // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
+            }
+        } else if (i2s_sr.pulser_status == PASSTHROUGH) {
+            // Stepper paused (passthrough state, static I2S control mode)
+            // In the passthrough mode, there is no need to fill the buffer with port_data.
             i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-            i2s_sr.dma.rw_pos = 0;              // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
-            dma_desc->next = NULL;              // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
+            i2s_sr.stream.rw_pos = 0;           // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
         }
-    } else {
-        // Stepper paused (passthrough state, static I2S control mode)
-        // In the passthrough mode, there is no need to fill the buffer with port_data.
-        i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
-        i2s_sr.dma.rw_pos = 0;              // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
-    }
 
-    I2S_OUT_PULSER_EXIT_CRITICAL();  // Unlock pulser status
+        I2S_OUT_PULSER_EXIT_CRITICAL();
+    }
 }
 
 #if I2S_LOCAL_QUEUE
@@ -626,14 +660,15 @@ static inline void IRAM_ATTR i2s_poll (void)
 {
     // Get a DMA complete event from I2S isr
     if(dma_queue.tail != dma_queue.head) {
-        I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock pulser status
+        I2S_OUT_ENTER_CRITICAL();  // Lock queue
 
-        dma_descriptor_t *dma_desc = dma_queue.descr[dma_queue.tail];
+        i2s_out_dma_event_t event = dma_queue.descr[dma_queue.tail];
 
         dma_queue.tail = (dma_queue.tail + 1) & (I2S_LOCAL_QUEUE - 1);
-        I2S_OUT_PULSER_EXIT_CRITICAL();  // Lock pulser status
+        uint32_t waiting = (dma_queue.head - dma_queue.tail) & (I2S_LOCAL_QUEUE - 1);
+        I2S_OUT_EXIT_CRITICAL();  // Unlock queue
 
-        i2s_step_gen(dma_desc);
+        i2s_step_gen(&event, waiting);
     }
 }
 
@@ -655,27 +690,54 @@ static void IRAM_ATTR i2s_poll_dly (sys_state_t state)
 
 static void IRAM_ATTR i2sOutTask (void *parameter)
 {
-    dma_descriptor_t *dma_desc;
+    i2s_out_dma_event_t event;
 
     while(true) {
 
         // Wait a DMA complete event from I2S isr
         // (Blocks until a DMA transfer has completed)
-        xQueueReceive(i2s_sr.dma.queue, &dma_desc, portMAX_DELAY);
-if((uint32_t)dma_desc > 1000)
-        i2s_step_gen(dma_desc);
+        xQueueReceive(i2s_sr.dma.queue, &event, portMAX_DELAY);
+if((uint32_t)event.desc > 1000)
+        i2s_step_gen(&event, uxQueueMessagesWaiting(i2s_sr.dma.queue));
     }
 }
 
 #endif
 
+// Output committed to the DMA ring, the sum of the descriptor lengths.
+static uint32_t IRAM_ATTR i2s_out_committed_us (void)
+{
+    uint32_t length = 0;
+
+    for(int i = 0; i < I2S_OUT_DMABUF_COUNT; i++)
+        length += i2s_sr.dma.desc[i]->dw0.length;
+
+    return length / I2S_SAMPLE_SIZE * I2S_OUT_USEC_PER_PULSE;
+}
+
 //
 // External funtions
 //
-void IRAM_ATTR i2s_out_delay (void)
+#if I2S_OUT_STATS_ENABLE
+
+void i2s_out_get_stats (i2s_out_stats_t *stats, bool reset)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
+    I2S_OUT_ENTER_CRITICAL();
+
+    memcpy(stats, &i2s_out_stats, sizeof(i2s_out_stats_t));
+
+    if(reset) {
+        memset(&i2s_out_stats, 0, sizeof(i2s_out_stats_t));
+        i2s_out_stats.ahead_min = I2S_OUT_DMABUF_COUNT;
+    }
 
+    I2S_OUT_EXIT_CRITICAL();
+}
+
+#endif
+
+void IRAM_ATTR i2s_out_delay (void)
+{
     if (i2s_sr.pulser_status == PASSTHROUGH) {
         // Depending on the timing, it may not be reflected immediately,
         // so wait twice as long just in case.
@@ -683,59 +745,88 @@ void IRAM_ATTR i2s_out_delay (void)
     } else {
         // Just wait until the data now registered in the DMA descripter
         // is reflected in the I2S TX module via FIFO.
-        delay(I2S_OUT_DELAY_MS);
+        delay(i2s_out_committed_us() / 1000 + 1);
     }
+}
 
-    I2S_OUT_PULSER_EXIT_CRITICAL();
+static inline void i2s_out_port_clear (i2s_out_data_t mask)
+{
+    atomic_fetch_and(&i2s_sr.port_data[0], ~(uint32_t)mask);
+#if I2S_STREAM_WORDS == 2
+    atomic_fetch_and(&i2s_sr.port_data[1], ~(uint32_t)(mask >> 32));
+#endif
 }
 
 void IRAM_ATTR i2s_out_write (uint8_t pin, uint8_t val)
 {
     if(val)
-        atomic_fetch_or(&i2s_sr.port_data, bit(pin));
+        atomic_fetch_or(&i2s_sr.port_data[pin >> 5], bit(pin & 0x1F));
     else
-        atomic_fetch_and(&i2s_sr.port_data, ~bit(pin));
+        atomic_fetch_and(&i2s_sr.port_data[pin >> 5], ~bit(pin & 0x1F));
 
     // It needs a lock for access, but I've given up because I need speed.
     // This is not a problem as long as there is no overlap between the status change and digitalWrite().
     if(i2s_sr.pulser_status == PASSTHROUGH) {
-        uint32_t data = atomic_load(&i2s_sr.port_data);
+        i2s_out_data_t data = i2s_stream_port_data(&i2s_sr.stream);
 
-        *(uint32_t *)i2s_sr.dma.idle->buffer = data & ~i2s_sr.step_mask;
+        i2s_stream_put(i2s_sr.dma.idle->buffer, data & ~i2s_sr.step_mask);
     }
 
 //    pd = atomic_load(&i2s_sr.port_data);
 }
 
-void IRAM_ATTR i2s_out_commit (uint8_t pulse, uint8_t delay)
+void IRAM_ATTR i2s_out_write_mask (i2s_out_data_t set, i2s_out_data_t clear)
 {
-    dma_descriptor_t *desc;
+    for(int i = 0; i < I2S_STREAM_WORDS; i++) {
 
-    I2S_OUT_ENTER_CRITICAL();
+        if((uint32_t)clear)
+            atomic_fetch_and(&i2s_sr.port_data[i], ~(uint32_t)clear);
 
-    uint32_t data = atomic_load(&i2s_sr.port_data);
+        if((uint32_t)set)
+            atomic_fetch_or(&i2s_sr.port_data[i], (uint32_t)set);
 
-    desc = i2s_sr.dma.idle_next;
+#if I2S_STREAM_WORDS == 2
+        set >>= 32;
+        clear >>= 32;
+#endif
+    }
 
-    if(delay) do {
-        *(uint32_t *)desc->buffer = data & ~i2s_sr.step_mask;
-        desc = desc->next;
-    } while(--delay);
+    if(i2s_sr.pulser_status == PASSTHROUGH) {
+        i2s_out_data_t data = i2s_stream_port_data(&i2s_sr.stream);
 
-    if(pulse) do {
-        *(uint32_t *)desc->buffer = data;
-        desc = desc->next;
-    } while(--pulse);
+        i2s_stream_put(i2s_sr.dma.idle->buffer, data & ~i2s_sr.step_mask);
+    }
+}
 
-    atomic_fetch_and(&i2s_sr.port_data, ~i2s_sr.step_mask);
-    data = atomic_load(&i2s_sr.port_data);
+void IRAM_ATTR i2s_out_commit (uint8_t pulse, uint8_t delay)
+{
+    dma_descriptor_t *entry;
+    i2s_pass_chain_t *chain;
 
-    *(uint32_t *)desc->buffer = data;
+    if(pulse > I2S_PASS_PULSE_MAX)
+        pulse = I2S_PASS_PULSE_MAX;
+    if(delay > I2S_PASS_DELAY_MAX)
+        delay = I2S_PASS_DELAY_MAX;
+
+    I2S_OUT_ENTER_CRITICAL();
 
-    i2s_sr.dma.idle->next = i2s_sr.dma.idle_next; // restore
-    i2s_sr.dma.idle_next = desc->next;
-    i2s_sr.dma.idle = desc;
-    desc->next = desc;
+    i2s_out_data_t data = i2s_stream_port_data(&i2s_sr.stream);
+
+    chain = &i2s_pass_chain[i2s_sr.dma.pass ^= 1];
+    entry = pulse ? &chain->pulse[I2S_PASS_PULSE_MAX - pulse] : &chain->idle;
+
+    i2s_stream_put(chain->on, data);
+    i2s_out_port_clear(i2s_sr.step_mask);
+    i2s_stream_put(chain->off, data & ~i2s_sr.step_mask);
+    i2s_stream_put(chain->rest, data & ~i2s_sr.step_mask);
+
+    chain->idle.next = &chain->idle;
+    chain->delay[I2S_PASS_DELAY_MAX - 1].next = entry;
+    if(delay)
+        entry = &chain->delay[I2S_PASS_DELAY_MAX - delay];
+
+    i2s_sr.dma.idle->next = entry;
+    i2s_sr.dma.idle = &chain->idle;
 
     gdma_ll_tx_restart(&GDMA, i2s_sr.dma.channel);
 
@@ -744,93 +835,113 @@ void IRAM_ATTR i2s_out_commit (uint8_t pulse, uint8_t delay)
 
 bool IRAM_ATTR i2s_out_state (uint8_t pin)
 {
-    uint32_t port_data = atomic_load(&i2s_sr.port_data);
+    uint32_t port_data = atomic_load(&i2s_sr.port_data[pin >> 5]);
 
-    return !!(port_data & bit(pin));
+    return !!(port_data & bit(pin & 0x1F));
 }
 
 uint32_t IRAM_ATTR i2s_out_push_sample (uint32_t num)
 {
-    if(num > SAMPLE_SAFE_COUNT)
-        return 0;
+    return i2s_stream_push(&i2s_sr.stream, num);
+}
 
-    uint32_t n = num ? num : 1, port_data = atomic_load(&i2s_sr.port_data);
+uint32_t IRAM_ATTR i2s_out_push_pulse (i2s_out_data_t mask, i2s_out_data_t level, uint32_t num)
+{
+    return i2s_stream_push_pulse(&i2s_sr.stream, mask, level, num);
+}
 
-    // push at least one sample (even if num is zero)
-    do {
-        i2s_sr.dma.current[i2s_sr.dma.rw_pos++] = port_data;
-    } while (--n);
+i2s_out_pulser_status_t IRAM_ATTR i2s_out_get_pulser_status (void)
+{
+    return i2s_sr.pulser_status;
+}
 
-    return num;
+void IRAM_ATTR i2s_out_set_passthrough (void)
+{
+    if(i2s_out_pulser_transition(STEPPING, WAITING))  // Start stopping the pulser
+        delay(i2s_out_committed_us() / 1000 + 1);
 }
 
-i2s_out_pulser_status_t IRAM_ATTR i2s_out_get_pulser_status (void)
+void IRAM_ATTR i2s_out_set_stepping (void)
 {
+    if(i2s_sr.pulser_status == STEPPING)
+        return; // Re-entered (fail safe)
+
+    // Wait for complete DMAs
+    while(i2s_sr.pulser_status == WAITING)
+        delay(i2s_sr.dma.samples * I2S_OUT_USEC_PER_PULSE / 1000 + 1);
+
     I2S_OUT_PULSER_ENTER_CRITICAL();
 
-    i2s_out_pulser_status_t s = i2s_sr.pulser_status;
+    if(i2s_sr.pulser_status == PASSTHROUGH)
+        gdma_ll_tx_stop(&GDMA, i2s_sr.dma.channel);
 
-    I2S_OUT_PULSER_EXIT_CRITICAL();
+    // Change I2S to STEPPING
+    i2s_out_start(STEPPING);
 
-    return s;
+    I2S_OUT_PULSER_EXIT_CRITICAL();
 }
 
-void IRAM_ATTR i2s_out_set_passthrough (void)
+uint32_t IRAM_ATTR i2s_out_set_depth (uint32_t usec)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
+    uint32_t samples = usec / I2S_OUT_USEC_PER_PULSE;
 
-    if (i2s_sr.pulser_status == STEPPING) {
-        i2s_sr.pulser_status = WAITING;  // Start stopping the pulser
-        delay(I2S_OUT_DELAY_MS);
-    }
+    i2s_sr.dma.samples = samples < I2S_OUT_MIN_DMABUF_SAMPLES ? I2S_OUT_MIN_DMABUF_SAMPLES : (samples > DMA_SAMPLE_COUNT ? DMA_SAMPLE_COUNT : samples);
 
-    I2S_OUT_PULSER_EXIT_CRITICAL();
+    return i2s_sr.dma.samples * I2S_OUT_USEC_PER_PULSE;
 }
 
-void IRAM_ATTR i2s_out_set_stepping (void)
+uint32_t IRAM_ATTR i2s_out_get_delay_us (void)
 {
-    I2S_OUT_PULSER_ENTER_CRITICAL();
+    return i2s_sr.pulser_status == PASSTHROUGH ? I2S_OUT_USEC_PER_PULSE * 2 : i2s_out_committed_us();
+}
 
-    if (i2s_sr.pulser_status == STEPPING) {
-        // Re-entered (fail safe)
-        I2S_OUT_PULSER_EXIT_CRITICAL();
-        return;
-    }
+// The buffer being filled goes out after the other buffers in the ring.
+// Only callbacks from the bitstream generator are in the stream, other callers get 0.
+// With the local queue the generator is polled from the foreground, so filling is only set in its context.
+uint32_t IRAM_ATTR i2s_out_get_stream_delay_us (void)
+{
+    if(!i2s_sr.stream.filling || i2s_sr.pulser_status != STEPPING || xPortInIsrContext())
+        return 0;
 
-    if(i2s_sr.pulser_status == PASSTHROUGH)
-        gdma_ll_tx_stop(&GDMA, i2s_sr.dma.channel);
+#if !I2S_LOCAL_QUEUE
+    if(xTaskGetCurrentTaskHandle() != i2s_sr.dma.task)
+        return 0;
+#endif
 
-    // Wait for complete DMAs
-    while(i2s_sr.pulser_status == WAITING) {
-        I2S_OUT_PULSER_EXIT_CRITICAL();
-        delay(I2S_OUT_DELAY_DMABUF_MS);
-        I2S_OUT_PULSER_ENTER_CRITICAL();
-    }
+    uint32_t length = 0;
 
-    // Change I2S to STEPPING
-    i2s_out_start(STEPPING);
+    for(int i = 0; i < I2S_OUT_DMABUF_COUNT; i++) {
+        if(i2s_sr.dma.desc[i]->buffer != (void *)i2s_sr.stream.buf)
+            length += i2s_sr.dma.desc[i]->dw0.length;
+    }
 
-    I2S_OUT_PULSER_EXIT_CRITICAL();
+    return (length / I2S_SAMPLE_SIZE + i2s_sr.stream.rw_pos) * I2S_OUT_USEC_PER_PULSE;
 }
 
 void IRAM_ATTR i2s_out_set_pulse_period (uint32_t period)
 {
-    i2s_sr.pulse_period = period;
+    i2s_sr.stream.pulse_period = period;
 }
 
 void IRAM_ATTR i2s_out_set_pulse_callback (i2s_out_pulse_func_t func)
 {
-    i2s_sr.pulse_func = func;
+    i2s_sr.stream.pulse_func = func;
+}
+
+void i2s_out_set_pulse_batch (i2s_out_pulse_batch_func_t func, i2s_out_data_t mask, uint32_t samples)
+{
+    i2s_sr.stream.pulse_batch_func = NULL;
+    i2s_sr.stream.step_mask = mask;
+    i2s_sr.stream.step_samples = samples;
+    i2s_sr.stream.pulse_batch_func = func;
 }
 
 void IRAM_ATTR i2s_out_reset (void)
 {
     I2S_OUT_PULSER_ENTER_CRITICAL();
 
-    if (i2s_sr.pulser_status == STEPPING) {
-        uint32_t port_data = atomic_load(&i2s_sr.port_data);
-        i2s_clear_o_dma_buffers(port_data);
-    }
+    if (i2s_sr.pulser_status == STEPPING)
+        i2s_clear_o_dma_buffers(i2s_stream_port_data(&i2s_sr.stream));
 
     // You need to set the status before calling i2s_out_start()
     // because the process in i2s_out_start() is different depending on the status.
@@ -842,9 +953,9 @@ void IRAM_ATTR i2s_out_reset (void)
 void i2s_set_step_mask (void)
 {
     i2s_sr.initialized = true;
-    i2s_sr.step_mask = atomic_load(&i2s_sr.port_data);
+    i2s_sr.step_mask = i2s_stream_port_data(&i2s_sr.stream);
 
-    atomic_fetch_xor(&i2s_sr.port_data, i2s_sr.step_mask);
+    i2s_out_port_clear(i2s_sr.step_mask);
 
     // Start the I2S peripheral
     i2s_out_start(PASSTHROUGH);
@@ -912,13 +1023,17 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
 
     // Initialize
 
-    atomic_store(&i2s_sr.port_data, init_param.init_val);
+    atomic_store(&i2s_sr.port_data[0], (uint32_t)init_param.init_val);
+#if I2S_STREAM_WORDS == 2
+    atomic_store(&i2s_sr.port_data[1], (uint32_t)(init_param.init_val >> 32));
+#endif
 
     i2s_clear_o_dma_buffers(init_param.init_val);
-    i2s_sr.dma.rw_pos  = 0;
-    i2s_sr.dma.current = NULL;
+    i2s_sr.stream.pulser_status = &i2s_sr.pulser_status;
+    i2s_sr.stream.port_data = i2s_sr.port_data;
+    i2s_stream_reset(&i2s_sr.stream, NULL);
 #if !I2S_LOCAL_QUEUE
-    i2s_sr.dma.queue   = xQueueCreate(I2S_OUT_DMABUF_COUNT, sizeof(uint32_t *));
+    i2s_sr.dma.queue   = xQueueCreate(I2S_OUT_DMABUF_COUNT, sizeof(i2s_out_dma_event_t));
 #endif
 
     i2s_ll_tx_stop(&I2S0);
@@ -942,16 +1057,32 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
 
 #else
 
+#if I2S_OUT_USEC_PER_PULSE == 4 && I2S_OUT_NUM_BITS == 32
+    // fbck = 160 MHz / (2 + 17/20) / 7 (reset value of tx_bck_div_num) = 8 MHz
     i2s_ll_mclk_div_t clk_ = {
          .mclk_div = 2,
          .a = 20,
          .b = 17
     };
+#else
+    // fbck = 160 MHz / (N + b/a) / 2, see I2S_OUT_BCK_KHZ
+    i2s_ll_mclk_div_t clk_ = {
+         .mclk_div = I2S_OUT_CLKM_DIV_X4 / 4,
+         .a = 4,
+         .b = I2S_OUT_CLKM_DIV_X4 % 4
+    };
+#endif
 
     i2s_ll_tx_enable_pdm(&I2S0, false); // Enables TDM
     i2s_ll_rx_set_active_chan_mask(&I2S0, 1);
     i2s_ll_tx_enable_msb_shift(&I2S0, 0);
     i2s_ll_tx_set_sample_bit(&I2S0, 32, 32); // ?
+#if I2S_OUT_NUM_BITS == 64
+    // Two 32-bit TDM slots per frame, one WS pulse (latch) per frame
+    i2s_ll_tx_set_chan_num(&I2S0, 2);
+    i2s_ll_tx_set_active_chan_mask(&I2S0, 0x03);
+    i2s_ll_tx_set_half_sample_bit(&I2S0, 32);
+#endif
     i2s_ll_tx_set_ws_width(&I2S0, 1);
  // I2S0.tx_timing.tx_bck_out_dm = 1;
     I2S0.tx_timing.tx_ws_out_dm = 1;
@@ -965,6 +1096,9 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     i2s_ll_tx_clk_set_src(&I2S0, I2S_CLK_D2CLK); // Set I2S_CLK_D2CLK as default
     i2s_ll_mclk_use_tx_clk(&I2S0);
     i2s_ll_tx_set_clk(&I2S0, &clk_);
+#if I2S_OUT_USEC_PER_PULSE != 4 || I2S_OUT_NUM_BITS == 64
+    i2s_ll_tx_set_bck_div_num(&I2S0, 2);
+#endif
     i2s_ll_tx_enable_clock(&I2S0);
     i2s_ll_tx_reset(&I2S0);
     i2s_ll_tx_reset_fifo(&I2S0);
@@ -981,7 +1115,7 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
 #else
 
     // Create the task that will feed the buffer
-    xTaskCreatePinnedToCore(i2sOutTask, "I2SOutTask",4096, NULL, GRBLHAL_TASK_PRIORITY + 1, NULL, GRBLHAL_TASK_CORE);
+    xTaskCreatePinnedToCore(i2sOutTask, "I2SOutTask",4096, NULL, GRBLHAL_TASK_PRIORITY + 1, &i2s_sr.dma.task, GRBLHAL_TASK_CORE);
 
 #endif
 
@@ -992,8 +1126,8 @@ bool IRAM_ATTR i2s_out_init2 (i2s_out_init_t init_param)
     if((ret = esp_intr_alloc(gdma_periph_signals.groups[0].pairs[i2s_sr.dma.channel].tx_irq_id, 0, i2s_out_intr_handler, NULL, &i2s_sr.dma.intr_handle))) {
 
         // Default pulse callback period (usec)
-        i2s_sr.pulse_period = init_param.pulse_period;
-        i2s_sr.pulse_func   = init_param.pulse_func;
+        i2s_sr.stream.pulse_period = init_param.pulse_period;
+        i2s_sr.stream.pulse_func   = init_param.pulse_func;
 
         // Remember GPIO pin numbers
         i2s_sr.ws_pin   = init_param.ws_pin;
@@ -1017,7 +1151,7 @@ bool IRAM_ATTR i2s_out_init (void)
         .bck_pin      = I2S_OUT_BCK,
         .data_pin     = I2S_OUT_DATA,
         .pulse_func   = NULL,
-        .pulse_period = I2S_OUT_USEC_PER_PULSE,
+        .pulse_period = I2S_STREAM_TICKS_PER_SAMPLE,
         .init_val     = I2S_OUT_INIT_VAL
     };
 
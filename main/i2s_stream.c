@@ -0,0 +1,177 @@
+/*
+
+  i2s_stream.c - I2S bitstream generator for the shift register step outputs
+
+  Target independent, shared by i2s_out.c and i2s_out_s3.c and buildable on a host for benchmarking.
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Sample generation derived from i2s_out.c, 2020 - Michiyasu Odaki (Grbl_ESP32)
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "i2s_stream.h"
+
+// Fill a run of samples with the same value, unrolled.
+static inline void IRAM_ATTR i2s_stream_fill_run (uint32_t *buf, uint32_t n, i2s_out_data_t value)
+{
+#if I2S_STREAM_WORDS == 2
+    while(n--)
+        buf = i2s_stream_put(buf, value);
+#else
+    while(n >= 4) {
+        buf[0] = value;
+        buf[1] = value;
+        buf[2] = value;
+        buf[3] = value;
+        buf += 4;
+        n -= 4;
+    }
+
+    while(n--)
+        *buf++ = value;
+#endif
+}
+
+// Updates the pulse timing after a pulse of length samples.
+static inline void IRAM_ATTR i2s_stream_next_pulse (i2s_stream_t *stream, uint32_t length)
+{
+    uint32_t period = I2S_STREAM_TICKS_PER_SAMPLE * length;
+
+    if(stream->pulse_period >= period)
+        stream->remain_time_until_next_pulse += stream->pulse_period - period;
+    else // too fast!
+        stream->remain_time_until_next_pulse += I2S_STREAM_TICKS_PER_SAMPLE;
+}
+
+// Writes a run of pulses from the batch callback, each pulse is started before end.
+// Returns the number of pulses written, 0 if the pulse callback is to be run.
+static inline uint32_t IRAM_ATTR i2s_stream_batch (i2s_stream_t *stream, i2s_out_pulse_batch_func_t batch_func, uint32_t end)
+{
+    i2s_stream_pulse_t pulses[I2S_STREAM_BATCH_MAX];
+
+    // Pulse i starts less than 1 + i x period samples after the first, the period is
+    // one sample longer than the pulse when too fast.
+    uint32_t period = stream->pulse_period, space = end - stream->rw_pos, max = 1, n, idx, run;
+
+    if(period < I2S_STREAM_TICKS_PER_SAMPLE * stream->step_samples)
+        period = I2S_STREAM_TICKS_PER_SAMPLE * (stream->step_samples + 1);
+
+    if(space > 1 && (max = ((space - 1) * I2S_STREAM_TICKS_PER_SAMPLE - 1) / period + 1) > I2S_STREAM_BATCH_MAX)
+        max = I2S_STREAM_BATCH_MAX;
+
+    if((n = batch_func(pulses, max)) == 0)
+        return 0;
+
+    i2s_out_data_t port_data = i2s_stream_port_data(stream);
+
+    for(idx = 0; idx < n; idx++) {
+
+        if(idx) {
+            run = stream->remain_time_until_next_pulse / I2S_STREAM_TICKS_PER_SAMPLE;
+            i2s_stream_fill_run(&stream->buf[stream->rw_pos * I2S_STREAM_WORDS], run, port_data);
+            stream->rw_pos += run;
+            stream->remain_time_until_next_pulse -= I2S_STREAM_TICKS_PER_SAMPLE * run;
+        }
+
+        if(pulses[idx].step) {
+            i2s_stream_fill_run(&stream->buf[stream->rw_pos * I2S_STREAM_WORDS], stream->step_samples, (port_data & ~stream->step_mask) | pulses[idx].level);
+            stream->rw_pos += stream->step_samples;
+        }
+
+        i2s_stream_next_pulse(stream, pulses[idx].step ? stream->step_samples : 0);
+    }
+
+    return n;
+}
+
+i2s_out_pulser_status_t IRAM_ATTR i2s_stream_fill (i2s_stream_t *stream, uint32_t *buf, uint32_t n_samples)
+{
+    i2s_out_pulse_func_t pulse_func = stream->pulse_func;
+    i2s_out_pulse_batch_func_t batch_func = stream->pulse_batch_func;
+
+    stream->buf = buf;
+    stream->rw_pos = 0;
+    stream->filling = true;
+
+    //
+    // To avoid buffer overflow, all of the maximum pulse width (normally about 10us)
+    // is adjusted to be in a single buffer.
+    // SAMPLE_SAFE_COUNT is referred to as the margin value.
+    // Therefore, if a buffer is close to full and it is time to generate a pulse,
+    // the generation of the buffer is interrupted (the buffer length is shortened slightly)
+    // and the pulse generation is postponed until the next buffer is filled.
+    //
+    while(stream->rw_pos < (n_samples - SAMPLE_SAFE_COUNT)) {
+
+        // pulser status may change in pulse phase func, so it has to be checked every time.
+        bool pulsing = *stream->pulser_status == STEPPING && pulse_func;
+
+        if(stream->remain_time_until_next_pulse < I2S_STREAM_TICKS_PER_SAMPLE && pulsing) {
+
+            // Run of pulses within the current segment, no status change.
+            if(batch_func && i2s_stream_batch(stream, batch_func, n_samples - SAMPLE_SAFE_COUNT))
+                continue;
+
+            uint32_t old_rw_pos = stream->rw_pos;
+
+            pulse_func();           // Insert steps, max SAMPLE_SAFE_COUNT samples.
+
+            // Calculate pulse period.
+            i2s_stream_next_pulse(stream, stream->rw_pos - old_rw_pos);
+
+            if(*stream->pulser_status == PASSTHROUGH) {
+                // i2s_out_reset() has been called during the execution of the pulse function.
+                // I2S is already in static mode and buffers have been cleared to zero.
+                // To prevent the pulse function from being called back,
+                // we assume that the buffer is already full.
+                stream->remain_time_until_next_pulse = 0;   // There is no need to fill the current buffer.
+                stream->rw_pos = n_samples;                 // The buffer is full.
+                break;
+            }
+            continue;
+        }
+
+        // No pulse due (pulse off or idle or callback is not defined), fill the samples up to the next pulse
+        // or the end of the buffer in one go.
+        uint32_t run = (n_samples - SAMPLE_SAFE_COUNT) - stream->rw_pos;
+
+        if(pulsing && stream->remain_time_until_next_pulse / I2S_STREAM_TICKS_PER_SAMPLE < run)
+            run = stream->remain_time_until_next_pulse / I2S_STREAM_TICKS_PER_SAMPLE;
+
+        i2s_stream_fill_run(&buf[stream->rw_pos * I2S_STREAM_WORDS], run, i2s_stream_port_data(stream));
+
+        stream->rw_pos += run;
+
+        if(stream->remain_time_until_next_pulse >= I2S_STREAM_TICKS_PER_SAMPLE * run)
+            stream->remain_time_until_next_pulse -= I2S_STREAM_TICKS_PER_SAMPLE * run;
+        else
+            stream->remain_time_until_next_pulse = 0;
+    }
+
+    stream->filling = false;
+
+    return *stream->pulser_status;
+}
+
+void IRAM_ATTR i2s_stream_reset (i2s_stream_t *stream, uint32_t *buf)
+{
+    stream->buf = buf;
+    stream->rw_pos = 0;
+    stream->remain_time_until_next_pulse = 0;
+}
@@ -0,0 +1,205 @@
+/*
+
+  i2s_stream.h - I2S bitstream generator for the shift register step outputs
+
+  Target independent, shared by i2s_out.c and i2s_out_s3.c and buildable on a host for benchmarking.
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Sample generation derived from i2s_out.c, 2020 - Michiyasu Odaki (Grbl_ESP32)
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _I2S_STREAM_H_
+#define _I2S_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#include "driver.h" // machine configuration, I2S_OUT_USEC_PER_PULSE may be set in my_machine.h
+#else
+#define IRAM_ATTR
+#endif
+
+/* 16-bit mode: 1000000 usec / ((160000000 Hz) / 10 / 2) x 16 bit/pulse x 2(stereo) = 4 usec/pulse */
+/* 32-bit mode: 1000000 usec / ((160000000 Hz) /  5 / 2) x 32 bit/pulse x 2(stereo) = 4 usec/pulse */
+/* 2 and 1 usec/pulse are available when the shift register chain can handle the higher bit clock, see i2s_out.h */
+#ifndef I2S_OUT_USEC_PER_PULSE
+#define I2S_OUT_USEC_PER_PULSE 4
+#endif
+
+#ifndef I2S_OUT_NUM_BITS
+#define I2S_OUT_NUM_BITS 32
+#endif
+
+/*
+  64-bit mode: each sample is two 32-bit words, one per channel (ESP32) or TDM slot (ESP32-S3),
+  and the output value is kept as two 32-bit words so that updates stay lock free.
+  The word holding bits 32 - 63 is shifted out first and drives the chips furthest down the chain.
+*/
+#if I2S_OUT_NUM_BITS == 64
+typedef uint64_t i2s_out_data_t;
+#define I2S_STREAM_WORDS 2
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && CONFIG_IDF_TARGET_ESP32S3
+#define I2S_STREAM_LO_WORD 1    // TDM slot 1, bits 0 - 31
+#else
+#define I2S_STREAM_LO_WORD 0    // Left channel, bits 0 - 31
+#endif
+#else
+typedef uint32_t i2s_out_data_t;
+#define I2S_STREAM_WORDS 1
+#define I2S_STREAM_LO_WORD 0
+#endif
+
+#define I2S_OUT_MAX_STEP_USEC 16    /* longest step pulse, $0 is clamped to this */
+#define I2S_OUT_MAX_DELAY_USEC 8    /* longest step pulse delay, $29 is clamped to this */
+
+/* prevent buffer overrun, the pulse callback may push a step pulse delay and a step pulse */
+#define SAMPLE_SAFE_COUNT ((I2S_OUT_MAX_STEP_USEC + I2S_OUT_MAX_DELAY_USEC) / I2S_OUT_USEC_PER_PULSE - 1)
+
+/* pulse timing is kept in 1/16 usec so that the step rate is not truncated to whole usecs */
+#define I2S_STREAM_TICKS_PER_USEC 16
+#define I2S_STREAM_TICKS_PER_SAMPLE (I2S_OUT_USEC_PER_PULSE * I2S_STREAM_TICKS_PER_USEC)
+
+typedef enum  {
+    PASSTHROUGH = 0,  // Static I2S mode.The i2s_out_write() reflected with very little delay
+    STEPPING,         // Streaming step data.
+    WAITING,          // Waiting for the step DMA completion
+    STOPPED,          // ESP32-S: no output
+} i2s_out_pulser_status_t;
+
+typedef void (*i2s_out_pulse_func_t)(void);
+
+typedef struct {
+    i2s_out_data_t level;   // Step output bits, in step_mask
+    bool step;              // false for a pulse period without a step
+} i2s_stream_pulse_t;
+
+/*
+  Batch callback, run by i2s_stream_fill() when a pulse is due: writes up to max pulses of the current
+  segment to pulses and returns the number written. The pulses are spaced by the pulse period and
+  have no step pulse delay, so none can follow a direction change.
+  Returns 0 when the pulse callback is to be run for the next pulse, e.g. at segment boundaries.
+*/
+typedef uint32_t (*i2s_out_pulse_batch_func_t)(i2s_stream_pulse_t *pulses, uint32_t max);
+
+#define I2S_STREAM_BATCH_MAX 32     /* max pulses per batch callback */
+
+typedef struct {
+    uint32_t *buf;                                      // Buffer being filled, i2s_stream_push() writes here
+    uint32_t rw_pos;                                    // Number of samples in buf
+    uint32_t remain_time_until_next_pulse;              // Time remaining until the next pulse (ticks)
+    volatile uint32_t pulse_period;                     // Pulse callback period (ticks, I2S_STREAM_TICKS_PER_USEC)
+    volatile i2s_out_pulse_func_t pulse_func;           // Pulse callback, pushes the step samples
+    volatile i2s_out_pulse_batch_func_t pulse_batch_func; // Batch callback, optional
+    i2s_out_data_t step_mask;                           // Step output bits for the batch callback pulses
+    uint32_t step_samples;                              // Step pulse length in samples for the batch callback pulses
+    volatile bool filling;                              // Set while i2s_stream_fill() runs, callbacks are in the stream context
+    _Atomic i2s_out_pulser_status_t *pulser_status;     // May be changed by the pulse callback or from another core
+    atomic_uint_least32_t *port_data;                   // Current output value, I2S_STREAM_WORDS words, bits 0 - 31 first
+} i2s_stream_t;
+
+// Returns the current output value.
+static inline i2s_out_data_t IRAM_ATTR i2s_stream_port_data (i2s_stream_t *stream)
+{
+#if I2S_STREAM_WORDS == 2
+    return (i2s_out_data_t)atomic_load(&stream->port_data[0]) | ((i2s_out_data_t)atomic_load(&stream->port_data[1]) << 32);
+#else
+    return atomic_load(stream->port_data);
+#endif
+}
+
+// Writes a sample to buf, returns a pointer to the next sample.
+static inline IRAM_ATTR uint32_t *i2s_stream_put (uint32_t *buf, i2s_out_data_t sample)
+{
+#if I2S_STREAM_WORDS == 2
+    buf[I2S_STREAM_LO_WORD] = (uint32_t)sample;
+    buf[I2S_STREAM_LO_WORD ^ 1] = (uint32_t)(sample >> 32);
+#else
+    *buf = sample;
+#endif
+
+    return buf + I2S_STREAM_WORDS;
+}
+
+/*
+  Fill a DMA buffer with samples while stepping.
+  The pulse callback is run when a pulse is due, or the batch callback for a run of pulses when set,
+  the remaining samples are filled with the current output value.
+  No lock is held, the pulser status is read before each callback.
+  Filling stops SAMPLE_SAFE_COUNT samples before the end of the buffer so that a pulse is never split across buffers.
+  Returns the pulser status after the last callback:
+    STEPPING    - buffer filled, stream->rw_pos samples
+    WAITING     - i2s_out_set_passthrough() was called from the callback, the buffer is to be the tail of the DMA chain
+    PASSTHROUGH - the output was reset from the callback, the buffer is to be considered full
+*/
+i2s_out_pulser_status_t i2s_stream_fill (i2s_stream_t *stream, uint32_t *buf, uint32_t n_samples);
+
+/*
+  Push num samples (at least one) of the current output value to the buffer being filled.
+  Returns the number of samples pushed, 0 if num exceeds SAMPLE_SAFE_COUNT.
+*/
+static inline uint32_t IRAM_ATTR i2s_stream_push (i2s_stream_t *stream, uint32_t num)
+{
+    if(num > SAMPLE_SAFE_COUNT)
+        return 0;
+
+    uint32_t n = num ? num : 1, *buf = &stream->buf[stream->rw_pos * I2S_STREAM_WORDS];
+    i2s_out_data_t port_data = i2s_stream_port_data(stream);
+
+    stream->rw_pos += n;
+
+    // push at least one sample (even if num is zero)
+    do {
+        buf = i2s_stream_put(buf, port_data);
+    } while(--n);
+
+    return num ? num : 1;
+}
+
+/*
+  Push num samples (at least one) of a step pulse: the current output value with the bits in mask replaced by level.
+  The output value is not changed so the pulse ends without a write to it.
+  Returns the number of samples pushed, 0 if num exceeds SAMPLE_SAFE_COUNT.
+*/
+static inline uint32_t IRAM_ATTR i2s_stream_push_pulse (i2s_stream_t *stream, i2s_out_data_t mask, i2s_out_data_t level, uint32_t num)
+{
+    if(num > SAMPLE_SAFE_COUNT)
+        return 0;
+
+    uint32_t n = num ? num : 1, *buf = &stream->buf[stream->rw_pos * I2S_STREAM_WORDS];
+    i2s_out_data_t sample = (i2s_stream_port_data(stream) & ~mask) | level;
+
+    stream->rw_pos += n;
+
+    do {
+        buf = i2s_stream_put(buf, sample);
+    } while(--n);
+
+    return num ? num : 1;
+}
+
+/*
+  Set a new buffer to fill, resets the pulse timing.
+*/
+void i2s_stream_reset (i2s_stream_t *stream, uint32_t *buf);
+
+#endif // _I2S_STREAM_H_
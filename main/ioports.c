@@ -32,6 +32,10 @@
 #include "i2s_out.h"
 #endif
 
+#if USE_I2S_IN
+#include "i2s_in.h"
+#endif
+
 static io_ports_data_t digital;
 static input_signal_t *aux_in;
 static output_signal_t *aux_out;
@@ -44,7 +48,7 @@ static void digital_out (uint8_t port, bool on)
 {
     if(port < digital.out.n_ports) {
         port = ioports_map(digital.out, port);
-        DIGITAL_OUT(aux_out[port].pin, ((settings.ioport.invert_out.mask >> port) & 0x01) ? !on : on);
+        ALIGNED_OUT(aux_out[port].pin, ((settings.ioport.invert_out.mask >> port) & 0x01) ? !on : on);
     }
 }
 
@@ -84,12 +88,11 @@ inline static __attribute__((always_inline)) int32_t get_input (const input_sign
         if(input->cap.irq_mode & irq_mode) {
 
             event_port = NULL;
-            gpio_set_intr_type(input->pin, map_intr_type(irq_mode));
-            gpio_intr_enable(input->pin);
+            INPUT_IRQ_ENABLE(input->pin, irq_mode);
 
             do {
                 if(event_port == input) {
-                    value = gpio_get_level(input->pin) ^ invert;
+                    value = DIGITAL_IN(input->pin) ^ invert;
                     break;
                 }
                 if(delay) {
@@ -101,9 +104,10 @@ inline static __attribute__((always_inline)) int32_t get_input (const input_sign
 
             // Restore pin interrupt status
             if(input->mode.irq_mode == IRQ_Mode_None) {
-                gpio_intr_disable(input->pin);
-            } else
-                gpio_set_intr_type(input->pin, map_intr_type(input->mode.irq_mode));
+                INPUT_IRQ_DISABLE(input->pin);
+            } else {
+                INPUT_IRQ_ENABLE(input->pin, input->mode.irq_mode);
+            }
         }
 
     } else {
@@ -111,8 +115,8 @@ inline static __attribute__((always_inline)) int32_t get_input (const input_sign
         bool wait_for = wait_mode != WaitMode_Low;
 
         do {
-            if((gpio_get_level(input->pin) ^ invert) == wait_for) {
-                value = gpio_get_level(input->pin) ^ invert;
+            if((DIGITAL_IN(input->pin) ^ invert) == wait_for) {
+                value = DIGITAL_IN(input->pin) ^ invert;
                 break;
             }
             if(delay) {
@@ -138,6 +142,14 @@ IRAM_ATTR static int32_t wait_on_input (io_port_type_t type, uint8_t port, wait_
     return value;
 }
 
+// Returns the state of a digital input with inversion applied, for use from interrupt context.
+IRAM_ATTR bool ioports_get_state (uint8_t port)
+{
+    port = ioports_map(digital.in, port);
+
+    return port < digital.in.n_ports && (DIGITAL_IN(aux_in[port].pin) ^ ((settings.ioport.invert_in.mask >> port) & 0x01));
+}
+
 IRAM_ATTR void ioports_event (input_signal_t *input)
 {
     spin_lock = true;
@@ -168,13 +180,12 @@ static bool register_interrupt_handler (uint8_t port, pin_irq_mode_t irq_mode, i
         if((ok = (irq_mode & input->cap.irq_mode) == irq_mode && interrupt_callback != NULL)) {
             input->mode.irq_mode = irq_mode;
             input->interrupt_callback = interrupt_callback;
-            gpio_set_intr_type(input->pin, map_intr_type(input->mode.irq_mode));
-            gpio_intr_enable(input->pin);
+            INPUT_IRQ_ENABLE(input->pin, input->mode.irq_mode);
         }
 
         if(irq_mode == IRQ_Mode_None || !ok) {
             while(spin_lock);
-            gpio_intr_disable(input->pin);     // Disable pin interrupt
+            INPUT_IRQ_DISABLE(input->pin);     // Disable pin interrupt
             input->mode.irq_mode = IRQ_Mode_None;
             input->interrupt_callback = NULL;
         }
@@ -0,0 +1,154 @@
+/*
+  isr_stats.c - step timer and GPIO interrupt latency and execution time statistics
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "driver.h"
+
+#if ISR_STATS_ENABLE
+
+#include <string.h>
+
+#include "isr_stats.h"
+
+#include "grbl/system.h"
+#include "grbl/nuts_bolts.h"
+
+isr_stats_t isr_stats[IsrStats_N];
+uint32_t isr_stats_step_timer_cycles = 1;
+
+static float cpu_mhz;
+static portMUX_TYPE isr_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const isr_name[IsrStats_N] = {
+    [IsrStats_Step] = "STEP",
+    [IsrStats_GPIO] = "GPIO"
+};
+
+static void isr_stats_reset (void)
+{
+    uint_fast8_t idx;
+
+    portENTER_CRITICAL(&isr_stats_mux);
+
+    memset(isr_stats, 0, sizeof(isr_stats));
+    for(idx = 0; idx < IsrStats_N; idx++)
+        isr_stats[idx].latency_min = UINT32_MAX;
+
+    portEXIT_CRITICAL(&isr_stats_mux);
+}
+
+static char *cycles_to_us (uint32_t cycles)
+{
+    return ftoa((float)cycles / cpu_mhz, 2);
+}
+
+static void report_histogram (const char *name, const char *type, uint32_t *buckets)
+{
+    uint_fast8_t idx;
+
+    hal.stream.write("[ISRSTATS:");
+    hal.stream.write(name);
+    hal.stream.write(type);
+    for(idx = 0; idx < ISR_STATS_BUCKETS; idx++) {
+        hal.stream.write(idx ? "," : "|");
+        hal.stream.write(uitoa(buckets[idx]));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// $ISRSTATS - report, $ISRSTATS=R - reset
+static status_code_t isr_stats_command (sys_state_t state, char *args)
+{
+    if(args) {
+        if(!(strlen(args) == 1 && CAPS(*args) == 'R'))
+            return Status_InvalidStatement;
+
+        isr_stats_reset();
+
+        return Status_OK;
+    }
+
+    uint_fast8_t idx;
+    isr_stats_t stats[IsrStats_N];
+
+    portENTER_CRITICAL(&isr_stats_mux);
+    memcpy(stats, isr_stats, sizeof(isr_stats));
+    portEXIT_CRITICAL(&isr_stats_mux);
+
+    // Bucket upper bounds
+    hal.stream.write("[ISRSTATS:BUCKETS US");
+    for(idx = 0; idx < ISR_STATS_BUCKETS; idx++) {
+        hal.stream.write(idx ? "," : "|");
+        hal.stream.write(idx == ISR_STATS_BUCKETS - 1 ? "inf" : cycles_to_us((1UL << idx) - 1));
+    }
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < IsrStats_N; idx++) {
+
+        hal.stream.write("[ISRSTATS:");
+        hal.stream.write(isr_name[idx]);
+        hal.stream.write("|");
+        hal.stream.write(uitoa(stats[idx].count));
+        hal.stream.write("|");
+        hal.stream.write(cycles_to_us(stats[idx].exec_max));
+        if(stats[idx].latency_min != UINT32_MAX) {
+            hal.stream.write("|");
+            hal.stream.write(cycles_to_us(stats[idx].latency_min));
+            hal.stream.write(",");
+            hal.stream.write(cycles_to_us(stats[idx].latency_max));
+            hal.stream.write(",");
+            hal.stream.write(cycles_to_us(stats[idx].latency_max - stats[idx].latency_min));
+        }
+        hal.stream.write("]" ASCII_EOL);
+
+        report_histogram(isr_name[idx], " EXEC", stats[idx].exec);
+        if(stats[idx].latency_min != UINT32_MAX)
+            report_histogram(isr_name[idx], " LATENCY", stats[idx].latency);
+    }
+
+    return Status_OK;
+}
+
+static const sys_command_t isr_stats_command_list[] = {
+    { .command = "ISRSTATS", .execute = isr_stats_command }
+};
+
+static sys_commands_t isr_stats_commands = {
+    .n_commands = sizeof(isr_stats_command_list) / sizeof(sys_command_t),
+    .commands = isr_stats_command_list
+};
+
+static sys_commands_t *isr_stats_get_commands (void)
+{
+    return &isr_stats_commands;
+}
+
+void isr_stats_init (void)
+{
+    cpu_mhz = (float)hal.f_mcu;
+    isr_stats_step_timer_cycles = (hal.f_mcu * 1000000UL) / hal.f_step_timer;
+
+    isr_stats_reset();
+
+    isr_stats_commands.on_get_commands = grbl.on_get_commands;
+    grbl.on_get_commands = isr_stats_get_commands;
+}
+
+#endif // ISR_STATS_ENABLE
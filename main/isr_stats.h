@@ -0,0 +1,78 @@
+/*
+  isr_stats.h - step timer and GPIO interrupt latency and execution time statistics
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ISR_STATS_H_
+#define _ISR_STATS_H_
+
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "xtensa/core-macros.h"
+
+#define ISR_STATS_BUCKETS 16 // log2 buckets, bucket n holds values in the range 2^(n-1) to 2^n - 1 CPU cycles
+
+typedef enum {
+    IsrStats_Step = 0,
+    IsrStats_GPIO,
+    IsrStats_N
+} isr_stats_id_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint32_t exec_max;
+    uint32_t latency[ISR_STATS_BUCKETS];
+    uint32_t exec[ISR_STATS_BUCKETS];
+} isr_stats_t;
+
+extern isr_stats_t isr_stats[IsrStats_N];
+extern uint32_t isr_stats_step_timer_cycles; // CPU cycles per step timer tick
+
+inline __attribute__((always_inline)) IRAM_ATTR static uint32_t isr_stats_bucket (uint32_t cycles)
+{
+    uint32_t bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
+
+    return bucket < ISR_STATS_BUCKETS ? bucket : ISR_STATS_BUCKETS - 1;
+}
+
+// Adds a sample, latency and exec are in CPU cycles. Pass UINT32_MAX as latency when not known.
+inline __attribute__((always_inline)) IRAM_ATTR static void isr_stats_add (isr_stats_id_t id, uint32_t latency, uint32_t exec)
+{
+    isr_stats_t *stats = &isr_stats[id];
+
+    stats->count++;
+    stats->exec[isr_stats_bucket(exec)]++;
+    if(exec > stats->exec_max)
+        stats->exec_max = exec;
+
+    if(latency != UINT32_MAX) {
+        stats->latency[isr_stats_bucket(latency)]++;
+        if(latency < stats->latency_min)
+            stats->latency_min = latency;
+        if(latency > stats->latency_max)
+            stats->latency_max = latency;
+    }
+}
+
+void isr_stats_init (void);
+
+#endif // _ISR_STATS_H_
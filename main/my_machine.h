@@ -83,6 +83,25 @@
 #define ESTOP_ENABLE            0 // When enabled only real-time report requests will be executed when the reset pin is asserted.
                                     // NOTE: if left commented out the default setting is determined from COMPATIBILITY_LEVEL.
 //#define PROBE_ENABLE            0 // Uncomment to disable probe input.
+//#define STEP_BURST_ENABLE       1 // ESP32-S3 RMT stepping only: output constant rate single axis step runs as RMT pulse trains.
+//#define STEP_QUEUE_ENABLE       1 // RMT stepping only: run the core stepper callback in a task feeding a step event queue output by the step timer ISR.
+//#define ISR_STATS_ENABLE        1 // Step timer and GPIO interrupt latency/execution time histograms, report with $ISRSTATS, reset with $ISRSTATS=R.
+//#define I2S_OUT_STATS_ENABLE    1 // I2S shift register boards: step stream underrun and refill statistics, report with $I2SSTATS, reset with $I2SSTATS=R.
+                                    // Underruns are also added to the real time report as |I2S:<underruns>,<min buffers ahead>,<max refill latency us>,<max fill time us>.
+//#define I2S_OUT_ALIGNED_OUTPUTS 1 // I2S shift register boards: delay GPIO spindle, coolant and aux outputs and spindle PWM changed while stepping by the I2S output latency
+                                    // so that they switch in step with the motion. Laser mode then no longer forces passthrough mode.
+//#define I2S_OUT_PULSE_BATCH     0 // I2S shift register boards: disable batched step generation within a segment, the core stepper callback is then run for every step.
+//#define I2S_OUT_STEP_MODE       0 // I2S shift register boards: default for the I2S step mode setting ($798), 0: auto, 1: passthrough, 2: streaming (default).
+//#define DEBOUNCE_LIMIT_US    2000 // Software debounce window for limit inputs in microseconds, default 32 ms. Shorten only for switches with clean edges.
+//#define DEBOUNCE_CONTROL_US 32000 // Software debounce window for control inputs in microseconds, default 32 ms.
+//#define DEBOUNCE_GLITCH_FILTER  1 // ESP32-S3: enable the GPIO hardware glitch filter for control and limit inputs.
+//#define PCNT_ENCODER_ENABLE     1 // Quadrature encoder position verification, raises a motor fault alarm on excessive following error.
+                                    // Encoder inputs are assigned by <axis>_ENCODER_A_PIN and <axis>_ENCODER_B_PIN in the board map.
+//#define I2S_OUT_USEC_PER_PULSE  2 // I2S shift register boards: sample period in microseconds, 4 (default) or 2. Shorter periods raise the max step rate
+                                    // and the bit clock, check I2S_OUT_MAX_BCK_KHZ (default 20000) against the shift register chain.
+                                    // 2 requires I2S_OUT_NUM_BITS 16 on the ESP32. The ESP32-S3 also supports 1 with I2S_OUT_NUM_BITS 16.
+//#define I2S_OUT_SHALLOW_DMABUF_USEC 100 // I2S shift register boards: DMA buffer time in microseconds used below I2S_OUT_DEEP_STREAM_RATE, default 100 us.
+//#define I2S_OUT_DEEP_STREAM_RATE 20000 // I2S shift register boards: step rate (steps/s) from where motion is streamed from deep DMA buffers, default 20000.
 
 // Optional control signals:
 // These will be assigned to aux input pins. Use the $pins command to check which pins are assigned.
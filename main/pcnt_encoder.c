@@ -0,0 +1,279 @@
+/*
+
+  pcnt_encoder.c - driver code for Espressif ESP32 processor
+
+  Quadrature encoder position verification via the PCNT peripheral
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  Each axis with X_ENCODER_A_PIN and X_ENCODER_B_PIN (Y_, Z_, ...) defined in the board map gets a PCNT unit
+  counting the quadrature signal in hardware. The count is periodically compared to the commanded position
+  (sys.position) and a motor fault is signalled via hal.control.interrupt_callback() when the difference exceeds
+  PCNT_ENCODER_MAX_ERROR steps. Encoders are synced to the commanded position on startup and when leaving
+  the homing and alarm states.
+  NOTE: the commanded position is one step timer tick ahead of the step outputs, more with step bursts
+        or the step event queue enabled. PCNT_ENCODER_MAX_ERROR has to cover that.
+*/
+
+#include "driver.h"
+
+#if PCNT_ENCODER_ENABLE
+
+#include <math.h>
+#include <string.h>
+
+#include "driver/pcnt.h"
+
+#include "pcnt_encoder.h"
+
+#include "grbl/protocol.h"
+#include "grbl/state_machine.h"
+
+#define PCNT_ENCODER_LIMIT 16384 // Counter is reset and accumulated on reaching +/- this value
+
+#ifndef X_ENCODER_STEPS_PER_COUNT
+#define X_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+#ifndef Y_ENCODER_STEPS_PER_COUNT
+#define Y_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+#ifndef Z_ENCODER_STEPS_PER_COUNT
+#define Z_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+#ifndef A_ENCODER_STEPS_PER_COUNT
+#define A_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+#ifndef B_ENCODER_STEPS_PER_COUNT
+#define B_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+#ifndef C_ENCODER_STEPS_PER_COUNT
+#define C_ENCODER_STEPS_PER_COUNT PCNT_ENCODER_STEPS_PER_COUNT
+#endif
+
+typedef struct {
+    uint8_t axis;
+    pcnt_unit_t unit;
+    uint8_t pin_a;
+    uint8_t pin_b;
+    float steps_per_count;
+    volatile int32_t accumulated;   // Counts at counter limit events
+    int32_t offset;                 // Commanded position - encoder position in steps at last sync
+} pcnt_encoder_t;
+
+static pcnt_encoder_t encoders[] = {
+#if defined(X_ENCODER_A_PIN) && defined(X_ENCODER_B_PIN)
+    { .axis = X_AXIS, .pin_a = X_ENCODER_A_PIN, .pin_b = X_ENCODER_B_PIN, .steps_per_count = X_ENCODER_STEPS_PER_COUNT },
+#endif
+#if defined(Y_ENCODER_A_PIN) && defined(Y_ENCODER_B_PIN)
+    { .axis = Y_AXIS, .pin_a = Y_ENCODER_A_PIN, .pin_b = Y_ENCODER_B_PIN, .steps_per_count = Y_ENCODER_STEPS_PER_COUNT },
+#endif
+#if defined(Z_ENCODER_A_PIN) && defined(Z_ENCODER_B_PIN)
+    { .axis = Z_AXIS, .pin_a = Z_ENCODER_A_PIN, .pin_b = Z_ENCODER_B_PIN, .steps_per_count = Z_ENCODER_STEPS_PER_COUNT },
+#endif
+#if defined(A_AXIS) && defined(A_ENCODER_A_PIN) && defined(A_ENCODER_B_PIN)
+    { .axis = A_AXIS, .pin_a = A_ENCODER_A_PIN, .pin_b = A_ENCODER_B_PIN, .steps_per_count = A_ENCODER_STEPS_PER_COUNT },
+#endif
+#if defined(B_AXIS) && defined(B_ENCODER_A_PIN) && defined(B_ENCODER_B_PIN)
+    { .axis = B_AXIS, .pin_a = B_ENCODER_A_PIN, .pin_b = B_ENCODER_B_PIN, .steps_per_count = B_ENCODER_STEPS_PER_COUNT },
+#endif
+#if defined(C_AXIS) && defined(C_ENCODER_A_PIN) && defined(C_ENCODER_B_PIN)
+    { .axis = C_AXIS, .pin_a = C_ENCODER_A_PIN, .pin_b = C_ENCODER_B_PIN, .steps_per_count = C_ENCODER_STEPS_PER_COUNT },
+#endif
+};
+
+#define N_ENCODERS (sizeof(encoders) / sizeof(pcnt_encoder_t))
+
+static bool fault = false;
+static uint32_t next_check = 0;
+static on_execute_realtime_ptr on_execute_realtime;
+static on_state_change_ptr on_state_change;
+static on_report_options_ptr on_report_options;
+
+IRAM_ATTR static void pcnt_encoder_isr (void *arg)
+{
+    uint32_t status;
+    pcnt_encoder_t *encoder = (pcnt_encoder_t *)arg;
+
+    pcnt_get_event_status(encoder->unit, &status);
+
+    if(status & PCNT_EVT_H_LIM)
+        encoder->accumulated += PCNT_ENCODER_LIMIT;
+    else if(status & PCNT_EVT_L_LIM)
+        encoder->accumulated -= PCNT_ENCODER_LIMIT;
+}
+
+// Returns the encoder position in counts.
+static int32_t pcnt_encoder_get_count (pcnt_encoder_t *encoder)
+{
+    int16_t count;
+    int32_t accumulated;
+
+    // Reread if a counter limit event occured in between.
+    do {
+        accumulated = encoder->accumulated;
+        pcnt_get_counter_value(encoder->unit, &count);
+    } while(accumulated != encoder->accumulated);
+
+    return accumulated + count;
+}
+
+// Returns the encoder position in steps.
+static inline int32_t pcnt_encoder_get_steps (pcnt_encoder_t *encoder)
+{
+    return lroundf((float)pcnt_encoder_get_count(encoder) * encoder->steps_per_count);
+}
+
+static void pcnt_encoder_sync (void)
+{
+    uint_fast8_t idx = N_ENCODERS;
+
+    do {
+        idx--;
+        encoders[idx].offset = sys.position[encoders[idx].axis] - pcnt_encoder_get_steps(&encoders[idx]);
+    } while(idx);
+
+    fault = false;
+}
+
+static void pcnt_encoder_check (void)
+{
+    int32_t error;
+    uint_fast8_t idx = N_ENCODERS;
+
+    do {
+        idx--;
+        error = sys.position[encoders[idx].axis] - encoders[idx].offset - pcnt_encoder_get_steps(&encoders[idx]);
+        if(error > PCNT_ENCODER_MAX_ERROR || error < -PCNT_ENCODER_MAX_ERROR) {
+            control_signals_t signals = hal.control.get_state();
+            fault = signals.motor_fault = On;
+            hal.control.interrupt_callback(signals);
+            break;
+        }
+    } while(idx);
+}
+
+static void pcnt_encoder_poll (sys_state_t state)
+{
+    on_execute_realtime(state);
+
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(!fault && (int32_t)(ms - next_check) >= 0 && !(state & (STATE_HOMING|STATE_ALARM|STATE_ESTOP))) {
+        next_check = ms + PCNT_ENCODER_CHECK_INTERVAL;
+        pcnt_encoder_check();
+    }
+}
+
+static void pcnt_encoder_state_changed (sys_state_t state)
+{
+    static sys_state_t last_state = STATE_IDLE;
+
+    if(state == STATE_IDLE && (last_state & (STATE_HOMING|STATE_ALARM|STATE_ESTOP)))
+        pcnt_encoder_sync();
+
+    last_state = state;
+
+    if(on_state_change)
+        on_state_change(state);
+}
+
+static void pcnt_encoder_report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt)
+        hal.stream.write("[PLUGIN:PCNT encoders v0.01]" ASCII_EOL);
+}
+
+static bool pcnt_encoder_config (pcnt_encoder_t *encoder, pcnt_unit_t unit)
+{
+    pcnt_config_t config = {
+        .unit = unit,
+        .channel = PCNT_CHANNEL_0,
+        .pulse_gpio_num = encoder->pin_a,
+        .ctrl_gpio_num = encoder->pin_b,
+        .pos_mode = PCNT_COUNT_DEC,
+        .neg_mode = PCNT_COUNT_INC,
+        .lctrl_mode = PCNT_MODE_REVERSE,
+        .hctrl_mode = PCNT_MODE_KEEP,
+        .counter_h_lim = PCNT_ENCODER_LIMIT,
+        .counter_l_lim = -PCNT_ENCODER_LIMIT
+    };
+
+    encoder->unit = unit;
+
+    if(pcnt_unit_config(&config) != ESP_OK)
+        return false;
+
+    // Second channel with the signals swapped for x4 decoding.
+    config.channel = PCNT_CHANNEL_1;
+    config.pulse_gpio_num = encoder->pin_b;
+    config.ctrl_gpio_num = encoder->pin_a;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DEC;
+
+    if(pcnt_unit_config(&config) != ESP_OK)
+        return false;
+
+    pcnt_set_filter_value(unit, PCNT_ENCODER_FILTER);
+    pcnt_filter_enable(unit);
+
+    pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+    pcnt_event_enable(unit, PCNT_EVT_L_LIM);
+
+    pcnt_counter_pause(unit);
+    pcnt_counter_clear(unit);
+
+    pcnt_isr_handler_add(unit, pcnt_encoder_isr, encoder);
+    pcnt_intr_enable(unit);
+
+    return pcnt_counter_resume(unit) == ESP_OK;
+}
+
+bool pcnt_encoder_init (void)
+{
+    uint_fast8_t idx;
+
+    if(N_ENCODERS == 0 || N_ENCODERS > PCNT_UNIT_MAX || pcnt_isr_service_install(0) != ESP_OK)
+        return false;
+
+    for(idx = 0; idx < N_ENCODERS; idx++) {
+        if(!pcnt_encoder_config(&encoders[idx], (pcnt_unit_t)idx))
+            return false;
+    }
+
+    pcnt_encoder_sync();
+
+    hal.signals_cap.motor_fault = On;
+
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = pcnt_encoder_poll;
+
+    on_state_change = grbl.on_state_change;
+    grbl.on_state_change = pcnt_encoder_state_changed;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = pcnt_encoder_report_options;
+
+    return true;
+}
+
+#endif // PCNT_ENCODER_ENABLE
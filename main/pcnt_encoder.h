@@ -0,0 +1,46 @@
+/*
+
+  pcnt_encoder.h - driver code for Espressif ESP32 processor
+
+  Quadrature encoder position verification via the PCNT peripheral
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _PCNT_ENCODER_H_
+#define _PCNT_ENCODER_H_
+
+#include "driver.h"
+
+#ifndef PCNT_ENCODER_STEPS_PER_COUNT
+#define PCNT_ENCODER_STEPS_PER_COUNT 1.0f   // Motor steps per encoder count (x4 quadrature decoding), negate to reverse direction.
+#endif
+#ifndef PCNT_ENCODER_MAX_ERROR
+#define PCNT_ENCODER_MAX_ERROR 50           // Max following error in steps before a motor fault alarm is raised.
+#endif
+#ifndef PCNT_ENCODER_CHECK_INTERVAL
+#define PCNT_ENCODER_CHECK_INTERVAL 2       // ms
+#endif
+#ifndef PCNT_ENCODER_FILTER
+#define PCNT_ENCODER_FILTER 100             // Glitch filter, APB clock cycles (max 1023).
+#endif
+
+bool pcnt_encoder_init (void);
+
+#endif // _PCNT_ENCODER_H_
@@ -0,0 +1,806 @@
+/*
+  step_out.h - step and direction outputs of the step timer ISR and the I2S bitstream generator
+
+  Part of grblHAL driver for ESP32
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Not a standalone header: the step paths are included once by driver.c, after the machine configuration
+  and the step burst and probe definitions, and by the host build of tools/stepsim against mock TIMERG0, GPIO,
+  RMT and I2S output layers. Keep them free of other driver.c dependencies so that the simulator runs this code.
+*/
+
+// Sets up stepper driver interrupt timeout
+IRAM_ATTR static void stepperCyclesPerTick (uint32_t cycles_per_tick)
+{
+#if STEP_BURST_ENABLE
+    burst.cycles_per_tick = cycles_per_tick;
+    if(burst.capture)
+        return;
+#endif
+
+// Limit min steps/s to about 2 (hal.f_step_timer @ 20MHz)
+#if CONFIG_IDF_TARGET_ESP32S3
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarmlo.val = cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL;
+  #else
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarmlo.val = cycles_per_tick < (1UL << 23) ? cycles_per_tick : (1UL << 23) - 1UL;
+  #endif
+#else
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low = cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL;
+  #else
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low = cycles_per_tick < (1UL << 23) ? cycles_per_tick : (1UL << 23) - 1UL;
+  #endif
+#endif
+}
+
+/*** Step/dir output maps ***/
+
+// Output levels for all combinations of axis bits, compiled from the pin assignments
+// and the invert settings by output_maps_init(). Each update of the step or dir outputs
+// is then at most a set and a clear register write per GPIO bank (and the I2S port data).
+
+#define AXES_COMBINATIONS (1 << N_AXIS)
+
+typedef struct {
+    uint32_t out;   // GPIO 0 - 31
+    uint32_t out1;  // GPIO 32 and up
+#if USE_I2S_OUT
+    i2s_out_data_t i2s; // I2S expanded outputs
+#endif
+} out_mask_t;
+
+typedef struct {
+    out_mask_t pins;                        // All pins in the map
+    out_mask_t level[AXES_COMBINATIONS];    // Pins to be set high, indexed by axis bits
+} out_map_t;
+
+static out_map_t dir_map;
+#if USE_I2S_OUT
+static out_map_t step_map;
+#ifdef SQUARING_ENABLED
+static out_map_t step_map_2;
+#endif
+#endif
+
+static void out_mask_add (out_mask_t *mask, uint8_t pin)
+{
+#if USE_I2S_OUT
+    if(pin >= I2S_OUT_PIN_BASE)
+        mask->i2s |= (i2s_out_data_t)1 << (pin - I2S_OUT_PIN_BASE);
+    else
+#endif
+    if(pin < 32)
+        mask->out |= 1UL << pin;
+    else
+        mask->out1 |= 1UL << (pin - 32);
+}
+
+static void out_map_add (out_map_t *map, uint8_t pin, uint_fast8_t axis, bool invert)
+{
+    uint_fast8_t idx;
+
+    out_mask_add(&map->pins, pin);
+
+    for(idx = 0; idx < AXES_COMBINATIONS; idx++) {
+        if(!!(idx & bit(axis)) != invert)
+            out_mask_add(&map->level[idx], pin);
+    }
+}
+
+static void output_maps_init (settings_t *settings)
+{
+    axes_signals_t dir_invert = settings->steppers.dir_invert;
+
+    memset(&dir_map, 0, sizeof(out_map_t));
+
+    out_map_add(&dir_map, X_DIRECTION_PIN, X_AXIS, dir_invert.x);
+    out_map_add(&dir_map, Y_DIRECTION_PIN, Y_AXIS, dir_invert.y);
+#ifdef Z_DIRECTION_PIN
+    out_map_add(&dir_map, Z_DIRECTION_PIN, Z_AXIS, dir_invert.z);
+#endif
+#ifdef A_AXIS
+    out_map_add(&dir_map, A_DIRECTION_PIN, A_AXIS, dir_invert.a);
+#endif
+#ifdef B_AXIS
+    out_map_add(&dir_map, B_DIRECTION_PIN, B_AXIS, dir_invert.b);
+#endif
+#ifdef C_AXIS
+    out_map_add(&dir_map, C_DIRECTION_PIN, C_AXIS, dir_invert.c);
+#endif
+#ifdef GANGING_ENABLED
+    dir_invert.mask ^= settings->steppers.ganged_dir_invert.mask;
+  #ifdef X2_DIRECTION_PIN
+    out_map_add(&dir_map, X2_DIRECTION_PIN, X_AXIS, dir_invert.x);
+  #endif
+  #ifdef Y2_DIRECTION_PIN
+    out_map_add(&dir_map, Y2_DIRECTION_PIN, Y_AXIS, dir_invert.y);
+  #endif
+  #ifdef Z2_DIRECTION_PIN
+    out_map_add(&dir_map, Z2_DIRECTION_PIN, Z_AXIS, dir_invert.z);
+  #endif
+#endif
+
+#if USE_I2S_OUT
+
+    axes_signals_t step_invert = settings->steppers.step_invert;
+    out_map_t *map_2 = &step_map;
+
+    memset(&step_map, 0, sizeof(out_map_t));
+#ifdef SQUARING_ENABLED
+    memset(&step_map_2, 0, sizeof(out_map_t));
+    map_2 = &step_map_2;
+#endif
+
+    out_map_add(&step_map, X_STEP_PIN, X_AXIS, step_invert.x);
+    out_map_add(&step_map, Y_STEP_PIN, Y_AXIS, step_invert.y);
+#ifdef Z_STEP_PIN
+    out_map_add(&step_map, Z_STEP_PIN, Z_AXIS, step_invert.z);
+#endif
+#ifdef A_AXIS
+    out_map_add(&step_map, A_STEP_PIN, A_AXIS, step_invert.a);
+#endif
+#ifdef B_AXIS
+    out_map_add(&step_map, B_STEP_PIN, B_AXIS, step_invert.b);
+#endif
+#ifdef C_AXIS
+    out_map_add(&step_map, C_STEP_PIN, C_AXIS, step_invert.c);
+#endif
+#ifdef X2_STEP_PIN
+    out_map_add(map_2, X2_STEP_PIN, X_AXIS, step_invert.x);
+#endif
+#ifdef Y2_STEP_PIN
+    out_map_add(map_2, Y2_STEP_PIN, Y_AXIS, step_invert.y);
+#endif
+#ifdef Z2_STEP_PIN
+    out_map_add(map_2, Z2_STEP_PIN, Z_AXIS, step_invert.z);
+#endif
+
+#endif // USE_I2S_OUT
+}
+
+inline __attribute__((always_inline)) IRAM_ATTR static void out_map_write (const out_mask_t *pins, const out_mask_t *level)
+{
+    if(pins->out) {
+        GPIO.out_w1ts = level->out;
+        GPIO.out_w1tc = pins->out ^ level->out;
+    }
+    if(pins->out1) {
+        GPIO.out1_w1ts.val = level->out1;
+        GPIO.out1_w1tc.val = pins->out1 ^ level->out1;
+    }
+#if USE_I2S_OUT
+    if(pins->i2s)
+        i2s_out_write_mask(level->i2s, pins->i2s ^ level->i2s);
+#endif
+}
+
+// Set stepper direction output pins
+// NOTE: see note for set_step_outputs()
+inline IRAM_ATTR static void set_dir_outputs (axes_signals_t dir_outbits)
+{
+    out_map_write(&dir_map.pins, &dir_map.level[dir_outbits.mask & AXES_BITMASK]);
+}
+
+#ifdef SQUARING_ENABLED
+static axes_signals_t motors_1 = {AXES_BITMASK}, motors_2 = {AXES_BITMASK};
+#endif
+
+#if USE_I2S_OUT
+
+static uint32_t i2s_step_length = I2S_OUT_USEC_PER_PULSE, i2s_delay_length = I2S_OUT_USEC_PER_PULSE, i2s_delay_samples = 1, i2s_step_samples = 1;
+static bool i2s_step_direct = false, i2s_deep_buffers = false;
+#define I2S_OUT_BATCH (I2S_OUT_PULSE_BATCH && !ENABLE_BACKLASH_COMPENSATION) // Only the core knows which steps are backlash steps, not added to the position
+#if I2S_OUT_BATCH
+static stepper_t *i2s_stepper = NULL;   // Core stepper data, for I2SStepperPulseBatch()
+#endif
+
+// Set stepper pulse output pins
+inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits_1);
+// Push a step pulse to the I2S stream
+inline __attribute__((always_inline)) IRAM_ATTR static void i2s_push_step_pulse (axes_signals_t step_outbits_1);
+
+#if !CONFIG_IDF_TARGET_ESP32S3
+
+// Passthrough mode pulse timing: the step pulse is ended, or started when the direction setup delay
+// has elapsed, from a one-shot alarm of the second timer in the step timer group.
+// A step arriving before the previous pulse has completed is held and output after it, with the
+// direction setup delay as the minimum low time.
+
+#define PULSE_TIMER_INDEX TIMER_1
+
+typedef struct {
+    bool pending;
+    bool dir_change;
+    axes_signals_t dir_outbits;
+    axes_signals_t step_outbits;
+} pulse_next_t;
+
+static uint32_t i2s_step_ticks, i2s_delay_ticks;    // Pulse and delay lengths + 1 microsecond, in step timer ticks
+static volatile axes_signals_t pulse_step_outbits;  // Step outputs to set when the direction setup delay has elapsed
+static volatile pulse_next_t pulse_next = {0};      // Step held until the current pulse has completed
+static volatile uint32_t pulse_lost = 0;            // Steps lost by merging held steps, reported when the steppers go idle
+
+inline __attribute__((always_inline)) IRAM_ATTR static void pulse_timer_start (uint32_t ticks)
+{
+    TIMERG0.hw_timer[PULSE_TIMER_INDEX].reload = 1; // Counter = 0
+    TIMERG0.hw_timer[PULSE_TIMER_INDEX].alarm_low = ticks;
+    TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.alarm_en = TIMER_ALARM_EN;
+    TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.enable = 1;
+}
+
+inline __attribute__((always_inline)) IRAM_ATTR static void pulse_timer_stop (void)
+{
+    TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.enable = 0;
+    pulse_step_outbits.value = 0;
+    pulse_next.pending = false;
+}
+
+// Returns true if a step pulse or direction setup delay is in progress.
+inline __attribute__((always_inline)) IRAM_ATTR static bool pulse_timer_running (void)
+{
+    return TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.enable;
+}
+
+// Holds a step until the current pulse has completed. Steps are merged if more than one arrives,
+// a second step of the same axis is then lost as the step rate is above what passthrough mode can output.
+// Lost steps are counted and reported as a warning, the machine position is then no longer valid.
+inline __attribute__((always_inline)) IRAM_ATTR static void pulse_hold (stepper_t *stepper)
+{
+    if(!pulse_next.pending) {
+        pulse_next.dir_change = false;
+        pulse_next.step_outbits.value = 0;
+    } else if(pulse_next.step_outbits.value & stepper->step_outbits.value)
+        pulse_lost += __builtin_popcount(pulse_next.step_outbits.value & stepper->step_outbits.value);
+
+    if(stepper->dir_change) {
+        pulse_next.dir_change = true;
+        pulse_next.dir_outbits = stepper->dir_outbits;
+    }
+    pulse_next.step_outbits.value |= stepper->step_outbits.value;
+    pulse_next.pending = true;
+}
+
+IRAM_ATTR static void pulse_timer_isr (void *arg)
+{
+    TIMERG0.int_clr_timers.t1 = 1;
+
+    if(pulse_step_outbits.value) {
+        i2s_set_step_outputs(pulse_step_outbits);
+        pulse_step_outbits.value = 0;
+        pulse_timer_start(i2s_step_ticks);
+    } else {
+        i2s_set_step_outputs((axes_signals_t){0});
+        if(pulse_next.pending) {
+            // Output the held step after the direction setup delay, the outputs are low meanwhile.
+            pulse_next.pending = false;
+            if(pulse_next.dir_change)
+                set_dir_outputs(pulse_next.dir_outbits);
+            if((pulse_step_outbits.value = pulse_next.step_outbits.value))
+                pulse_timer_start(i2s_delay_ticks);
+            else
+                TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.enable = 0;
+        } else
+            TIMERG0.hw_timer[PULSE_TIMER_INDEX].config.enable = 0;
+    }
+}
+
+#endif // !CONFIG_IDF_TARGET_ESP32S3
+
+// Selects the DMA buffer depth per segment, see i2s_state_changed().
+IRAM_ATTR static void I2SStepperCyclesPerTick (uint32_t cycles_per_tick)
+{
+    bool deep = cycles_per_tick <= hal.f_step_timer / I2S_OUT_DEEP_STREAM_RATE;
+
+    if(deep != i2s_deep_buffers) {
+        i2s_deep_buffers = deep;
+        i2s_out_set_depth(deep ? I2S_OUT_DEEP_DMABUF_USEC : I2S_OUT_SHALLOW_DMABUF_USEC);
+    }
+
+    i2s_out_set_pulse_period((cycles_per_tick < (1UL << 18) ? cycles_per_tick : (1UL << 18) - 1UL) * I2S_STREAM_TICKS_PER_USEC / (hal.f_step_timer / 1000000));
+}
+
+// Sets stepper direction and pulse pins and starts a step pulse
+// Called when in I2S stepping mode, from the core stepper callback run by i2s_stream_fill()
+// at segment boundaries, other steps are generated by I2SStepperPulseBatch() when enabled.
+IRAM_ATTR static void I2SStepperPulseStart (stepper_t *stepper)
+{
+#if I2S_OUT_BATCH
+    i2s_stepper = stepper;
+#endif
+
+    if(stepper->dir_change) {
+        set_dir_outputs(stepper->dir_outbits);
+        if(stepper->step_outbits.value)
+            i2s_out_push_sample(i2s_delay_samples);
+    }
+
+    if(stepper->step_outbits.value)
+        i2s_push_step_pulse(stepper->step_outbits);
+}
+
+#ifdef SQUARING_ENABLED
+
+// Set stepper pulse output pins
+inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits_1)
+{
+    const out_mask_t *level_1 = &step_map.level[step_outbits_1.mask & motors_1.mask & AXES_BITMASK],
+                     *level_2 = &step_map_2.level[step_outbits_1.mask & motors_2.mask & AXES_BITMASK];
+    out_mask_t pins, level;
+
+    pins.out = step_map.pins.out | step_map_2.pins.out;
+    pins.out1 = step_map.pins.out1 | step_map_2.pins.out1;
+    pins.i2s = step_map.pins.i2s | step_map_2.pins.i2s;
+    level.out = level_1->out | level_2->out;
+    level.out1 = level_1->out1 | level_2->out1;
+    level.i2s = level_1->i2s | level_2->i2s;
+
+    out_map_write(&pins, &level);
+}
+
+#else // !SQUARING_ENABLED
+
+// Set stepper pulse output pins
+inline __attribute__((always_inline)) IRAM_ATTR static void i2s_set_step_outputs (axes_signals_t step_outbits)
+{
+    out_map_write(&step_map.pins, &step_map.level[step_outbits.mask & AXES_BITMASK]);
+}
+
+#endif // !SQUARING_ENABLED
+
+// When all step outputs are I2S expanded the pulse is written straight to the DMA buffer,
+// the port data is left at the idle level and no write is needed to end the pulse.
+inline __attribute__((always_inline)) IRAM_ATTR static void i2s_push_step_pulse (axes_signals_t step_outbits_1)
+{
+    if(i2s_step_direct) {
+#ifdef SQUARING_ENABLED
+        i2s_out_push_pulse(step_map.pins.i2s | step_map_2.pins.i2s,
+                            step_map.level[step_outbits_1.mask & motors_1.mask & AXES_BITMASK].i2s |
+                             step_map_2.level[step_outbits_1.mask & motors_2.mask & AXES_BITMASK].i2s,
+                              i2s_step_samples);
+#else
+        i2s_out_push_pulse(step_map.pins.i2s, step_map.level[step_outbits_1.mask & AXES_BITMASK].i2s, i2s_step_samples);
+#endif
+    } else {
+        i2s_set_step_outputs(step_outbits_1);
+        i2s_out_push_sample(i2s_step_samples);
+        i2s_set_step_outputs((axes_signals_t){0});
+    }
+}
+
+#if I2S_OUT_BATCH
+
+#define I2S_BRESENHAM(axis, counter, bit) \
+    if((stepper->counter += stepper->steps[axis]) > stepper->step_event_count) { \
+        step_outbits.bit = On; \
+        stepper->counter -= stepper->step_event_count; \
+        sys.position[axis] = sys.position[axis] + (stepper->dir_outbits.bit ? -1 : 1); \
+    }
+
+// Runs the core stepper callback for up to max steps of the current segment, called by i2s_stream_fill()
+// when a step is due: outputs the pending step and traces the next one as stepper_driver_interrupt_handler() does.
+// The last step of a segment is left to the core as the segment buffer is then advanced, and so is every step
+// of a new block, probing and homing as the core then has more to do per step.
+IRAM_ATTR static uint32_t I2SStepperPulseBatch (i2s_stream_pulse_t *pulses, uint32_t max)
+{
+    uint32_t n = 0;
+    stepper_t *stepper = i2s_stepper;
+    axes_signals_t step_outbits;
+
+    if(stepper == NULL || stepper->exec_segment == NULL || stepper->new_block || stepper->dir_change ||
+        sys.probing_state == Probing_Active || state_get() == STATE_HOMING)
+        return 0;
+
+    while(n < max && stepper->step_count > 1) {
+
+  #ifdef SQUARING_ENABLED
+        pulses[n].level = step_map.level[stepper->step_outbits.mask & motors_1.mask & AXES_BITMASK].i2s |
+                           step_map_2.level[stepper->step_outbits.mask & motors_2.mask & AXES_BITMASK].i2s;
+  #else
+        pulses[n].level = step_map.level[stepper->step_outbits.mask & AXES_BITMASK].i2s;
+  #endif
+        pulses[n++].step = stepper->step_outbits.value != 0;
+
+        step_outbits.value = 0;
+
+        I2S_BRESENHAM(X_AXIS, counter_x, x);
+        I2S_BRESENHAM(Y_AXIS, counter_y, y);
+  #ifdef Z_AXIS
+        I2S_BRESENHAM(Z_AXIS, counter_z, z);
+  #endif
+  #ifdef A_AXIS
+        I2S_BRESENHAM(A_AXIS, counter_a, a);
+  #endif
+  #ifdef B_AXIS
+        I2S_BRESENHAM(B_AXIS, counter_b, b);
+  #endif
+  #ifdef C_AXIS
+        I2S_BRESENHAM(C_AXIS, counter_c, c);
+  #endif
+
+        stepper->step_outbits.value = step_outbits.value;
+        stepper->step_count--;
+    }
+
+    return n;
+}
+
+#endif // I2S_OUT_BATCH
+
+#else // RMT stepping
+
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+#define RMT_TX_SYNC 1
+static uint32_t rmt_tx_sync;    // TX sync register value with sync enabled and no channels in the group
+#else
+#define RMT_TX_SYNC 0
+#endif
+
+static uint32_t rmt_channels = 0; // Configured RMT channels
+
+#if STEP_BURST_ENABLE
+
+#if !(SOC_RMT_SUPPORT_TX_LOOP_COUNT && SOC_RMT_SUPPORT_TX_LOOP_AUTO_STOP)
+#error "Step bursts requires RMT TX loop count support (ESP32-S3)!"
+#endif
+
+#define RMT_CLK_DIV 4                   // 20 MHz, same as the step timer so that pulse trains have the exact step interval
+#define RMT_ITEM_DURATION_MAX 32767UL
+#define STEP_BURST_MAX_PULSES 1023UL    // RMT TX loop counter is 10 bits
+#define RMT_TX_LOOP_INT_SHIFT 12        // RMT_INT_RAW_REG, CHn_TX_LOOP_INT_RAW bits
+
+static uint32_t rmt_pulse_ticks;        // Delay + pulse duration of the pulse item
+static uint32_t rmt_idle_level;         // Channel idle levels
+
+#else
+#define RMT_CLK_DIV 20                  // 4 MHz
+#endif
+
+#define RMT_TICKS_PER_US (80.0f / (float)RMT_CLK_DIV)
+
+static void initRMT (settings_t *settings)
+{
+    rmt_item32_t rmtItem[2];
+
+    rmt_config_t rmtConfig = {
+        .rmt_mode = RMT_MODE_TX,
+        .clk_div = RMT_CLK_DIV,
+        .mem_block_num = 1,
+        .tx_config.loop_en = false,
+        .tx_config.carrier_en = false,
+        .tx_config.carrier_freq_hz = 0,
+        .tx_config.carrier_duty_percent = 50,
+        .tx_config.carrier_level = RMT_CARRIER_LEVEL_LOW,
+        .tx_config.idle_output_en = true
+    };
+
+    rmtItem[0].duration0 = (uint32_t)(settings->steppers.pulse_delay_microseconds > 0.0f ? RMT_TICKS_PER_US * settings->steppers.pulse_delay_microseconds : 1.0f);
+    rmtItem[0].duration1 = (uint32_t)(RMT_TICKS_PER_US * settings->steppers.pulse_microseconds);
+    rmtItem[1].duration0 = 0;
+    rmtItem[1].duration1 = 0;
+
+#if STEP_BURST_ENABLE
+    rmt_idle_level = 0;
+    rmt_pulse_ticks = rmtItem[0].duration0 + rmtItem[0].duration1;
+#endif
+
+//    hal.max_step_rate = 4000000UL / (rmtItem[0].duration0 + rmtItem[0].duration1); // + latency
+
+    uint32_t channel;
+    for(channel = 0; channel < (N_AXIS + N_GANGED); channel++) {
+
+        rmtConfig.channel = channel;
+
+        switch(channel) {
+            case X_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.x;
+                rmtConfig.gpio_num = X_STEP_PIN;
+                break;
+            case Y_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.y;
+                rmtConfig.gpio_num = Y_STEP_PIN;
+                break;
+#ifdef Z_STEP_PIN
+            case Z_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.z;
+                rmtConfig.gpio_num = Z_STEP_PIN;
+                break;
+#endif
+#ifdef A_STEP_PIN
+            case A_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.a;
+                rmtConfig.gpio_num = A_STEP_PIN;
+                break;
+#endif
+#ifdef B_STEP_PIN
+            case B_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.b;
+                rmtConfig.gpio_num = B_STEP_PIN;
+                break;
+#endif
+#ifdef C_STEP_PIN
+            case C_AXIS:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.c;
+                rmtConfig.gpio_num = C_STEP_PIN;
+                break;
+#endif
+#ifdef X2_STEP_PIN
+            case X2_MOTOR:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.x;
+                rmtConfig.gpio_num = X2_STEP_PIN;
+                break;
+#endif
+#ifdef Y2_STEP_PIN
+            case Y2_MOTOR:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.y;
+                rmtConfig.gpio_num = Y2_STEP_PIN;
+                break;
+#endif
+#ifdef Z2_STEP_PIN
+            case Z2_MOTOR:
+                rmtConfig.tx_config.idle_level = settings->steppers.step_invert.z;
+                rmtConfig.gpio_num = Z2_STEP_PIN;
+                break;
+#endif
+        }
+#ifndef Z_STEP_PIN
+        if(channel == Z_AXIS)
+            continue;
+#endif
+        rmtItem[0].level0 = rmtConfig.tx_config.idle_level;
+        rmtItem[0].level1 = !rmtConfig.tx_config.idle_level;
+        rmt_config(&rmtConfig);
+        rmt_fill_tx_items(rmtConfig.channel, &rmtItem[0], 2, 0);
+        rmt_channels |= bit(channel);
+#if STEP_BURST_ENABLE
+        if(rmtConfig.tx_config.idle_level)
+            rmt_idle_level |= bit(channel);
+#endif
+    }
+
+#if RMT_TX_SYNC
+    RMT.tx_sim.val = 0;
+    rmt_ll_tx_enable_sync(&RMT, true);
+    rmt_tx_sync = RMT.tx_sim.val;
+#endif
+}
+
+// Starts the RMT channels in the mask.
+// Channels are added to the TX sync group when supported so that all pulses of a tick start
+// simultaneously when the last channel is started.
+inline __attribute__((always_inline)) IRAM_ATTR static void rmt_start_channels (uint32_t channels)
+{
+    uint32_t channel;
+
+#if RMT_TX_SYNC
+    RMT.tx_sim.val = rmt_tx_sync | channels;
+#endif
+
+    while(channels) {
+        channel = __builtin_ctz(channels);
+        channels &= channels - 1;
+        rmt_ll_tx_reset_pointer(&RMT, channel);
+        rmt_ll_tx_start(&RMT, channel);
+    }
+}
+
+#ifdef SQUARING_ENABLED
+
+// Returns the RMT channels to start for the step bits
+inline IRAM_ATTR static uint32_t get_step_channels (axes_signals_t step_outbits_1)
+{
+    uint32_t channels = step_outbits_1.mask & motors_1.mask;
+
+#ifdef GANGING_ENABLED
+    axes_signals_t step_outbits_2;
+    step_outbits_2.mask = step_outbits_1.mask & motors_2.mask;
+  #ifdef X2_STEP_PIN
+    if(step_outbits_2.x)
+        channels |= bit(X2_MOTOR);
+  #endif
+  #ifdef Y2_STEP_PIN
+    if(step_outbits_2.y)
+        channels |= bit(Y2_MOTOR);
+  #endif
+  #ifdef Z2_STEP_PIN
+    if(step_outbits_2.z)
+        channels |= bit(Z2_MOTOR);
+  #endif
+#endif
+
+    return channels & rmt_channels;
+}
+
+#else // !SQUARING_ENABLED
+
+// Returns the RMT channels to start for the step bits
+inline IRAM_ATTR static uint32_t get_step_channels (axes_signals_t step_outbits)
+{
+    uint32_t channels = step_outbits.mask;
+
+#ifdef X2_STEP_PIN
+    if(step_outbits.x)
+        channels |= bit(X2_MOTOR);
+#endif
+#ifdef Y2_STEP_PIN
+    if(step_outbits.y)
+        channels |= bit(Y2_MOTOR);
+#endif
+#ifdef Z2_STEP_PIN
+    if(step_outbits.z)
+        channels |= bit(Z2_MOTOR);
+#endif
+
+    return channels & rmt_channels;
+}
+
+#endif // !SQUARING_ENABLED
+
+// Set stepper pulse output pins
+// NOTE: step invert is handled by the RMT idle level
+inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits)
+{
+    rmt_start_channels(get_step_channels(step_outbits));
+}
+
+#endif // RMT stepping
+
+// Compiles the output maps and the step pulse timing from the settings
+static void step_outputs_init (settings_t *settings)
+{
+    output_maps_init(settings);
+
+#if USE_I2S_OUT
+
+  #ifdef SQUARING_ENABLED
+    i2s_step_direct = !(step_map.pins.out || step_map.pins.out1 || step_map_2.pins.out || step_map_2.pins.out1);
+  #else
+    i2s_step_direct = !(step_map.pins.out || step_map.pins.out1);
+  #endif
+
+    i2s_delay_length = (uint32_t)ceilf(settings->steppers.pulse_delay_microseconds);
+    i2s_step_length = (uint32_t)ceilf(settings->steppers.pulse_microseconds);
+
+    if(i2s_delay_length % I2S_OUT_USEC_PER_PULSE)
+        i2s_delay_length += I2S_OUT_USEC_PER_PULSE - i2s_delay_length % I2S_OUT_USEC_PER_PULSE;
+
+    i2s_delay_length = min(max(i2s_delay_length, I2S_OUT_USEC_PER_PULSE), I2S_OUT_MAX_DELAY_USEC);
+
+    if(i2s_step_length % I2S_OUT_USEC_PER_PULSE)
+        i2s_step_length += I2S_OUT_USEC_PER_PULSE - i2s_step_length % I2S_OUT_USEC_PER_PULSE;
+
+    i2s_step_length = min(max(i2s_step_length, I2S_OUT_USEC_PER_PULSE), I2S_OUT_MAX_STEP_USEC);
+
+    i2s_delay_samples = i2s_delay_length / I2S_OUT_USEC_PER_PULSE;
+    i2s_step_samples = i2s_step_length / I2S_OUT_USEC_PER_PULSE;
+
+  #if I2S_OUT_BATCH
+    #ifdef SQUARING_ENABLED
+    i2s_out_set_pulse_batch(i2s_step_direct ? I2SStepperPulseBatch : NULL, step_map.pins.i2s | step_map_2.pins.i2s, i2s_step_samples);
+    #else
+    i2s_out_set_pulse_batch(i2s_step_direct ? I2SStepperPulseBatch : NULL, step_map.pins.i2s, i2s_step_samples);
+    #endif
+  #endif
+
+  #if !CONFIG_IDF_TARGET_ESP32S3
+    i2s_delay_ticks = (i2s_delay_length + 1) * (hal.f_step_timer / 1000000);
+    i2s_step_ticks = (i2s_step_length + 1) * (hal.f_step_timer / 1000000);
+  #endif
+
+#else
+    initRMT(settings);
+#endif
+}
+
+#if STEP_BURST_ENABLE
+IRAM_ATTR static void stepBurstCapture (stepper_t *stepper);
+#endif
+
+// Sets stepper direction and pulse pins and starts a step pulse
+// Called when in I2S passthrough mode
+
+#if CONFIG_IDF_TARGET_ESP32S3
+
+IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
+{
+#if USE_I2S_OUT
+    static bool add_dir_delay = false;
+#endif
+
+#if STEP_BURST_ENABLE
+    if(burst.capture) {
+        stepBurstCapture(stepper);
+        return;
+    }
+#endif
+
+    if(stepper->dir_change) {
+        set_dir_outputs(stepper->dir_outbits);
+#if USE_I2S_OUT
+        if(!(add_dir_delay = !!stepper->step_outbits.value))
+            i2s_out_commit(0, i2s_delay_samples);
+#endif
+    }
+
+    if(stepper->step_outbits.value) {
+#if USE_I2S_OUT
+        i2s_set_step_outputs(stepper->step_outbits);
+        i2s_out_commit(i2s_step_samples, add_dir_delay ? i2s_delay_samples : 0);
+        add_dir_delay = false;
+#else
+        set_step_outputs(stepper->step_outbits);
+#endif
+    }
+
+#if PROBE_ISR
+    if(probe.is_probing && !probe_log.frozen && stepper->step_outbits.value)
+        probe_log_step(stepper);
+#endif
+
+#if STEP_BURST_ENABLE
+    // Single axis step without a direction change?
+    if((burst.candidate = !burst.inhibit && !stepper->dir_change && stepper->step_outbits.value &&
+                           !(stepper->step_outbits.value & (stepper->step_outbits.value - 1))))
+        burst.step_outbits = stepper->step_outbits;
+#endif
+}
+
+#else
+
+IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
+{
+#if USE_I2S_OUT
+    if((stepper->dir_change || stepper->step_outbits.value) && pulse_timer_running()) {
+        pulse_hold(stepper);
+  #if PROBE_ISR
+        if(probe.is_probing && !probe_log.frozen && stepper->step_outbits.value)
+            probe_log_step(stepper);
+  #endif
+        return;
+    }
+#endif
+
+    if(stepper->dir_change) {
+        set_dir_outputs(stepper->dir_outbits);
+#if USE_I2S_OUT
+        if(stepper->step_outbits.value) {
+            // Step outputs are set by pulse_timer_isr() when the direction setup delay has elapsed.
+            pulse_step_outbits = stepper->step_outbits;
+            pulse_timer_start(i2s_delay_ticks);
+            return;
+        }
+#endif
+    }
+
+    if(stepper->step_outbits.value) {
+#if USE_I2S_OUT
+        i2s_set_step_outputs(stepper->step_outbits);
+        pulse_timer_start(i2s_step_ticks);
+#else
+        set_step_outputs(stepper->step_outbits);
+#endif
+    }
+
+#if PROBE_ISR
+    if(probe.is_probing && !probe_log.frozen && stepper->step_outbits.value)
+        probe_log_step(stepper);
+#endif
+}
+
+#endif
@@ -0,0 +1,444 @@
+/*
+  i2sbench.c - host-side benchmark for the I2S bitstream generator in main/i2s_stream.c
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Fills DMA sized buffers with i2s_stream_fill() as i2sOutTask does, with a pulse callback
+  modelled on I2SStepperPulseStart() in main/driver.c, and reports how many steps per second
+  one host core synthesizes. The generated bitstream is decoded and the step count and
+  step spacing are checked against the commanded period.
+
+  A few fixed cases are first checked sample-for-sample against golden bitstreams,
+  run with -g to only run these.
+
+  Usage: i2sbench [options]
+    -a, --axes <n>          number of axes stepping, 1 - 6, default 3
+    -p, --pulse <us>        $0, step pulse length, default 4
+    -d, --delay <us>        $29, step pulse delay (dir setup time), default 0
+    -r, --rate <steps/s>    step rate, default sweep of 1k - 500k
+    -e, --dir-every <n>     reverse direction every n steps, default 0 (never)
+    -t, --time <s>          simulated time per rate, default 10
+    -g, --golden            only run the golden bitstream checks
+    -i, --indirect          set and clear the step bits in the output value around i2s_stream_push(),
+                            as when not all step outputs are I2S expanded
+    -b, --batch             generate the pulses between direction changes from the batch callback,
+                            as I2SStepperPulseBatch() does within a segment. The golden checks are run both ways.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "i2s_stream.h"
+
+#define I2S_OUT_DMABUF_LEN 2000                                 // as in i2s_out.h
+#define DMA_SAMPLE_COUNT (I2S_OUT_DMABUF_LEN / sizeof(uint32_t))
+
+#define I2S_STEP_BIT(axis) ((axis) * 2)
+#define I2S_DIR_BIT(axis) ((axis) * 2 + 1)
+
+typedef struct {
+    uint32_t n_axis;
+    uint32_t step_samples;
+    uint32_t delay_samples;
+    uint32_t dir_every;
+    uint32_t stop_after;    // switch to WAITING after this many steps as I2SStepperGoIdle() does, 0 for never
+    bool indirect;          // i2s_push_step_pulse() without i2s_step_direct
+    bool batch;             // I2SStepperPulseBatch()
+    double time;
+} bench_t;
+
+typedef struct {
+    uint64_t steps;         // pulse callbacks
+    uint64_t samples;
+    uint64_t steps_seen;    // rising edges of the X step bit in the output
+    uint64_t dir_changes;
+    uint32_t min_spacing;   // X step spacing in samples
+    uint32_t max_spacing;
+    double cpu_time;
+} bench_result_t;
+
+static bench_t bench = {
+    .n_axis = 3,
+    .step_samples = 1,
+    .delay_samples = 0,
+    .dir_every = 0,
+    .stop_after = 0,
+    .time = 10.0
+};
+
+static atomic_uint_least32_t port_data = 0;
+static _Atomic i2s_out_pulser_status_t pulser_status = STEPPING;
+static i2s_stream_t stream = {
+    .pulser_status = &pulser_status,
+    .port_data = &port_data
+};
+static uint32_t step_mask, dir_mask;
+static bench_result_t result;
+
+static inline void port_write_mask (uint32_t set, uint32_t clear)
+{
+    atomic_fetch_and(&port_data, ~clear);
+    atomic_fetch_or(&port_data, set);
+}
+
+// I2SStepperPulseStart()
+static void pulse_func (void)
+{
+    result.steps++;
+
+    if(bench.dir_every && (result.steps % bench.dir_every) == 0) {
+        port_write_mask(atomic_load(&port_data) & dir_mask ? 0 : dir_mask, atomic_load(&port_data) & dir_mask);
+        if(bench.delay_samples)
+            i2s_stream_push(&stream, bench.delay_samples);
+    }
+
+    if(bench.indirect) {
+        port_write_mask(step_mask, 0);
+        i2s_stream_push(&stream, bench.step_samples);
+        port_write_mask(0, step_mask);
+    } else
+        i2s_stream_push_pulse(&stream, step_mask, step_mask, bench.step_samples);
+
+    if(bench.stop_after && result.steps == bench.stop_after)
+        atomic_store(&pulser_status, WAITING);
+}
+
+// I2SStepperPulseBatch(), leaves direction changes and the stop to the pulse callback.
+static uint32_t pulse_batch_func (i2s_stream_pulse_t *pulses, uint32_t max)
+{
+    uint32_t n = 0;
+
+    while(n < max) {
+        uint64_t step = result.steps + 1;
+        if((bench.dir_every && (step % bench.dir_every) == 0) || (bench.stop_after && step >= bench.stop_after))
+            break;
+        pulses[n].level = step_mask;
+        pulses[n++].step = true;
+        result.steps = step;
+    }
+
+    return n;
+}
+
+static uint32_t last, since_step;
+
+static void decode (const uint32_t *buf, uint32_t n_samples)
+{
+    uint32_t idx;
+
+    for(idx = 0; idx < n_samples; idx++) {
+        since_step++;
+        if((buf[idx] & ~last) & (1 << I2S_STEP_BIT(0))) {
+            if(result.steps_seen) {
+                if(since_step < result.min_spacing)
+                    result.min_spacing = since_step;
+                if(since_step > result.max_spacing)
+                    result.max_spacing = since_step;
+            }
+            result.steps_seen++;
+            since_step = 0;
+        }
+        if((buf[idx] ^ last) & (1 << I2S_DIR_BIT(0)))
+            result.dir_changes++;
+        last = buf[idx];
+    }
+}
+
+/*
+  Golden bitstreams, one axis with the step output in bit 0 and the direction output in bit 1.
+  Each sample is one hex digit of bits 0 - 3, buffers are separated by '|'. Buffers are GOLDEN_SAMPLES long
+  so that i2s_stream_fill() stops SAMPLE_SAFE_COUNT samples short of the end, a pulse started before then
+  may extend past it, and the pulse timing carries over to the next buffer.
+  Only valid for the default 4 us sample period in 32-bit mode.
+*/
+
+#define GOLDEN_SAMPLES 24
+
+typedef struct {
+    const char *name;
+    uint32_t rate;                      // steps/s
+    uint32_t step_samples;
+    uint32_t delay_samples;
+    uint32_t dir_every;
+    uint32_t stop_after;
+    i2s_out_pulser_status_t status;     // i2s_stream_fill() return for the last buffer
+    const char *expected;
+} golden_t;
+
+static const golden_t golden[] = {
+    { "50 kHz, 4 us pulse", 50000, 1, 0, 0, 0, STEPPING,
+      "1000010000100001000" "|" "0100001000010000100" },
+    { "33.3 kHz, 8 us pulse, fractional period", 33333, 2, 0, 0, 0, STEPPING,
+      "1100000110000001100" "|" "00011000000110000011" },
+    { "25 kHz, 4 us pulse, 8 us delay, reversing", 25000, 1, 2, 2, 0, STEPPING,
+      "1000000000223222222" "|" "2322222222200100000" },
+    { "50 kHz, WAITING cutover after 2 steps", 50000, 1, 0, 0, 2, WAITING,
+      "1000010000000000000" },
+};
+
+static bool golden_run (const golden_t *test)
+{
+    static uint32_t buf[GOLDEN_SAMPLES];
+
+    char actual[GOLDEN_SAMPLES * 4] = "";
+    uint32_t idx, len = 0;
+    i2s_out_pulser_status_t status = STEPPING;
+    const char *expected = test->expected;
+
+    memset(&result, 0, sizeof(bench_result_t));
+    stream.step_samples = bench.step_samples = test->step_samples;
+    bench.delay_samples = test->delay_samples;
+    bench.dir_every = test->dir_every;
+    bench.stop_after = test->stop_after;
+    stream.step_mask = step_mask = 1 << I2S_STEP_BIT(0);
+    dir_mask = 1 << I2S_DIR_BIT(0);
+
+    atomic_store(&port_data, 0);
+    atomic_store(&pulser_status, STEPPING);
+    stream.pulse_period = 1000000UL * I2S_STREAM_TICKS_PER_USEC / test->rate;
+    i2s_stream_reset(&stream, buf);
+
+    do {
+        if(len)
+            actual[len++] = '|';
+        status = i2s_stream_fill(&stream, buf, GOLDEN_SAMPLES);
+        for(idx = 0; idx < stream.rw_pos && len < sizeof(actual) - 1; idx++)
+            actual[len++] = "0123456789abcdef"[buf[idx] & 0x0F];
+        actual[len] = '\0';
+    } while((expected = strchr(expected, '|')) && expected++);
+
+    bool ok = status == test->status && !strcmp(actual, test->expected);
+
+    printf("  %-44s %-5s %s\n", test->name, bench.batch ? "batch" : "", ok ? "ok" : "FAIL");
+    if(!ok)
+        printf("    expected %s, status %d\n    actual   %s, status %d\n", test->expected, test->status, actual, status);
+
+    return ok;
+}
+
+static bool golden_check (void)
+{
+    bool ok = true;
+    uint32_t idx;
+    bench_t saved = bench;
+
+    printf("Golden bitstreams\n");
+
+#if I2S_OUT_USEC_PER_PULSE == 4 && I2S_STREAM_WORDS == 1
+    for(idx = 0; idx < sizeof(golden) / sizeof(golden_t); idx++) {
+        bench.batch = false;
+        stream.pulse_batch_func = NULL;
+        ok &= golden_run(&golden[idx]);
+        bench.batch = true;
+        stream.pulse_batch_func = pulse_batch_func;
+        ok &= golden_run(&golden[idx]);
+    }
+#else
+    printf("  skipped, only valid for 4 us samples in 32-bit mode\n");
+#endif
+
+    printf("\n");
+
+    bench = saved;
+    stream.pulse_batch_func = NULL;
+    stream.step_mask = step_mask = dir_mask = 0;
+    stream.pulse_period = 0;
+    atomic_store(&pulser_status, STEPPING);
+
+    return ok;
+}
+
+static double now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool run (uint32_t rate)
+{
+    static uint32_t buf[DMA_SAMPLE_COUNT];
+
+    double t0, sim_time = 0.0;
+    uint32_t period = 1000000UL * I2S_STREAM_TICKS_PER_USEC / rate;
+
+    memset(&result, 0, sizeof(bench_result_t));
+    result.min_spacing = UINT32_MAX;
+
+    atomic_store(&port_data, 0);
+    atomic_store(&pulser_status, STEPPING);
+    stream.pulse_period = period;
+    i2s_stream_reset(&stream, buf);
+
+    // Generate, cpu time only.
+    t0 = now();
+    while(sim_time < bench.time) {
+        i2s_stream_fill(&stream, buf, DMA_SAMPLE_COUNT);
+        result.samples += stream.rw_pos;
+        sim_time += (double)(stream.rw_pos * I2S_OUT_USEC_PER_PULSE) * 1e-6;
+    }
+    result.cpu_time = now() - t0;
+
+    // Generate again and decode the bitstream.
+    uint64_t steps = result.steps, samples = result.samples;
+
+    atomic_store(&port_data, 0);
+    result.steps = last = since_step = 0;
+    i2s_stream_reset(&stream, buf);
+    while(result.steps < steps) {
+        i2s_stream_fill(&stream, buf, DMA_SAMPLE_COUNT);
+        decode(buf, stream.rw_pos);
+    }
+
+    uint32_t expected = (period + I2S_STREAM_TICKS_PER_SAMPLE - 1) / I2S_STREAM_TICKS_PER_SAMPLE;
+    // A step following a direction change is late by the step pulse delay, the next one early by the same.
+    uint32_t jitter = 1 + (bench.dir_every ? bench.delay_samples : 0);
+    bool ok = result.steps_seen == result.steps && result.min_spacing >= (expected > jitter ? expected - jitter : 1);
+
+    printf("%8u %10.0f %10.0f %12.0f %8.1f %7u %7u %s\n",
+            rate,
+            (double)steps / result.cpu_time,
+            (double)samples / result.cpu_time,
+            bench.time / result.cpu_time,
+            100.0 * result.cpu_time / bench.time,
+            result.min_spacing == UINT32_MAX ? 0 : result.min_spacing * I2S_OUT_USEC_PER_PULSE,
+            result.max_spacing * I2S_OUT_USEC_PER_PULSE,
+            ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+int main (int argc, char **argv)
+{
+    static const uint32_t rates[] = { 1000, 5000, 10000, 25000, 50000, 100000, 125000, 250000, 500000 };
+    static const struct option options[] = {
+        { "axes",      required_argument, NULL, 'a' },
+        { "pulse",     required_argument, NULL, 'p' },
+        { "delay",     required_argument, NULL, 'd' },
+        { "rate",      required_argument, NULL, 'r' },
+        { "dir-every", required_argument, NULL, 'e' },
+        { "time",      required_argument, NULL, 't' },
+        { "golden",    no_argument,       NULL, 'g' },
+        { "indirect",  no_argument,       NULL, 'i' },
+        { "batch",     no_argument,       NULL, 'b' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    bool ok = true, golden_only = false;
+    uint32_t idx, rate = 0, pulse_us = 4, delay_us = 0;
+
+    while((opt = getopt_long(argc, argv, "a:p:d:r:e:t:gibh", options, NULL)) != -1) switch(opt) {
+
+        case 'a':
+            bench.n_axis = (uint32_t)atoi(optarg);
+            if(bench.n_axis < 1 || bench.n_axis > 6) {
+                fprintf(stderr, "axes must be 1 - 6\n");
+                return 1;
+            }
+            break;
+
+        case 'p':
+            pulse_us = (uint32_t)atoi(optarg);
+            break;
+
+        case 'd':
+            delay_us = (uint32_t)atoi(optarg);
+            break;
+
+        case 'r':
+            rate = (uint32_t)atoi(optarg);
+            break;
+
+        case 'e':
+            bench.dir_every = (uint32_t)atoi(optarg);
+            break;
+
+        case 't':
+            bench.time = atof(optarg);
+            break;
+
+        case 'g':
+            golden_only = true;
+            break;
+
+        case 'i':
+            bench.indirect = true;
+            break;
+
+        case 'b':
+            bench.batch = true;
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-a axes] [-p pulse_us] [-d delay_us] [-r rate] [-e dir_every] [-t time_s] [-g] [-i] [-b]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+    }
+
+    stream.pulse_func = pulse_func;
+
+    if(!golden_check())
+        return 2;
+
+    if(golden_only)
+        return 0;
+
+    // settings_changed(), I2S step pulse config
+    bench.step_samples = (pulse_us + I2S_OUT_USEC_PER_PULSE - 1) / I2S_OUT_USEC_PER_PULSE;
+    bench.step_samples = bench.step_samples < 1 ? 1 : (bench.step_samples > I2S_OUT_MAX_STEP_USEC / I2S_OUT_USEC_PER_PULSE ? I2S_OUT_MAX_STEP_USEC / I2S_OUT_USEC_PER_PULSE : bench.step_samples);
+    bench.delay_samples = (delay_us + I2S_OUT_USEC_PER_PULSE - 1) / I2S_OUT_USEC_PER_PULSE;
+    bench.delay_samples = bench.delay_samples > I2S_OUT_MAX_DELAY_USEC / I2S_OUT_USEC_PER_PULSE ? I2S_OUT_MAX_DELAY_USEC / I2S_OUT_USEC_PER_PULSE : bench.delay_samples;
+
+    for(idx = 0; idx < bench.n_axis; idx++) {
+        step_mask |= 1 << I2S_STEP_BIT(idx);
+        dir_mask |= 1 << I2S_DIR_BIT(idx);
+    }
+
+    if(bench.batch && bench.indirect) {
+        fprintf(stderr, "batch requires direct step pulses\n");
+        return 1;
+    }
+
+    stream.step_mask = step_mask;
+    stream.step_samples = bench.step_samples;
+    stream.pulse_batch_func = bench.batch ? pulse_batch_func : NULL;
+
+    printf("I2S bitstream generator, %u us/sample, %u sample DMA buffers, %u axes, pulse %u us, delay %u us, %s step pulses%s\n\n",
+            I2S_OUT_USEC_PER_PULSE, (uint32_t)DMA_SAMPLE_COUNT, bench.n_axis,
+             bench.step_samples * I2S_OUT_USEC_PER_PULSE, bench.delay_samples * I2S_OUT_USEC_PER_PULSE,
+              bench.indirect ? "indirect" : "direct", bench.batch ? ", batched" : "");
+    printf("    rate    steps/s  samples/s     realtime    load%% min(us) max(us)\n");
+
+    if(rate)
+        ok = run(rate);
+    else for(idx = 0; idx < sizeof(rates) / sizeof(uint32_t); idx++) {
+        // Skip rates above the limit set by the pulse length (and delay), one low sample is needed between pulses.
+        if(rates[idx] <= 1000000UL / (I2S_OUT_USEC_PER_PULSE * (bench.step_samples + (bench.dir_every ? bench.delay_samples : 0) + 1)))
+            ok &= run(rates[idx]);
+    }
+
+    return ok ? 0 : 2;
+}
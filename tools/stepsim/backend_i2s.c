@@ -0,0 +1,66 @@
+/*
+  backend_i2s.c - ESP32 I2S shift register step outputs of main/step_out.h on the mock register layer:
+                  passthrough mode, with the pulse timer, and streaming mode
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define USE_I2S_OUT 1
+
+#include "stepsim.h"
+#include "step_out.h"
+
+static void init (settings_t *settings, axes_signals_t ganged)
+{
+    step_outputs_init(settings);
+
+    motors_2.mask = AXES_BITMASK ^ (0x07 & ~ganged.mask);
+
+    // Driver state kept across runs, reset as on power up.
+    pulse_timer_stop();
+    pulse_lost = 0;
+    i2s_deep_buffers = false;
+#if I2S_OUT_BATCH
+    i2s_stepper = NULL;
+#endif
+
+    i2s_set_step_outputs((axes_signals_t){0});
+    set_dir_outputs((axes_signals_t){0});
+}
+
+static void pulseTimerISR (void)
+{
+    pulse_timer_isr(NULL);
+}
+
+const sim_backend_t backend_i2s_passthrough = {
+    .name = "i2s-passthrough",
+    .mode = Sim_StepTimer,
+    .init = init,
+    .pulse_start = stepperPulseStart,
+    .cycles_per_tick = stepperCyclesPerTick,
+    .pulse_timer_isr = pulseTimerISR
+};
+
+const sim_backend_t backend_i2s_streaming = {
+    .name = "i2s-streaming",
+    .mode = Sim_Streaming,
+    .init = init,
+    .pulse_start = I2SStepperPulseStart,
+    .cycles_per_tick = I2SStepperCyclesPerTick
+};
@@ -0,0 +1,43 @@
+/*
+  backend_rmt.c - ESP32 RMT step output of main/step_out.h on the mock register layer
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define USE_I2S_OUT 0
+
+#include "stepsim.h"
+#include "step_out.h"
+
+static void init (settings_t *settings, axes_signals_t ganged)
+{
+    step_outputs_init(settings);
+
+    motors_2.mask = AXES_BITMASK ^ (0x07 & ~ganged.mask);
+
+    set_step_outputs((axes_signals_t){0});
+    set_dir_outputs((axes_signals_t){0});
+}
+
+const sim_backend_t backend_rmt = {
+    .name = "rmt",
+    .mode = Sim_StepTimer,
+    .init = init,
+    .pulse_start = stepperPulseStart,
+    .cycles_per_tick = stepperCyclesPerTick
+};
@@ -0,0 +1,185 @@
+/*
+  mock_grbl.h - grblHAL core types and driver configuration seen by main/step_out.h in the step timing simulator
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOCK_GRBL_H_
+#define _MOCK_GRBL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+/*
+  Driver configuration, see main/driver.h. The backend sources select the target and step output mode
+  by defining CONFIG_IDF_TARGET_ESP32S3, SOC_RMT_SUPPORT_TX_SYNCHRO and USE_I2S_OUT before including mock_hw.h.
+  Features adding code paths that are not simulated are disabled.
+*/
+
+#ifndef CONFIG_IDF_TARGET_ESP32S3
+#define CONFIG_IDF_TARGET_ESP32S3 0
+#endif
+#ifndef SOC_RMT_SUPPORT_TX_SYNCHRO
+#define SOC_RMT_SUPPORT_TX_SYNCHRO 0
+#endif
+#ifndef USE_I2S_OUT
+#define USE_I2S_OUT 0
+#endif
+
+#define PROBE_ISR                       0
+#define STEP_BURST_ENABLE               0
+#define ENABLE_BACKLASH_COMPENSATION    0
+#define I2S_OUT_PULSE_BATCH             1
+#define I2S_OUT_DEEP_STREAM_RATE        20000
+#define I2S_OUT_PIN_BASE                64
+
+#include "i2s_stream.h"
+
+#define On 1
+#define bit(n) (1UL << (n))
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+/*
+  Six axes with X, Y and Z ganged and auto squared, the motors of axes not stepped or not ganged in the simulation
+  are left idle at run time: axes beyond --axes get no steps and the second motor of an axis not in --ganged
+  is disabled via motors_2, as StepperDisableMotors() does.
+*/
+
+#define N_AXIS          6
+#define X_AXIS          0
+#define Y_AXIS          1
+#define Z_AXIS          2
+#define A_AXIS          3
+#define B_AXIS          4
+#define C_AXIS          5
+#define AXES_BITMASK    0x3F
+
+#define GANGING_ENABLED
+#define SQUARING_ENABLED
+#define N_GANGED        3
+#define X2_MOTOR        (N_AXIS)
+#define Y2_MOTOR        (N_AXIS + 1)
+#define Z2_MOTOR        (N_AXIS + 2)
+#define N_MOTORS        (N_AXIS + N_GANGED)
+
+// Step pin of a motor is GPIO motor, direction pin GPIO 32 + motor. With I2S expanded outputs
+// the step pin of a motor is I2SO(2 x motor) and the direction pin the next.
+#if USE_I2S_OUT
+#define SIM_STEP_PIN(motor) (I2S_OUT_PIN_BASE + (motor) * 2)
+#define SIM_DIR_PIN(motor)  (I2S_OUT_PIN_BASE + (motor) * 2 + 1)
+#else
+#define SIM_STEP_PIN(motor) (motor)
+#define SIM_DIR_PIN(motor)  (32 + (motor))
+#endif
+
+#define X_STEP_PIN          SIM_STEP_PIN(X_AXIS)
+#define Y_STEP_PIN          SIM_STEP_PIN(Y_AXIS)
+#define Z_STEP_PIN          SIM_STEP_PIN(Z_AXIS)
+#define A_STEP_PIN          SIM_STEP_PIN(A_AXIS)
+#define B_STEP_PIN          SIM_STEP_PIN(B_AXIS)
+#define C_STEP_PIN          SIM_STEP_PIN(C_AXIS)
+#define X2_STEP_PIN         SIM_STEP_PIN(X2_MOTOR)
+#define Y2_STEP_PIN         SIM_STEP_PIN(Y2_MOTOR)
+#define Z2_STEP_PIN         SIM_STEP_PIN(Z2_MOTOR)
+#define X_DIRECTION_PIN     SIM_DIR_PIN(X_AXIS)
+#define Y_DIRECTION_PIN     SIM_DIR_PIN(Y_AXIS)
+#define Z_DIRECTION_PIN     SIM_DIR_PIN(Z_AXIS)
+#define A_DIRECTION_PIN     SIM_DIR_PIN(A_AXIS)
+#define B_DIRECTION_PIN     SIM_DIR_PIN(B_AXIS)
+#define C_DIRECTION_PIN     SIM_DIR_PIN(C_AXIS)
+#define X2_DIRECTION_PIN    SIM_DIR_PIN(X2_MOTOR)
+#define Y2_DIRECTION_PIN    SIM_DIR_PIN(Y2_MOTOR)
+#define Z2_DIRECTION_PIN    SIM_DIR_PIN(Z2_MOTOR)
+
+/*** Core types, the members used by the step paths ***/
+
+typedef union {
+    uint8_t value;
+    uint8_t mask;
+    struct {
+        uint8_t x :1,
+                y :1,
+                z :1,
+                a :1,
+                b :1,
+                c :1,
+                u :1,
+                v :1;
+    };
+} axes_signals_t;
+
+typedef struct {
+    axes_signals_t step_invert;
+    axes_signals_t dir_invert;
+    axes_signals_t ganged_dir_invert;
+    float pulse_microseconds;
+    float pulse_delay_microseconds;
+} stepper_settings_t;
+
+typedef struct {
+    stepper_settings_t steppers;
+} settings_t;
+
+typedef struct {
+    uint_fast16_t n_step;
+} segment_t;
+
+typedef struct {
+    uint32_t counter_x, counter_y, counter_z, counter_a, counter_b, counter_c;
+    bool new_block;
+    bool dir_change;
+    axes_signals_t step_outbits;
+    axes_signals_t dir_outbits;
+    uint32_t steps[N_AXIS];
+    uint_fast16_t step_count;
+    uint32_t step_event_count;
+    segment_t *exec_segment;
+} stepper_t;
+
+typedef struct {
+    uint32_t f_step_timer;
+} grbl_hal_t;
+
+typedef enum {
+    Probing_Off = 0,
+    Probing_Active
+} probing_state_t;
+
+typedef struct {
+    int32_t position[N_AXIS];
+    probing_state_t probing_state;
+} system_t;
+
+#define STATE_IDLE      0
+#define STATE_CYCLE     bit(2)
+#define STATE_HOMING    bit(4)
+
+extern grbl_hal_t hal;
+extern system_t sys;
+
+uint_fast16_t state_get (void);
+
+#endif // _MOCK_GRBL_H_
@@ -0,0 +1,394 @@
+/*
+  mock_hw.c - mock TIMERG0/GPIO/RMT registers and I2S output driver for the step timing simulator
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+
+#include "mock_hw.h"
+
+mock_hw_t hw;
+sim_cost_t cost;
+grbl_hal_t hal = { .f_step_timer = SIM_F_STEP_TIMER };
+system_t sys;
+
+static mock_timg_t timg;
+static mock_gpio_t gpio;
+static mock_rmt_t rmt;
+
+static sim_time_t timg_t, gpio_t;   // Time of the last TIMERG0 and GPIO access
+static bool gpio_pending = false;
+static uint32_t rmt_sync_pending = 0;
+
+static _Atomic i2s_out_pulser_status_t i2s_pulser_status = PASSTHROUGH;
+static atomic_uint_least32_t i2s_port_data[I2S_STREAM_WORDS];
+static bool i2s_pending = false;
+static sim_time_t i2s_pending_t;
+static i2s_out_data_t i2s_pending_data;
+
+uint_fast16_t state_get (void)
+{
+    return STATE_CYCLE;
+}
+
+static void trace_add (sim_time_t t, uint8_t motor, edge_type_t type, bool level)
+{
+    if(hw.trace.count < hw.trace.size) {
+        sim_edge_t *edge = &hw.trace.edges[hw.trace.count++];
+        edge->t = t;
+        edge->motor = motor;
+        edge->type = (uint8_t)type;
+        edge->level = level;
+    } else
+        hw.trace.overflow = true;
+}
+
+static void pin_write (sim_time_t t, uint8_t motor, edge_type_t type, bool on)
+{
+    uint8_t *level = &hw.gpio_level[motor * 2 + type];
+
+    if(motor < N_MOTORS && *level != on) {
+        *level = on;
+        trace_add(t, motor, type, on);
+    }
+}
+
+void mock_cpu_cycles (uint32_t cycles)
+{
+    hw.now += ((sim_time_t)cycles * 1000000000ULL) / SIM_F_MCU;
+}
+
+/*** TIMERG0 ***/
+
+mock_timg_t *mock_timg (void)
+{
+    mock_cpu_cycles(cost.timer_write);
+    timg_t = hw.now;
+
+    return &timg;
+}
+
+uint32_t mock_step_timer_period (void)
+{
+    return timg.hw_timer[STEP_TIMER_INDEX].alarm_low ? timg.hw_timer[STEP_TIMER_INDEX].alarm_low : timg.hw_timer[STEP_TIMER_INDEX].alarmlo.val;
+}
+
+// The counter is reset by setting reload, the alarm is due alarm_low ticks after the last register access.
+void mock_pulse_timer_poll (void)
+{
+    mock_timg_timer_t *timer = &timg.hw_timer[TIMER_1];
+
+    if(timer->reload) {
+        timer->reload = 0;
+        hw.pulse_timer.due = timg_t + ((sim_time_t)timer->alarm_low * 1000000000ULL) / SIM_F_STEP_TIMER;
+        hw.pulse_timer.armed = true;
+    }
+
+    if(!timer->config.enable)
+        hw.pulse_timer.armed = false;
+}
+
+/*** GPIO ***/
+
+static void gpio_flush (void)
+{
+    uint32_t bits, pin;
+
+    if(!gpio_pending)
+        return;
+
+    for(bits = gpio.out_w1ts; bits; bits &= bits - 1) {
+        pin = __builtin_ctz(bits);
+        pin_write(gpio_t, pin, Edge_Step, true);
+    }
+    for(bits = gpio.out_w1tc; bits; bits &= bits - 1) {
+        pin = __builtin_ctz(bits);
+        pin_write(gpio_t, pin, Edge_Step, false);
+    }
+    for(bits = gpio.out1_w1ts.val; bits; bits &= bits - 1) {
+        pin = __builtin_ctz(bits);
+        pin_write(gpio_t, pin, Edge_Dir, true);
+    }
+    for(bits = gpio.out1_w1tc.val; bits; bits &= bits - 1) {
+        pin = __builtin_ctz(bits);
+        pin_write(gpio_t, pin, Edge_Dir, false);
+    }
+
+    memset(&gpio, 0, sizeof(mock_gpio_t));
+    gpio_pending = false;
+}
+
+mock_gpio_t *mock_gpio (void)
+{
+    gpio_flush();
+    mock_cpu_cycles(cost.gpio_write);
+    gpio_t = hw.now;
+    gpio_pending = true;
+
+    return &gpio;
+}
+
+/*** RMT ***/
+
+mock_rmt_t *mock_rmt (void)
+{
+    mock_cpu_cycles(cost.rmt_write);
+
+    return &rmt;
+}
+
+int rmt_config (const rmt_config_t *config)
+{
+    mock_rmt_channel_t *channel = &hw.rmt[config->channel];
+
+    channel->clk_div = config->clk_div;
+    channel->motor = (uint8_t)config->gpio_num;
+    hw.gpio_level[channel->motor * 2 + Edge_Step] = config->tx_config.idle_level;
+
+    return 0;
+}
+
+int rmt_fill_tx_items (uint32_t channel, const rmt_item32_t *item, uint16_t item_num, uint16_t mem_offset)
+{
+    hw.rmt[channel].duration0 = item[0].duration0;
+    hw.rmt[channel].level0 = item[0].level0;
+    hw.rmt[channel].duration1 = item[0].duration1;
+    hw.rmt[channel].level1 = item[0].level1;
+
+    return 0;
+}
+
+// The channel drives level0 for duration0 ticks then level1 for duration1 ticks,
+// level0 is the idle level as set up by initRMT().
+static void rmt_channel_start (uint32_t channel)
+{
+    mock_rmt_channel_t *rmt = &hw.rmt[channel];
+    sim_time_t t0 = hw.now + ((sim_time_t)rmt->duration0 * rmt->clk_div * 1000000000ULL) / SIM_F_RMT_APB,
+               t1 = hw.now + ((sim_time_t)(rmt->duration0 + rmt->duration1) * rmt->clk_div * 1000000000ULL) / SIM_F_RMT_APB;
+
+    if(hw.now < rmt->busy_until)
+        hw.retriggers++;
+
+    trace_add(t0, rmt->motor, Edge_Step, rmt->level1);
+    trace_add(t1, rmt->motor, Edge_Step, rmt->level0);
+
+    rmt->busy_until = t1;
+}
+
+void rmt_ll_tx_reset_pointer (mock_rmt_t *dev, uint32_t channel)
+{
+}
+
+// With TX sync enabled the channels in the group start together when the last of them is started.
+void rmt_ll_tx_start (mock_rmt_t *dev, uint32_t channel)
+{
+    uint32_t group = dev->tx_sim.val & ~MOCK_RMT_TX_SIM_EN;
+
+    if((dev->tx_sim.val & MOCK_RMT_TX_SIM_EN) && (group & bit(channel))) {
+        if(((rmt_sync_pending |= bit(channel)) & group) == group) {
+            for(; rmt_sync_pending; rmt_sync_pending &= rmt_sync_pending - 1)
+                rmt_channel_start(__builtin_ctz(rmt_sync_pending));
+        }
+    } else
+        rmt_channel_start(channel);
+}
+
+void rmt_ll_tx_enable_sync (mock_rmt_t *dev, bool enable)
+{
+    if(enable)
+        dev->tx_sim.val |= MOCK_RMT_TX_SIM_EN;
+    else
+        dev->tx_sim.val &= ~MOCK_RMT_TX_SIM_EN;
+}
+
+/*** I2S ***/
+
+static void i2s_latch (sim_time_t t, i2s_out_data_t data)
+{
+    i2s_out_data_t changed = data ^ hw.i2s.pin_level;
+    uint32_t bit;
+
+    while(changed) {
+        bit = __builtin_ctzll(changed);
+        changed &= changed - 1;
+        pin_write(t, bit >> 1, bit & 1 ? Edge_Dir : Edge_Step, (data >> bit) & 1);
+    }
+
+    hw.i2s.pin_level = data;
+}
+
+static void i2s_flush (void)
+{
+    if(i2s_pending) {
+        i2s_latch(i2s_pending_t, i2s_pending_data);
+        i2s_pending = false;
+    }
+}
+
+// Passthrough: the data register is shifted out every sample period, a write is latched
+// at the next sample boundary and writes within the same period collapse into one.
+void i2s_out_write_mask (i2s_out_data_t set, i2s_out_data_t clear)
+{
+    i2s_out_data_t port_data;
+
+    mock_cpu_cycles(cost.i2s_write);
+
+    for(int i = 0; i < I2S_STREAM_WORDS; i++) {
+        atomic_fetch_and(&i2s_port_data[i], ~(uint32_t)clear);
+        atomic_fetch_or(&i2s_port_data[i], (uint32_t)set);
+#if I2S_STREAM_WORDS == 2
+        set >>= 32;
+        clear >>= 32;
+#endif
+    }
+
+    if(!hw.i2s.streaming) {
+
+        sim_time_t boundary = (hw.now / SIM_SAMPLE_NS + 1) * SIM_SAMPLE_NS;
+
+        port_data = i2s_stream_port_data(&hw.i2s.stream);
+
+        if(i2s_pending && i2s_pending_t < boundary)
+            i2s_flush();
+
+        i2s_pending = true;
+        i2s_pending_t = boundary;
+        i2s_pending_data = port_data;
+    }
+}
+
+uint32_t i2s_out_push_sample (uint32_t num)
+{
+    mock_cpu_cycles(cost.i2s_write);
+
+    return i2s_stream_push(&hw.i2s.stream, num);
+}
+
+uint32_t i2s_out_push_pulse (i2s_out_data_t mask, i2s_out_data_t level, uint32_t num)
+{
+    mock_cpu_cycles(cost.i2s_write);
+
+    return i2s_stream_push_pulse(&hw.i2s.stream, mask, level, num);
+}
+
+uint32_t i2s_out_set_depth (uint32_t usec)
+{
+    uint32_t samples = usec / I2S_OUT_USEC_PER_PULSE;
+
+    hw.i2s.samples = samples < I2S_OUT_MIN_DMABUF_SAMPLES ? I2S_OUT_MIN_DMABUF_SAMPLES : (samples > I2S_OUT_MAX_SAMPLES ? I2S_OUT_MAX_SAMPLES : samples);
+
+    return hw.i2s.samples * I2S_OUT_USEC_PER_PULSE;
+}
+
+void i2s_out_set_pulse_period (uint32_t period)
+{
+    hw.i2s.stream.pulse_period = period;
+}
+
+void i2s_out_set_pulse_batch (i2s_out_pulse_batch_func_t func, i2s_out_data_t mask, uint32_t samples)
+{
+    hw.i2s.batch_func = func;
+    hw.i2s.stream.pulse_batch_func = func;
+    hw.i2s.stream.step_mask = mask;
+    hw.i2s.stream.step_samples = samples;
+}
+
+void mock_i2s_set_streaming (i2s_out_pulse_func_t pulse_func)
+{
+    i2s_flush();
+
+    hw.i2s.streaming = true;
+    hw.i2s.stream.pulse_func = pulse_func;
+    i2s_stream_reset(&hw.i2s.stream, NULL);
+    i2s_pulser_status = STEPPING;
+}
+
+void mock_i2s_latch_samples (const uint32_t *buf, uint32_t n, sim_time_t t)
+{
+    i2s_out_data_t sample;
+
+    while(n--) {
+#if I2S_STREAM_WORDS == 2
+        sample = (i2s_out_data_t)buf[I2S_STREAM_LO_WORD] | ((i2s_out_data_t)buf[I2S_STREAM_LO_WORD ^ 1] << 32);
+#else
+        sample = *buf;
+#endif
+        buf += I2S_STREAM_WORDS;
+        i2s_latch(t, sample);
+        t += SIM_SAMPLE_NS;
+    }
+}
+
+/*** Simulator ***/
+
+void mock_hw_reset (uint32_t trace_size)
+{
+    sim_edge_t *edges = hw.trace.edges;
+
+    if(hw.trace.size != trace_size) {
+        free(edges);
+        edges = calloc(trace_size, sizeof(sim_edge_t));
+    }
+
+    memset(&hw, 0, sizeof(mock_hw_t));
+    memset(&timg, 0, sizeof(mock_timg_t));
+    memset(&gpio, 0, sizeof(mock_gpio_t));
+    memset(&rmt, 0, sizeof(mock_rmt_t));
+    memset(&sys, 0, sizeof(system_t));
+
+    gpio_pending = i2s_pending = false;
+    rmt_sync_pending = 0;
+    timg_t = gpio_t = 0;
+
+    for(int i = 0; i < I2S_STREAM_WORDS; i++)
+        atomic_store(&i2s_port_data[i], 0);
+    i2s_pulser_status = PASSTHROUGH;
+    hw.i2s.stream.pulser_status = &i2s_pulser_status;
+    hw.i2s.stream.port_data = i2s_port_data;
+    hw.i2s.samples = I2S_OUT_SHALLOW_DMABUF_USEC / I2S_OUT_USEC_PER_PULSE;
+
+    hw.trace.edges = edges;
+    hw.trace.size = edges ? trace_size : 0;
+}
+
+// Applies the register writes pending, I2S passthrough writes latched up to the time given.
+void mock_hw_flush (sim_time_t until)
+{
+    gpio_flush();
+    if(i2s_pending && i2s_pending_t <= until)
+        i2s_flush();
+}
+
+// Applies the output levels set up by the backend init and restarts the time and the trace from them.
+void mock_hw_settle (void)
+{
+    mock_hw_flush((sim_time_t)-1);
+
+    hw.now = 0;
+    hw.retriggers = 0;
+    hw.trace.count = 0;
+    hw.trace.overflow = false;
+    hw.pulse_timer.armed = false;
+}
+
+void mock_hw_free (void)
+{
+    free(hw.trace.edges);
+    memset(&hw, 0, sizeof(mock_hw_t));
+}
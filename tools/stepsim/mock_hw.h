@@ -0,0 +1,243 @@
+/*
+  mock_hw.h - mock TIMERG0/GPIO/RMT registers and I2S output driver for the step timing simulator
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  The peripherals are accessed by main/step_out.h through the same names as in the ESP-IDF, TIMERG0, GPIO and RMT
+  expand to a call returning the register block that charges the access with its cost in CPU cycles.
+  GPIO set/clear register writes take effect at the time of the access and are applied on the next access
+  or by mock_hw_flush(), I2S passthrough writes at the next sample boundary.
+*/
+
+#ifndef _MOCK_HW_H_
+#define _MOCK_HW_H_
+
+#include <stdio.h>
+
+#include "mock_grbl.h"
+
+#define SIM_F_MCU        240000000UL    // CPU clock, CCOUNT rate
+#define SIM_F_STEP_TIMER 20000000UL     // TIMERG0 clocked via STEPPER_DRIVER_PRESCALER 4
+#define SIM_F_RMT_APB    80000000UL     // RMT source clock, divided by rmt_config_t.clk_div
+
+#define SIM_SAMPLE_NS ((sim_time_t)I2S_OUT_USEC_PER_PULSE * 1000ULL)
+
+// Virtual time is kept in nanoseconds.
+typedef uint64_t sim_time_t;
+
+typedef enum {
+    Edge_Step = 0,
+    Edge_Dir
+} edge_type_t;
+
+typedef struct {
+    sim_time_t t;
+    uint8_t motor;
+    uint8_t type;
+    uint8_t level;
+} sim_edge_t;
+
+typedef struct {
+    sim_edge_t *edges;
+    uint32_t count;
+    uint32_t size;
+    bool overflow;
+} sim_trace_t;
+
+// CPU cycles spent in the building blocks of the step paths, @ 240 MHz.
+typedef struct {
+    uint32_t isr_entry;     // Interrupt entry latency + context save/restore
+    uint32_t core_tick;     // grblHAL core stepper interrupt callback, Bresenham and segment bookkeeping
+    uint32_t batch_step;    // Bresenham step of I2SStepperPulseBatch()
+    uint32_t gpio_write;    // GPIO register access
+    uint32_t rmt_write;     // RMT register access
+    uint32_t timer_write;   // TIMERG0 register access
+    uint32_t i2s_write;     // i2s_out_write_mask(), i2s_out_push_sample() and i2s_out_push_pulse() calls
+    uint32_t i2s_sample;    // DMA buffer sample written by i2s_stream_fill()
+} sim_cost_t;
+
+/*** TIMERG0, the ESP32 and ESP32-S3 names of the fields used ***/
+
+#define TIMER_0 0
+#define TIMER_1 1
+#define TIMER_ALARM_EN 1
+#define STEP_TIMER_INDEX TIMER_0
+
+typedef struct {
+    uint32_t reload;
+    uint32_t alarm_low;
+    uint32_t alarm_high;
+    struct {
+        uint32_t val;
+    } alarmlo, alarmhi;
+    struct {
+        uint32_t enable;
+        uint32_t alarm_en;
+        uint32_t tn_en;
+        uint32_t tn_alarm_en;
+    } config;
+} mock_timg_timer_t;
+
+typedef struct {
+    mock_timg_timer_t hw_timer[2];
+    struct {
+        uint32_t t0;
+        uint32_t t1;
+    } int_clr_timers;
+} mock_timg_t;
+
+#define TIMERG0 (*mock_timg())
+
+/*** GPIO ***/
+
+typedef struct {
+    uint32_t out_w1ts;
+    uint32_t out_w1tc;
+    struct {
+        uint32_t val;
+    } out1_w1ts, out1_w1tc;
+} mock_gpio_t;
+
+#define GPIO (*mock_gpio())
+
+/*** RMT ***/
+
+#define MOCK_RMT_TX_SIM_EN bit(31)  // TX sync enable, channel bits below
+
+typedef struct {
+    struct {
+        uint32_t val;
+    } tx_sim;
+} mock_rmt_t;
+
+#define RMT (*mock_rmt())
+
+typedef struct {
+    uint32_t duration0 :15;
+    uint32_t level0    :1;
+    uint32_t duration1 :15;
+    uint32_t level1    :1;
+} rmt_item32_t;
+
+typedef enum {
+    RMT_MODE_TX = 0
+} rmt_mode_t;
+
+typedef enum {
+    RMT_CARRIER_LEVEL_LOW = 0
+} rmt_carrier_level_t;
+
+typedef struct {
+    rmt_mode_t rmt_mode;
+    uint32_t channel;
+    int gpio_num;
+    uint8_t clk_div;
+    uint8_t mem_block_num;
+    struct {
+        bool loop_en;
+        bool carrier_en;
+        uint32_t carrier_freq_hz;
+        uint8_t carrier_duty_percent;
+        rmt_carrier_level_t carrier_level;
+        bool idle_output_en;
+        uint32_t idle_level;
+    } tx_config;
+} rmt_config_t;
+
+int rmt_config (const rmt_config_t *config);
+int rmt_fill_tx_items (uint32_t channel, const rmt_item32_t *item, uint16_t item_num, uint16_t mem_offset);
+void rmt_ll_tx_reset_pointer (mock_rmt_t *dev, uint32_t channel);
+void rmt_ll_tx_start (mock_rmt_t *dev, uint32_t channel);
+void rmt_ll_tx_enable_sync (mock_rmt_t *dev, bool enable);
+
+/*** I2S output driver, see main/i2s_out.h ***/
+
+#define I2S_OUT_SHALLOW_DMABUF_USEC 100
+#define I2S_OUT_DEEP_DMABUF_USEC (500 * I2S_OUT_USEC_PER_PULSE)  // I2S_OUT_DMABUF_LEN / I2S_OUT_SAMPLE_SIZE samples
+#define I2S_OUT_MIN_DMABUF_SAMPLES (SAMPLE_SAFE_COUNT * 2 + 2)
+#define I2S_OUT_MAX_SAMPLES (I2S_OUT_DEEP_DMABUF_USEC / I2S_OUT_USEC_PER_PULSE)
+
+void i2s_out_write_mask (i2s_out_data_t set, i2s_out_data_t clear);
+uint32_t i2s_out_push_sample (uint32_t num);
+uint32_t i2s_out_push_pulse (i2s_out_data_t mask, i2s_out_data_t level, uint32_t num);
+uint32_t i2s_out_set_depth (uint32_t usec);
+void i2s_out_set_pulse_period (uint32_t period);
+void i2s_out_set_pulse_batch (i2s_out_pulse_batch_func_t func, i2s_out_data_t mask, uint32_t samples);
+
+/*** Simulator side ***/
+
+typedef struct {
+    uint32_t clk_div;
+    uint8_t motor;
+    uint8_t level0;         // idle level
+    uint8_t level1;
+    uint16_t duration0;
+    uint16_t duration1;
+    sim_time_t busy_until;
+} mock_rmt_channel_t;
+
+typedef struct {
+    bool armed;
+    sim_time_t due;
+} mock_pulse_timer_t;
+
+typedef struct {
+    bool streaming;
+    uint32_t samples;           // DMA buffer samples while streaming, set by i2s_out_set_depth()
+    i2s_out_data_t pin_level;   // Output latched by the shift registers
+    i2s_out_pulse_batch_func_t batch_func;
+    i2s_stream_t stream;
+} mock_i2s_t;
+
+typedef struct {
+    sim_time_t now;             // CPU time of the currently executing code
+    uint32_t retriggers;        // RMT channel started while still transmitting
+    mock_pulse_timer_t pulse_timer;
+    mock_rmt_channel_t rmt[N_MOTORS];
+    uint8_t gpio_level[N_MOTORS * 2];
+    mock_i2s_t i2s;
+    sim_trace_t trace;
+} mock_hw_t;
+
+extern mock_hw_t hw;
+extern sim_cost_t cost;
+
+mock_timg_t *mock_timg (void);
+mock_gpio_t *mock_gpio (void);
+mock_rmt_t *mock_rmt (void);
+
+void mock_hw_reset (uint32_t trace_size);
+void mock_hw_settle (void);
+void mock_hw_flush (sim_time_t until);
+void mock_hw_free (void);
+
+// Advance CPU time by a number of CPU cycles.
+void mock_cpu_cycles (uint32_t cycles);
+
+// Step timer alarm interval in timer ticks.
+uint32_t mock_step_timer_period (void);
+// Picks up a start or stop of the pulse timer (TIMERG0 timer 1) by the code just run.
+void mock_pulse_timer_poll (void);
+
+void mock_i2s_set_streaming (i2s_out_pulse_func_t pulse_func);
+// Streaming: latches the samples of a filled DMA buffer, the first at time t.
+void mock_i2s_latch_samples (const uint32_t *buf, uint32_t n, sim_time_t t);
+
+#endif // _MOCK_HW_H_
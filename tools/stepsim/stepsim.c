@@ -0,0 +1,608 @@
+/*
+  stepsim.c - host-side step timing simulator for the ESP32 driver step backends
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runs the step output configurations of main/step_out.h, compiled against the mock register layer in mock_hw.c,
+  with a model of the grblHAL core stepper callback stepping a Bresenham line at a constant rate.
+  The step/dir edges output are recorded and checked against $0 (pulse width) and $29 (dir setup time),
+  the highest clean rate is found by bisection.
+
+  Usage: stepsim [options]
+    -b, --backend <rmt|rmt-s3|i2s-passthrough|i2s-streaming|all>  default all
+    -a, --axes <n>          number of axes stepping, 1 - 6, default 3
+    -g, --ganged <mask>     ganged axes mask, bit 0 = X2, bit 1 = Y2, bit 2 = Z2, default 0
+    -p, --pulse <us>        $0, step pulse length, default 5.0
+    -d, --delay <us>        $29, step pulse delay (dir setup time), default 0.0
+    -i, --step-invert <mask> $2, default 0
+    -n, --ticks <n>         number of step events per run, default 5000
+    -e, --dir-every <n>     step events per block, the direction is reversed every block, default 250
+    -m, --segment <n>       step events per segment, default 50
+    -c, --core <cycles>     core stepper callback cost in CPU cycles, default 700
+    -l, --load <percent>    max CPU load for the streaming backend, default 90
+    -x, --no-batch          streaming: run the core stepper callback for every step, no I2SStepperPulseBatch()
+    -r, --rate <steps/s>    run at a single rate and report, no search
+    -t, --trace <file>      write the edge trace (csv) of the single rate run
+*/
+
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "stepsim.h"
+
+typedef struct {
+    uint8_t n_axis;
+    axes_signals_t ganged;
+    uint32_t ticks;
+    uint32_t block;
+    uint32_t segment;
+    uint32_t max_load;
+    bool no_batch;
+} sim_scenario_t;
+
+typedef struct {
+    uint32_t steps_commanded;
+    uint32_t steps_seen;
+    uint32_t width_violations;
+    uint32_t dir_violations;
+    uint32_t overruns;
+    uint32_t retriggers;
+    sim_time_t min_width;
+    sim_time_t min_dir_setup;
+    sim_time_t max_isr;
+    int64_t lag;
+    float load;
+} sim_result_t;
+
+static const sim_backend_t *const backends[] = {
+    &backend_rmt,
+    &backend_rmt_s3,
+    &backend_i2s_passthrough,
+    &backend_i2s_streaming
+};
+
+#define N_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static sim_scenario_t scenario = {
+    .n_axis = 3,
+    .ticks = 5000,
+    .block = 250,
+    .segment = 50,
+    .max_load = 90
+};
+
+static settings_t settings;
+static const sim_backend_t *backend;
+
+/*** grblHAL core stepper callback model ***/
+
+static stepper_t st;
+static segment_t segment;
+
+static struct {
+    uint32_t cycles_per_tick;
+    uint32_t loaded;                // step events of the segments loaded
+    uint32_t block_remain;          // step events left of the current block
+    uint32_t computed[N_MOTORS];    // steps traced
+    sim_time_t stream_t;            // streaming: time of the first sample of the buffer being filled
+    sim_time_t pulse_t;             // streaming: time of the last pulse callback
+    uint32_t pulse_event;           // streaming: step events traced at the last pulse callback
+} core;
+
+static uint32_t *const counter[N_AXIS] = {
+    &st.counter_x, &st.counter_y, &st.counter_z, &st.counter_a, &st.counter_b, &st.counter_c
+};
+
+// Step events traced, the last is pending output.
+static inline uint32_t core_events (void)
+{
+    return core.loaded - st.step_count;
+}
+
+static void core_count (uint_fast8_t axis, int32_t steps)
+{
+    core.computed[axis] += steps;
+    if(axis < N_GANGED && (scenario.ganged.mask & bit(axis)))
+        core.computed[X2_MOTOR + axis] += steps;
+}
+
+// Axis n steps (n_axis - n) / n_axis as often as the dominant X axis.
+static void core_init (uint32_t rate)
+{
+    uint_fast8_t idx;
+
+    memset(&st, 0, sizeof(stepper_t));
+    memset(&core, 0, sizeof(core));
+
+    core.cycles_per_tick = SIM_F_STEP_TIMER / rate;
+
+    st.step_event_count = 1000;
+    for(idx = 0; idx < scenario.n_axis; idx++)
+        st.steps[idx] = st.step_event_count * (scenario.n_axis - idx) / scenario.n_axis;
+}
+
+// The part of the core stepper interrupt handler run after hal.stepper.pulse_start():
+// loads the next segment when the current is completed and traces the step to output next.
+static void core_tick (void)
+{
+    uint_fast8_t idx;
+
+    st.new_block = st.dir_change = false;
+
+    if(st.step_count == 0)
+        st.exec_segment = NULL;
+
+    if(st.exec_segment == NULL) {
+
+        if(core.block_remain == 0) {
+            core.block_remain = scenario.block;
+            st.new_block = true;
+            for(idx = 0; idx < N_AXIS; idx++)
+                *counter[idx] = st.step_event_count >> 1;
+            if(core.loaded) {
+                st.dir_outbits.mask ^= (1 << scenario.n_axis) - 1;
+                st.dir_change = true;
+            }
+        }
+
+        segment.n_step = min(scenario.segment, core.block_remain);
+        core.block_remain -= segment.n_step;
+        core.loaded += segment.n_step;
+        st.exec_segment = &segment;
+        st.step_count = segment.n_step;
+
+        backend->cycles_per_tick(core.cycles_per_tick);
+    }
+
+    st.step_outbits.value = 0;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if((*counter[idx] += st.steps[idx]) > st.step_event_count) {
+            *counter[idx] -= st.step_event_count;
+            st.step_outbits.mask |= bit(idx);
+            sys.position[idx] += st.dir_outbits.mask & bit(idx) ? -1 : 1;
+            core_count(idx, 1);
+        }
+    }
+
+    st.step_count--;
+
+    mock_cpu_cycles(cost.core_tick);
+}
+
+// Steps traced but not output when the run ends are not commanded.
+static void core_end (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(st.step_outbits.mask & bit(idx))
+            core_count(idx, -1);
+    }
+}
+
+/*** Step timer ISR driven backends ***/
+
+// Runs pulse timer interrupts due before the time given, they are delayed by an interrupt in progress.
+static void run_pulse_timer (sim_time_t until, sim_time_t *isr_free, sim_time_t *busy)
+{
+    sim_time_t start;
+
+    while(backend->pulse_timer_isr && hw.pulse_timer.armed && hw.pulse_timer.due <= until) {
+        hw.now = start = *isr_free > hw.pulse_timer.due ? *isr_free : hw.pulse_timer.due;
+        hw.pulse_timer.armed = false;
+        mock_cpu_cycles(cost.isr_entry);
+        backend->pulse_timer_isr();
+        mock_pulse_timer_poll();
+        mock_hw_flush(hw.now);
+        *isr_free = hw.now;
+        *busy += *isr_free - start;
+    }
+}
+
+// The step timer auto reloads so alarms are at fixed intervals regardless of ISR execution time,
+// an alarm arriving while the previous one is still pending is lost (overrun).
+static void run_isr (sim_result_t *result)
+{
+    sim_time_t t_alarm = 0, period, isr_free = 0, busy = 0, start;
+
+    while(core_events() < scenario.ticks) {
+
+        run_pulse_timer(t_alarm, &isr_free, &busy);
+
+        period = ((sim_time_t)mock_step_timer_period() * 1000000000ULL) / SIM_F_STEP_TIMER;
+
+        if(isr_free > t_alarm + period)
+            result->overruns++;
+
+        hw.now = start = isr_free > t_alarm ? isr_free : t_alarm;
+
+        mock_cpu_cycles(cost.isr_entry);
+        backend->pulse_start(&st);
+        mock_pulse_timer_poll();
+        core_tick();
+        mock_hw_flush(hw.now);
+
+        isr_free = hw.now;
+        busy += isr_free - start;
+        if(isr_free - start > result->max_isr)
+            result->max_isr = isr_free - start;
+
+        t_alarm += ((sim_time_t)mock_step_timer_period() * 1000000000ULL) / SIM_F_STEP_TIMER;
+    }
+
+    run_pulse_timer((sim_time_t)-1, &isr_free, &busy);
+
+    result->load = t_alarm ? (float)busy / (float)t_alarm : 0.0f;
+}
+
+/*** I2S streaming ***/
+
+// Pulse callback, i2s_stream_fill() runs the core stepper callback when a pulse is due.
+static void stream_pulse (void)
+{
+    core.pulse_t = core.stream_t + hw.i2s.stream.rw_pos * SIM_SAMPLE_NS;
+    core.pulse_event = core_events();
+
+    backend->pulse_start(&st);
+    core_tick();
+}
+
+// Batch callback, the steps traced by I2SStepperPulseBatch() are counted from the position change.
+static uint32_t stream_batch (i2s_stream_pulse_t *pulses, uint32_t max)
+{
+    uint_fast8_t idx;
+    int32_t position[N_AXIS];
+    uint32_t n;
+
+    memcpy(position, sys.position, sizeof(position));
+
+    n = hw.i2s.batch_func(pulses, max);
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        core_count(idx, abs(sys.position[idx] - position[idx]));
+
+    mock_cpu_cycles(cost.batch_step * n);
+
+    return n;
+}
+
+// Mirrors i2s_fillout_dma_buffer(), the DMA buffers are shifted out at the sample rate and the CPU time
+// for filling them is accumulated separately. The lag is how far the last pulse callback is behind
+// the time it is due at the commanded rate.
+static void run_streaming (uint32_t rate, sim_result_t *result)
+{
+    static uint32_t buf[I2S_OUT_MAX_SAMPLES * I2S_STREAM_WORDS];
+
+    sim_time_t limit = ((sim_time_t)scenario.ticks * 1000000000ULL / rate) * 4 + 10000000ULL;
+
+    mock_i2s_set_streaming(stream_pulse);
+    hw.i2s.stream.pulse_batch_func = hw.i2s.batch_func && !scenario.no_batch ? stream_batch : NULL;
+
+    while(core_events() < scenario.ticks && core.stream_t < limit) {
+        i2s_stream_fill(&hw.i2s.stream, buf, hw.i2s.samples);
+        mock_cpu_cycles(cost.i2s_sample * hw.i2s.stream.rw_pos);
+        mock_i2s_latch_samples(buf, hw.i2s.stream.rw_pos, core.stream_t);
+        core.stream_t += hw.i2s.stream.rw_pos * SIM_SAMPLE_NS;
+    }
+
+    // The step traced at the last pulse callback is output when the period following it has elapsed.
+    result->lag = (int64_t)core.pulse_t - (int64_t)(((sim_time_t)core.pulse_event * core.cycles_per_tick * 1000000000ULL) / SIM_F_STEP_TIMER);
+    result->load = core.stream_t ? (float)hw.now / (float)core.stream_t : 0.0f;
+}
+
+/*** Analysis ***/
+
+static int cmp_edge (const void *a, const void *b)
+{
+    const sim_edge_t *ea = a, *eb = b;
+
+    return ea->t < eb->t ? -1 : (ea->t > eb->t ? 1 : 0);
+}
+
+static void analyze (sim_result_t *result)
+{
+    uint_fast8_t motor;
+    uint32_t idx;
+    sim_time_t step_rise[N_MOTORS], dir_edge[N_MOTORS];
+    bool has_dir_edge[N_MOTORS] = {0}, in_pulse[N_MOTORS] = {0};
+    sim_time_t width_min = (sim_time_t)(settings.steppers.pulse_microseconds * 1000.0f);
+    sim_time_t setup_min = (sim_time_t)(settings.steppers.pulse_delay_microseconds * 1000.0f);
+
+    qsort(hw.trace.edges, hw.trace.count, sizeof(sim_edge_t), cmp_edge);
+
+    result->min_width = result->min_dir_setup = (sim_time_t)-1;
+
+    for(idx = 0; idx < hw.trace.count; idx++) {
+
+        sim_edge_t *edge = &hw.trace.edges[idx];
+        bool active = edge->level != ((settings.steppers.step_invert.mask >> (edge->motor >= X2_MOTOR ? edge->motor - X2_MOTOR : edge->motor)) & 1);
+
+        motor = edge->motor;
+
+        if(edge->type == Edge_Dir) {
+            if(in_pulse[motor])
+                result->dir_violations++;
+            dir_edge[motor] = edge->t;
+            has_dir_edge[motor] = true;
+        } else if(active) {
+            in_pulse[motor] = true;
+            step_rise[motor] = edge->t;
+            result->steps_seen++;
+            if(has_dir_edge[motor]) {
+                sim_time_t setup = edge->t - dir_edge[motor];
+                if(setup < result->min_dir_setup)
+                    result->min_dir_setup = setup;
+                if(setup < setup_min)
+                    result->dir_violations++;
+                has_dir_edge[motor] = false;
+            }
+        } else if(in_pulse[motor]) {
+            sim_time_t width = edge->t - step_rise[motor];
+            in_pulse[motor] = false;
+            if(width < result->min_width)
+                result->min_width = width;
+            if(width < width_min)
+                result->width_violations++;
+        }
+    }
+
+    for(motor = 0; motor < N_MOTORS; motor++)
+        result->steps_commanded += core.computed[motor];
+
+    result->retriggers = hw.retriggers;
+}
+
+// The streaming lag may not exceed one step interval + 1% of the run.
+static bool result_ok (uint32_t rate, sim_result_t *result)
+{
+    int64_t max_lag = (int64_t)(1000000000ULL / rate) + (int64_t)((sim_time_t)scenario.ticks * 10000000ULL / rate);
+
+    return result->steps_seen == result->steps_commanded &&
+            result->width_violations == 0 &&
+             result->dir_violations == 0 &&
+              result->overruns == 0 &&
+               result->retriggers == 0 &&
+                result->lag <= max_lag &&
+                 !hw.trace.overflow &&
+                  (backend->mode != Sim_Streaming || result->load * 100.0f <= (float)scenario.max_load);
+}
+
+static bool simulate (const sim_backend_t *sim_backend, uint32_t rate, sim_result_t *result)
+{
+    memset(result, 0, sizeof(sim_result_t));
+
+    backend = sim_backend;
+
+    mock_hw_reset(scenario.ticks * N_MOTORS * 4 + 64);
+    core_init(rate);
+    backend->init(&settings, scenario.ganged);
+    backend->cycles_per_tick(core.cycles_per_tick);
+    mock_hw_settle();
+
+    if(backend->mode == Sim_Streaming)
+        run_streaming(rate, result);
+    else
+        run_isr(result);
+
+    mock_hw_flush((sim_time_t)-1);
+    core_end();
+    analyze(result);
+
+    return result_ok(rate, result);
+}
+
+static void print_result (const sim_backend_t *backend, uint32_t rate, sim_result_t *result)
+{
+    printf("%-16s %8u steps/s  steps %u/%u  width min %.2f us (%u violations)  dir setup min %.2f us (%u violations)  overruns %u  retriggers %u  lag %.1f us  isr max %.2f us  load %.0f%%\n",
+            backend->name, rate,
+            result->steps_seen, result->steps_commanded,
+            result->min_width == (sim_time_t)-1 ? 0.0f : (float)result->min_width / 1000.0f, result->width_violations,
+            result->min_dir_setup == (sim_time_t)-1 ? 0.0f : (float)result->min_dir_setup / 1000.0f, result->dir_violations,
+            result->overruns, result->retriggers, (float)result->lag / 1000.0f,
+            (float)result->max_isr / 1000.0f, result->load * 100.0f);
+}
+
+static void write_trace (const char *filename)
+{
+    FILE *file;
+
+    if((file = fopen(filename, "w")) == NULL) {
+        perror(filename);
+        return;
+    }
+
+    fprintf(file, "t_ns,motor,signal,level\n");
+    for(uint32_t idx = 0; idx < hw.trace.count; idx++)
+        fprintf(file, "%llu,%u,%s,%u\n", (unsigned long long)hw.trace.edges[idx].t, hw.trace.edges[idx].motor,
+                                           hw.trace.edges[idx].type == Edge_Dir ? "dir" : "step", hw.trace.edges[idx].level);
+    fclose(file);
+}
+
+// Largest rate in steps/s that runs clean, assumes failures are monotonic in rate.
+static uint32_t find_max_rate (const sim_backend_t *backend, sim_result_t *result)
+{
+    uint32_t lo = 0, hi = 2000000, mid;
+
+    while(hi - lo > 100) {
+        mid = lo + (hi - lo) / 2;
+        if(simulate(backend, mid, result))
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if(lo)
+        simulate(backend, lo, result);
+
+    return lo;
+}
+
+int main (int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "backend",     required_argument, NULL, 'b' },
+        { "axes",        required_argument, NULL, 'a' },
+        { "ganged",      required_argument, NULL, 'g' },
+        { "pulse",       required_argument, NULL, 'p' },
+        { "delay",       required_argument, NULL, 'd' },
+        { "step-invert", required_argument, NULL, 'i' },
+        { "ticks",       required_argument, NULL, 'n' },
+        { "dir-every",   required_argument, NULL, 'e' },
+        { "segment",     required_argument, NULL, 'm' },
+        { "core",        required_argument, NULL, 'c' },
+        { "load",        required_argument, NULL, 'l' },
+        { "no-batch",    no_argument,       NULL, 'x' },
+        { "rate",        required_argument, NULL, 'r' },
+        { "trace",       required_argument, NULL, 't' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt, backend_id = -1;
+    uint32_t rate = 0;
+    const char *trace = NULL;
+    sim_result_t result;
+
+    settings.steppers.pulse_microseconds = 5.0f;
+    settings.steppers.pulse_delay_microseconds = 0.0f;
+
+    cost = (sim_cost_t){
+        .isr_entry = 120,
+        .core_tick = 700,
+        .batch_step = 60,
+        .gpio_write = 12,
+        .rmt_write = 12,
+        .timer_write = 8,
+        .i2s_write = 40,
+        .i2s_sample = 2
+    };
+
+    while((opt = getopt_long(argc, argv, "b:a:g:p:d:i:n:e:m:c:l:xr:t:", options, NULL)) != -1) switch(opt) {
+
+        case 'b':
+            if(strcmp(optarg, "all")) {
+                for(backend_id = 0; backend_id < (int)N_BACKENDS; backend_id++) {
+                    if(!strcmp(optarg, backends[backend_id]->name))
+                        break;
+                }
+                if(backend_id == (int)N_BACKENDS) {
+                    fprintf(stderr, "unknown backend: %s\n", optarg);
+                    return 1;
+                }
+            }
+            break;
+
+        case 'a':
+            scenario.n_axis = (uint8_t)atoi(optarg);
+            if(scenario.n_axis < 1 || scenario.n_axis > N_AXIS) {
+                fprintf(stderr, "axes must be 1 - %d\n", N_AXIS);
+                return 1;
+            }
+            break;
+
+        case 'g':
+            scenario.ganged.mask = (uint8_t)strtoul(optarg, NULL, 0) & 0x07;
+            break;
+
+        case 'p':
+            settings.steppers.pulse_microseconds = strtof(optarg, NULL);
+            break;
+
+        case 'd':
+            settings.steppers.pulse_delay_microseconds = strtof(optarg, NULL);
+            break;
+
+        case 'i':
+            settings.steppers.step_invert.mask = (uint8_t)strtoul(optarg, NULL, 0) & AXES_BITMASK;
+            break;
+
+        case 'n':
+            scenario.ticks = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'e':
+            scenario.block = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'm':
+            scenario.segment = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'c':
+            cost.core_tick = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'l':
+            scenario.max_load = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'x':
+            scenario.no_batch = true;
+            break;
+
+        case 'r':
+            rate = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+
+        case 't':
+            trace = optarg;
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-b backend] [-a axes] [-g ganged] [-p pulse_us] [-d delay_us] [-i step_invert]\n"
+                            "       [-n ticks] [-e dir_every] [-m segment] [-c core_cycles] [-l max_load] [-x] [-r rate] [-t trace.csv]\n", argv[0]);
+            return 1;
+    }
+
+    if(scenario.block == 0 || scenario.segment == 0 || scenario.ticks == 0) {
+        fprintf(stderr, "ticks, dir-every and segment must be > 0\n");
+        return 1;
+    }
+
+    printf("axes %u, ganged 0x%02X, $0 %.1f us, $29 %.1f us, %u ticks, core %u cycles @ %lu MHz\n",
+            scenario.n_axis, scenario.ganged.mask, settings.steppers.pulse_microseconds, settings.steppers.pulse_delay_microseconds,
+            scenario.ticks, cost.core_tick, SIM_F_MCU / 1000000UL);
+
+    for(int id = 0; id < (int)N_BACKENDS; id++) {
+
+        if(backend_id >= 0 && id != backend_id)
+            continue;
+
+        if(rate) {
+            bool ok = simulate(backends[id], rate, &result);
+            print_result(backends[id], rate, &result);
+            printf("%-16s %s\n", "", ok ? "ok" : "FAIL");
+            if(trace && backend_id >= 0)
+                write_trace(trace);
+        } else {
+            uint32_t max_rate = find_max_rate(backends[id], &result);
+            printf("%-16s max %u steps/s\n", backends[id]->name, max_rate);
+            if(max_rate)
+                print_result(backends[id], max_rate, &result);
+        }
+    }
+
+    if(trace && (backend_id < 0 || !rate))
+        fprintf(stderr, "trace requires a single backend and rate\n");
+
+    mock_hw_free();
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+  stepsim.h - host-side step timing simulator for the ESP32 driver step paths
+
+  Part of grblHAL
+
+  Copyright (c) 2024 grblHAL contributors
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STEPSIM_H_
+#define _STEPSIM_H_
+
+#include "mock_hw.h"
+
+typedef enum {
+    Sim_StepTimer = 0,  // pulse_start() run from the step timer ISR
+    Sim_Streaming       // pulse_start() run from i2s_stream_fill() as the pulse callback
+} sim_mode_t;
+
+/*
+  A backend is a step output configuration of main/step_out.h, compiled in its own translation unit.
+  init() sets up the outputs from the settings as settings_changed() does, the second motor of the X, Y
+  and Z axes are enabled for the axes in ganged.
+*/
+typedef struct {
+    const char *name;
+    sim_mode_t mode;
+    void (*init)(settings_t *settings, axes_signals_t ganged);
+    void (*pulse_start)(stepper_t *stepper);
+    void (*cycles_per_tick)(uint32_t cycles_per_tick);
+    void (*pulse_timer_isr)(void);  // Passthrough pulse timer (TIMERG0 timer 1) interrupt, optional
+} sim_backend_t;
+
+extern const sim_backend_t backend_rmt;
+extern const sim_backend_t backend_rmt_s3;
+extern const sim_backend_t backend_i2s_passthrough;
+extern const sim_backend_t backend_i2s_streaming;
+
+#endif // _STEPSIM_H_